@@ -0,0 +1,1965 @@
+// Native throughput benchmark for LMCV4Driver + RP2350Laser.
+//
+// Replays LightBurn-style command streams through the real update()/run()
+// against the simulated USB link and galvo in sim/. The host side behaves like
+// LightBurn: poll 0x0025, send a 256-command chunk when READY is set, repeat.
+//
+//   pio run -e native && .pio/build/native/program [scenario...]
+//
+// Reported per scenario:
+//   sim ms      simulated wall time from first byte to galvo idle
+//   KB/s        job bytes per simulated second over the USB link
+//   kcmd/s      job records per simulated second
+//   cpu ns/cmd  host CPU spent in update()/run() per job record, idle passes
+//               included
+//   not-ready   status polls answered with READY cleared
+//   nr ms       simulated time READY was held low by flow control
+//   poll us     mean simulated time from sending a status poll to its reply
+//   writes      USB IN transactions the driver used for its replies
+//   underruns   times the LaserQueue ran dry while jobs were waiting
+//
+// "optimizer" replays every scenario with the path optimizer off and on and
+// compares sim time, galvo segments and the optimizer's own counters.
+// "corners" does the same with the corner planner, and shows how the cuts were
+// split over the polygon delay quarters.
+// "jumps" compares one settle time for every jump (the jump delay) with the
+// default settle-by-length table. No jump may wait longer with the table and
+// no job take longer, and raster has to gain at least 4.6%.
+// "replay" runs a multi-pass job with the host sending every pass against one
+// 0x8023 MARK_COUNT list repeated on the device, and a list too long to record.
+// "full list" is a list just short of the recorder's size sent in one go,
+// "full+polls" the same with status polls mixed in; the polls land behind a
+// full job queue and are handled out of band, and must not use up the
+// recording.
+// "cache" sends the same job several times with the job cache off, on, and on
+// with run-ahead, then a serial plate whose last shape changes every run.
+// "bulk" sends every scenario as plain records and with its moves packed into
+// 0x80F0 bulk vector records (BulkVectors.h), on the normal and a slow link.
+// "segs ok" compares galvo segments with the path optimizer off; with it on
+// the counts may differ, a bulk record hands it a whole run at once.
+// "photo" engraves a 1-bit and an 8-bit photo sent as plain records and as
+// 0x80F1 raster rows (RasterRows.h), on the normal and a slow link. "+segs"
+// is the extra galvo segments the rows cost with the path optimizer off:
+// 8-bit rows take several records, a run across the end of one is cut twice.
+// "lens" runs every scenario, and a job of long cuts, with lens correction
+// off and with a pincushion grid loaded over 0x00F4, then times correcting
+// single points and whole cuts on the host, and checks the pieces of a cut
+// stay within the tolerance of the corrected line.
+// "hatch" checks the executor's hatch fill (HatchFill.h) against a reference
+// hatcher in double precision over shapes, angles, spacings and flags, then
+// sends a job of hatched shapes as plain records and as 0x80F2 outlines.
+// "peak q" is the most job queue entries in use, "+segs" the galvo segments
+// the outlines cost over the plain records with the path optimizer off (a
+// jump back to the first vertex per fill).
+// "flatten" checks the executor's curve flattening (CurveFlatten.h) against
+// the exact arcs and cubics, then sends the curves scenario as plain cuts and
+// as 0x80F3 arcs and 0x80F4 cubics. "job ops" is what went through the job
+// queue, "segs" the galvo segments it took.
+// "usb" pushes a long stream of cheap records without flow control while
+// core 0 only runs update() every "pass us", and reports the sustained link
+// throughput: polled at the top of update() with the old 8 KB RX FIFO and
+// with the 1280-byte one, and moved by the RX callback with the 1280-byte one.
+// "usb irq" sends a job with polls mixed in at once and brings the RX callback
+// in from inside update() (LMCV4_USB_IRQ_POINT): the link runs on for "busy
+// us" where update() holds the stream buffer's write end and the callback has
+// to leave the data in the FIFO, and for "idle us" elsewhere. The galvo has
+// to draw the same path as without, and every poll has to be answered.
+// "stall 1 ms" holds every busy point for a whole update() pass with the host
+// sending at the full speed maximum, and the RX FIFO has to take it all
+// without NAKing the host ("nak ms").
+// "dispatch" times decoding job records with the old switch and through the
+// opcode table, then getting from an op to its handler with a switch on the
+// op kind and through handler pointers. Each pair has to agree.
+// "ingest" moves every scenario from the RX FIFO into the job queue, with the
+// old copy-then-parse update() and with records parsed in place, and needs
+// the same records out of both and in place to be at least 5x faster.
+// "abort" streams a job, then sends a backlog of job records past READY with
+// a 0x0012 behind it, at a few points of the job and with the corner planner
+// off and on, and times host to laser off.
+//
+// Cases that check a bound or an equivalence print FAIL when it does not hold,
+// and the run exits non-zero.
+
+#include "RP2350Laser.h"
+#include "SimUsb.h"
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <random>
+#include <string>
+#include <vector>
+
+static const uint32_t SIM_STEP_US = 5;
+static const uint32_t POLL_INTERVAL_US = 250;
+static const size_t HOST_CHUNK_RECORDS = 256;
+static const size_t ABORT_BACKLOG_RECORDS = 1024;
+static const uint16_t REPLAY_PASSES = 5;
+static const int CACHE_RUNS = 4;
+static const uint16_t CACHE_RUN_AHEAD = 4096;
+static const double SLOW_LINK_BYTES_PER_US = 0.004; // a busy hub or a serial bridge, ~4 KB/s
+static const double BULK_SLOW_LINK_BYTES_PER_US = 0.015; // ~15 KB/s
+static const uint64_t SIM_TIME_LIMIT_US = 600ull * 1000 * 1000;
+
+class BenchLaser : public RP2350Laser {
+public:
+    // What the host does after an error: 0x0012
+    void enableExtensions(uint16_t wanted) {
+        BalorCommand ext = {LMC_OPCODE_EXTENSIONS, {wanted, 0, 0, 0, 0}};
+        handleSystemCommand(ext);
+        _replyLen = 0;
+    }
+    void clearFault() {
+        BalorCommand abort = {0x0012, {0, 0, 0, 0, 0}};
+        handleSystemCommand(abort);
+        _replyLen = 0;
+    }
+    // Loads a grid node by node over 0x00F4 and switches it on, like a host
+    // tool would. Returns the reply flags of the worst command.
+    uint8_t loadLens(const LensGrid& grid) {
+        uint8_t flags = lensCommand(LENS_CLEAR);
+        for (uint16_t n = 0; n < LENS_GRID_NODES; n++)
+            flags |= lensCommand(LENS_NODE, n, (uint16_t)grid.dx[n], (uint16_t)grid.dy[n]);
+        return flags | lensCommand(LENS_APPLY);
+    }
+    uint8_t lensCommand(uint16_t action, uint16_t p1 = 0, uint16_t p2 = 0, uint16_t p3 = 0) {
+        BalorCommand cmd = {LMC_OPCODE_LENS, {action, p1, p2, p3, 0}};
+        handleSystemCommand(cmd);
+        uint8_t flags = _replyBuf[_replyLen - REPORT_SIZE + 2];
+        _replyLen = 0;
+        return flags & (LENS_REPLY_BUSY | LENS_REPLY_BAD);
+    }
+    bool drained() { return _jobQueue.isEmpty() && _usbStreamBuffer.isEmpty() && !_replay.replaying(); }
+    bool rxBusy() const { return _rxBusy; }
+    size_t streamFree() const { return _usbStreamBuffer.capacity() - _usbStreamBuffer.available(); }
+    size_t queued() const { return _jobQueue.available(); }
+    bool decode(const BalorCommand& cmd, JobOp& op) { return decodeJobCommand(cmd, op); }
+    float speedFactor() const { return _galvoSpeedFactor; }
+};
+
+XY2Galvo galvo;
+
+// --------------------------------------------------------------------------
+// JOB GENERATORS
+// --------------------------------------------------------------------------
+
+typedef std::vector<BalorCommand> Job;
+
+static BalorCommand rec(uint16_t opcode, uint16_t p0 = 0, uint16_t p1 = 0) {
+    BalorCommand c = {opcode, {p0, p1, 0, 0, 0}};
+    return c;
+}
+
+// Note the wire order: params[0] is Y, params[1] is X
+static void jump(Job& job, uint16_t x, uint16_t y) { job.push_back(rec(0x8001, y, x)); }
+static void cut(Job& job, uint16_t x, uint16_t y) { job.push_back(rec(0x8005, y, x)); }
+
+static void preamble(Job& job) {
+    job.push_back(rec(0x8051));
+    job.push_back(rec(0x8006, 2035));   // jump speed ~4000 mm/s
+    job.push_back(rec(0x800C, 509));    // mark speed ~1000 mm/s
+    job.push_back(rec(0x8012, 2048));   // power 50%
+    job.push_back(rec(0x800A, 100));    // frequency
+    job.push_back(rec(0x8007, 100));    // laser on delay
+    job.push_back(rec(0x8008, 100));    // laser off delay
+    job.push_back(rec(0x800F, 100));    // polygon delay
+}
+
+// Curves and text: long runs of very short cuts, a jump every few dozen
+static Job shortVectors() {
+    Job job;
+    preamble(job);
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> step(-40, 40);
+    std::uniform_int_distribution<int> pos(8000, 57000);
+    int x = 0x8000, y = 0x8000;
+    for (int i = 0; i < 60000; i++) {
+        if (i % 40 == 0) {
+            x = pos(rng);
+            y = pos(rng);
+            jump(job, x, y);
+        }
+        x += step(rng);
+        y += step(rng);
+        cut(job, x, y);
+    }
+    job.push_back(rec(0x8002));
+    return job;
+}
+
+// Photo/raster: bidirectional scanlines split into short pixel runs
+static Job raster() {
+    Job job;
+    preamble(job);
+    std::mt19937 rng(2);
+    std::uniform_int_distribution<int> run(4, 60);
+    for (int row = 0; row < 600; row++) {
+        uint16_t y = 12000 + row * 60;
+        bool forward = (row & 1) == 0;
+        int x = forward ? 12000 : 53000;
+        int dir = forward ? 1 : -1;
+        while (forward ? x < 53000 : x > 12000) {
+            int gap = run(rng) * 20;
+            int len = run(rng) * 20;
+            x += dir * gap;
+            jump(job, x, y);
+            x += dir * len;
+            cut(job, x, y);
+        }
+    }
+    job.push_back(rec(0x8002));
+    return job;
+}
+
+// Power/speed ramps: every vector comes with its own parameter changes
+static Job paramHeavy() {
+    Job job;
+    preamble(job);
+    static const uint16_t powers[] = {1024, 2048, 3072, 4095};
+    static const uint16_t speeds[] = {254, 509, 763, 1017};
+    int x = 16000, y = 16000;
+    for (int i = 0; i < 25000; i++) {
+        job.push_back(rec(0x8012, powers[i % 4]));
+        job.push_back(rec(0x800C, speeds[(i / 4) % 4]));
+        job.push_back(rec(0x8007, 100 + (i % 3) * 10));
+        if (i % 100 == 0) {
+            x = 16000 + (i % 700) * 40;
+            y += 30;
+            jump(job, x, y);
+        }
+        x += 200;
+        cut(job, x, y);
+    }
+    job.push_back(rec(0x8002));
+    return job;
+}
+
+// Vector art as LightBurn tends to send it: the same power/speed re-sent for
+// every shape, straight edges split into collinear pieces, zero-length cuts at
+// corners, and a jump to where the head already is
+static Job redundant() {
+    Job job;
+    preamble(job);
+    std::mt19937 rng(4);
+    std::uniform_int_distribution<int> pos(12000, 50000);
+    std::uniform_int_distribution<int> size(200, 3000);
+    for (int shape = 0; shape < 3000; shape++) {
+        job.push_back(rec(0x8012, 2048));
+        job.push_back(rec(0x800C, 509));
+        int x = pos(rng), y = pos(rng), w = size(rng), h = size(rng);
+        jump(job, x, y);
+        jump(job, x, y);
+        const int corners[4][2] = {{x + w, y}, {x + w, y + h}, {x, y + h}, {x, y}};
+        int px = x, py = y;
+        for (const auto& c : corners) {
+            for (int piece = 1; piece <= 4; piece++) cut(job, px + (c[0] - px) * piece / 4, py + (c[1] - py) * piece / 4);
+            cut(job, c[0], c[1]);
+            px = c[0];
+            py = c[1];
+        }
+    }
+    job.push_back(rec(0x8002));
+    return job;
+}
+
+// Circles and spirals (every third shape, three turns in to a quarter of the
+// radius), counter-clockwise from (cx + r, cy)
+struct CurveShape {
+    float cx, cy, r;
+    bool spiral;
+};
+
+static std::vector<CurveShape> curveShapes() {
+    std::vector<CurveShape> shapes;
+    std::mt19937 rng(5);
+    std::uniform_int_distribution<int> pos(16000, 48000);
+    std::uniform_int_distribution<int> radius(300, 6000);
+    for (int shape = 0; shape < 600; shape++) {
+        float cx = pos(rng), cy = pos(rng), r = radius(rng);
+        shapes.push_back({cx, cy, r, (shape % 3) == 0});
+    }
+    return shapes;
+}
+
+// Round shapes and spirals flattened into many short cuts: every joint turns
+// by a few degrees only
+static Job curves() {
+    Job job;
+    preamble(job);
+    const float pi = 3.14159265f;
+    for (const CurveShape& s : curveShapes()) {
+        float cx = s.cx, cy = s.cy, r = s.r;
+        bool spiral = s.spiral;
+        int segments = 48 + (int)(r / 100);
+        int turns = spiral ? 3 : 1;
+        jump(job, (uint16_t)(cx + r), (uint16_t)cy);
+        for (int i = 1; i <= segments * turns; i++) {
+            float a = 2 * pi * i / segments;
+            float ri = spiral ? r * (1.0f - 0.25f * i / segments) : r;
+            cut(job, (uint16_t)(cx + ri * cosf(a)), (uint16_t)(cy + ri * sinf(a)));
+        }
+    }
+    job.push_back(rec(0x8002));
+    return job;
+}
+
+// The same shapes as curve records (CurveFlatten.h): a circle is one arc
+// back to where it started, a spiral a cubic per eighth of a turn
+static Job curveRecords() {
+    Job job;
+    preamble(job);
+    const double pi = 3.14159265358979;
+    const double k = 4.0 / 3.0 * tan(pi / 16); // control points for an eighth turn
+    uint8_t bytes[2 * CURVE_RECORD_SIZE];
+    auto add = [&](size_t len) {
+        const BalorCommand* recs = (const BalorCommand*)bytes;
+        job.insert(job.end(), recs, recs + len / sizeof(BalorCommand));
+    };
+    auto at = [](double v) { return (uint16_t)lround(v); };
+    for (const CurveShape& s : curveShapes()) {
+        jump(job, (uint16_t)(s.cx + s.r), (uint16_t)s.cy);
+        if (!s.spiral) {
+            add(curveWriteArc(bytes, (uint16_t)(s.cx + s.r), (uint16_t)s.cy, (uint16_t)s.cx, (uint16_t)s.cy, CURVE_CCW));
+            continue;
+        }
+        // rho(a) = r (1 - a / 8 pi), a = 0 .. 6 pi
+        auto point = [&](double a, double& x, double& y, double& dx, double& dy) {
+            double rho = s.r * (1.0 - a / (8 * pi)), drho = -s.r / (8 * pi);
+            x = s.cx + rho * cos(a);
+            y = s.cy + rho * sin(a);
+            dx = drho * cos(a) - rho * sin(a);
+            dy = drho * sin(a) + rho * cos(a);
+        };
+        for (int i = 0; i < 24; i++) {
+            double x0, y0, dx0, dy0, x1, y1, dx1, dy1;
+            point(i * pi / 4, x0, y0, dx0, dy0);
+            point((i + 1) * pi / 4, x1, y1, dx1, dy1);
+            add(curveWriteCubic(bytes, at(x0 + k * dx0), at(y0 + k * dy0), at(x1 - k * dx1), at(y1 - k * dy1), at(x1), at(y1)));
+        }
+    }
+    job.push_back(rec(0x8002));
+    return job;
+}
+
+// Deep engraving: a small logo, marked over and over
+static Job logo() {
+    Job job;
+    preamble(job);
+    std::mt19937 rng(6);
+    std::uniform_int_distribution<int> pos(24000, 40000);
+    std::uniform_int_distribution<int> size(200, 2000);
+    for (int shape = 0; shape < 300; shape++) {
+        int x = pos(rng), y = pos(rng), w = size(rng), h = size(rng);
+        jump(job, x, y);
+        cut(job, x + w, y);
+        cut(job, x + w, y + h);
+        cut(job, x, y + h);
+        cut(job, x, y);
+    }
+    job.push_back(rec(0x8002));
+    return job;
+}
+
+// The same list with a MARK_COUNT right after the start record
+static Job withMarkCount(Job job, uint16_t passes) {
+    job.insert(job.begin() + 1, rec(0x8023, passes));
+    return job;
+}
+
+// A list just short of what the device can record for a repeat, in logo
+// shapes, with a status poll after every 16 records if `polls`
+static Job fullRecording(uint16_t passes, bool polls) {
+    Job body = logo();
+    body.pop_back();
+    body.erase(body.begin());
+    Job list;
+    list.push_back(rec(0x8051));
+    for (size_t i = 0; list.size() < LMCV4Config::REPLAY_RECORDS - 40; i++) list.push_back(body[i % body.size()]);
+    list.push_back(rec(0x8002));
+    list = withMarkCount(list, passes);
+    if (!polls) return list;
+
+    Job job;
+    for (size_t i = 0; i < list.size(); i++) {
+        job.push_back(list[i]);
+        if (i % 16 == 15) job.push_back(rec(0x0025));
+    }
+    return job;
+}
+
+// The logo with a serial number: the last shape differs every time
+static Job serialPlate(int serial) {
+    Job job = logo();
+    job.pop_back();
+    int x = 30000 + (serial % 10) * 300;
+    jump(job, x, 42000);
+    cut(job, x + 200, 42000);
+    cut(job, x + 200, 42400);
+    job.push_back(rec(0x8002));
+    return job;
+}
+
+// A photo for raster engraving: a radial gradient with some grain, one byte
+// per pixel. 1-bit photos get it ordered dithered.
+static const int PHOTO_ROWS = 300;
+static const int PHOTO_COLS = 800;
+static const int PHOTO_PITCH = 60; // steps, ~0.1 mm
+static const int PHOTO_X = 8000;
+static const int PHOTO_Y = 12000;
+
+static std::vector<uint8_t> photo(bool eightBit) {
+    static const uint8_t bayer[4][4] = {{0, 8, 2, 10}, {12, 4, 14, 6}, {3, 11, 1, 9}, {15, 7, 13, 5}};
+    std::vector<uint8_t> pixels(PHOTO_ROWS * PHOTO_COLS);
+    std::mt19937 rng(8);
+    std::uniform_int_distribution<int> grain(-12, 12);
+    for (int r = 0; r < PHOTO_ROWS; r++) {
+        for (int c = 0; c < PHOTO_COLS; c++) {
+            float dx = (c - PHOTO_COLS / 2) / (float)PHOTO_COLS, dy = (r - PHOTO_ROWS / 2) / (float)PHOTO_COLS;
+            int v = std::min(255, std::max(0, (int)(255 * (1.0f - 2.2f * sqrtf(dx * dx + dy * dy))) + grain(rng)));
+            // 8-bit: 32 grey levels, as the host's image processing leaves them
+            pixels[r * PHOTO_COLS + c] = eightBit ? (v & 0xF8) : (v > bayer[r & 3][c & 3] * 16 + 8) ? 1 : 0;
+        }
+    }
+    return pixels;
+}
+
+// Bidirectional: odd rows scan right to left
+static uint16_t photoPixel(const std::vector<uint8_t>& pixels, int r, int i) {
+    int c = (r & 1) ? PHOTO_COLS - 1 - i : i;
+    return pixels[r * PHOTO_COLS + c];
+}
+
+// As LightBurn sends it: per run of equal lit pixels a jump to its start,
+// the power for its grey level (8-bit) and a cut to its end
+static Job photoPlain(const std::vector<uint8_t>& pixels, bool eightBit) {
+    Job job;
+    preamble(job);
+    const uint16_t power = 2048;
+    for (int r = 0; r < PHOTO_ROWS; r++) {
+        int dir = (r & 1) ? -1 : 1;
+        int start = (r & 1) ? PHOTO_X + PHOTO_COLS * PHOTO_PITCH : PHOTO_X;
+        uint16_t y = PHOTO_Y + r * PHOTO_PITCH;
+        uint16_t lastPower = power;
+        int at = -1;
+        for (int i = 0; i < PHOTO_COLS;) {
+            uint16_t v = photoPixel(pixels, r, i);
+            if (!v) {
+                i++;
+                continue;
+            }
+            int end = i;
+            while (end < PHOTO_COLS && photoPixel(pixels, r, end) == v) end++;
+            int from = start + dir * i * PHOTO_PITCH, to = start + dir * end * PHOTO_PITCH;
+            if (from != at) jump(job, from, y);
+            if (eightBit && power * v / 255 != lastPower) {
+                lastPower = power * v / 255;
+                job.push_back(rec(0x8012, lastPower));
+            }
+            cut(job, to, y);
+            at = to;
+            i = end;
+        }
+        if (lastPower != power) job.push_back(rec(0x8012, power));
+    }
+    job.push_back(rec(0x8002));
+    return job;
+}
+
+// The same photo as raster row records (RasterRows.h), 8-bit rows split in
+// records of up to 240 pixels
+static Job photoRaster(const std::vector<uint8_t>& pixels, bool eightBit) {
+    Job job;
+    preamble(job);
+    const int perRecord = eightBit ? RASTER_MAX_PAYLOAD : PHOTO_COLS;
+    std::vector<uint8_t> row(PHOTO_COLS);
+    uint8_t bytes[RASTER_RECORD_SIZE + RASTER_MAX_PAYLOAD];
+    for (int r = 0; r < PHOTO_ROWS; r++) {
+        int dir = (r & 1) ? -1 : 1;
+        int start = (r & 1) ? PHOTO_X + PHOTO_COLS * PHOTO_PITCH : PHOTO_X;
+        for (int i = 0; i < PHOTO_COLS; i++) row[i] = (uint8_t)photoPixel(pixels, r, i);
+        for (int i = 0; i < PHOTO_COLS; i += perRecord) {
+            int n = std::min(perRecord, PHOTO_COLS - i);
+            size_t len = rasterWriteRow(bytes, (uint16_t)(start + dir * i * PHOTO_PITCH), (uint16_t)(PHOTO_Y + r * PHOTO_PITCH),
+                                        (int16_t)(dir * PHOTO_PITCH), eightBit ? RASTER_8BIT : 0, row.data() + i, n);
+            const BalorCommand* recs = (const BalorCommand*)bytes;
+            job.insert(job.end(), recs, recs + len / sizeof(BalorCommand));
+        }
+    }
+    job.push_back(rec(0x8002));
+    return job;
+}
+
+// The same job with its runs of moves packed into bulk vector records, as a
+// host linking BulkVectors.h would send it. The first move stays a plain
+// record so the encoder starts from a position the driver agrees on.
+static Job packBulk(const Job& plain) {
+    Job job;
+    BulkVectorEncoder enc;
+    bool positioned = false;
+    BalorCommand last;
+    auto flush = [&]() {
+        if (enc.empty()) return;
+        if (enc.count() == 1) {
+            // A bulk record is 24 bytes at least, a lone move is cheaper plain
+            uint8_t scratch[BULK_RECORD_SIZE + BULK_MAX_PAYLOAD];
+            enc.write(scratch);
+            job.push_back(last);
+            return;
+        }
+        std::vector<uint8_t> bytes(enc.bytes());
+        enc.write(bytes.data());
+        const BalorCommand* recs = (const BalorCommand*)bytes.data();
+        job.insert(job.end(), recs, recs + bytes.size() / sizeof(BalorCommand));
+    };
+    for (const BalorCommand& c : plain) {
+        bool move = (c.opcode == 0x8001 || c.opcode == 0x8005);
+        if (!move) {
+            flush();
+            job.push_back(c);
+            continue;
+        }
+        if (!positioned) {
+            job.push_back(c);
+            enc = BulkVectorEncoder(c.params[1], c.params[0]);
+            positioned = true;
+            continue;
+        }
+        if (!enc.add(c.opcode == 0x8005, c.params[1], c.params[0])) {
+            flush();
+            enc.add(c.opcode == 0x8005, c.params[1], c.params[0]);
+        }
+        last = c;
+    }
+    flush();
+    return job;
+}
+
+// --------------------------------------------------------------------------
+// HOST MODEL + REPORT
+// --------------------------------------------------------------------------
+
+// Bounds and equivalences the driver promises. A check that does not hold is
+// printed with FAIL and makes the run exit non-zero.
+static int failures = 0;
+static bool check(bool ok, const char* what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+    return ok;
+}
+
+struct Result {
+    size_t records = 0;
+    uint64_t sim_us = 0;
+    uint64_t galvo_done_us = 0; // last time the galvo was busy
+    double cpu_s = 0;
+    uint32_t polls = 0;
+    uint32_t not_ready = 0;
+    uint64_t poll_wait_us = 0;
+    size_t peak_queued = 0; // job queue entries
+    bool timed_out = false;
+};
+
+static Result replay(BenchLaser& machine, const Job& job);
+
+// Records in the next chunk from `next`. Payload records are never split, the
+// poll after the chunk would land in the middle of their payload.
+static size_t chunkRecords(const Job& job, size_t next) {
+    size_t n = 0;
+    while (n < HOST_CHUNK_RECORDS && next + n < job.size()) {
+        const BalorCommand& c = job[next + n];
+        if (c.opcode == LMC_OPCODE_BULK_VECTORS) n += bulkRecordBytes(c.params[0]) / sizeof(BalorCommand);
+        else if (c.opcode == LMC_OPCODE_RASTER_ROW) n += rasterRecordBytes(c.params[2], c.params[4]) / sizeof(BalorCommand);
+        else if (c.opcode == LMC_OPCODE_HATCH_FILL) n += hatchRecordBytes(c.params[0], c.params[1]) / sizeof(BalorCommand);
+        else n++;
+    }
+    return n;
+}
+
+// Runs a few jobs back to back and prints one line for all of them
+static void cacheRuns(BenchLaser& machine, const char* name, Job (*make)(int)) {
+    BenchLaser::Cache::Stats before = machine.jobCacheStats();
+    BenchLaser::FirstMarkStats marks = machine.firstMarkStats();
+    double simMs = 0, cpuNs = 0;
+    size_t records = 0;
+    for (int run = 0; run < CACHE_RUNS; run++) {
+        Result r = replay(machine, make(run));
+        simMs += r.galvo_done_us / 1000.0;
+        cpuNs += r.cpu_s * 1e9;
+        records += r.records;
+    }
+    const BenchLaser::Cache::Stats& after = machine.jobCacheStats();
+    const BenchLaser::FirstMarkStats& m = machine.firstMarkStats();
+    uint32_t lists = m.lists - marks.lists;
+    printf("%-14s %10.1f %10.1f %9.1f %6u %6u %6u %6u\n", name, simMs / CACHE_RUNS, cpuNs / records,
+           lists ? (double)(m.total_us - marks.total_us) / lists : 0.0, after.hits - before.hits,
+           after.misses - before.misses, after.mismatches - before.mismatches, after.faults - before.faults);
+}
+
+static Job sameLogo(int) { return logo(); }
+
+static Result replay(BenchLaser& machine, const Job& job) {
+    Result r;
+    r.records = job.size();
+
+    simUsb.reset();
+    galvo.requestAbort();
+    galvo.resetStats();
+    uint64_t start = SimClock::us;
+
+    size_t next = 0;
+    bool awaitingReply = false;
+    uint64_t nextPoll = SimClock::us;
+    uint64_t pollSent = 0;
+
+    while (true) {
+        // Host: one status poll in flight at a time, a chunk after every READY
+        if (awaitingReply && simUsb.replyAvailable() >= REPORT_SIZE) {
+            uint8_t report[REPORT_SIZE];
+            simUsb.readReply(report, sizeof(report));
+            awaitingReply = false;
+            r.polls++;
+            r.poll_wait_us += SimClock::us - pollSent;
+            if (report[6] & LMC_STATUS_READY) {
+                if (next < job.size()) {
+                    size_t n = chunkRecords(job, next);
+                    simUsb.send(&job[next], n * sizeof(BalorCommand));
+                    next += n;
+                }
+                nextPoll = SimClock::us;
+            } else {
+                r.not_ready++;
+                nextPoll = SimClock::us + POLL_INTERVAL_US;
+            }
+        }
+        if (!awaitingReply && next < job.size() && SimClock::us >= nextPoll) {
+            BalorCommand poll = rec(0x0025);
+            simUsb.send(&poll, sizeof(poll));
+            awaitingReply = true;
+            pollSent = SimClock::us;
+        }
+
+        simUsb.step(SIM_STEP_US);
+
+        auto t0 = std::chrono::steady_clock::now();
+        machine.update();
+        machine.run();
+        r.cpu_s += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        r.peak_queued = std::max(r.peak_queued, machine.queued());
+
+        galvo.step(SIM_STEP_US);
+        SimClock::us += SIM_STEP_US;
+        if (!galvo.idle()) r.galvo_done_us = SimClock::us - start;
+
+        if (next >= job.size() && !awaitingReply && simUsb.pendingOut() == 0 && simUsb.fifoAvailable() == 0 &&
+            machine.drained() && galvo.idle()) break;
+        if (SimClock::us - start > SIM_TIME_LIMIT_US) {
+            r.timed_out = true;
+            break;
+        }
+    }
+
+    r.sim_us = SimClock::us - start;
+    return r;
+}
+
+// Sends the whole job at once without waiting for READY and runs until it is
+// done, throwing the replies to any polls in it away
+static Result sendAtOnce(BenchLaser& machine, const Job& job) {
+    Result r;
+    r.records = job.size();
+
+    simUsb.reset();
+    galvo.requestAbort();
+    galvo.resetStats();
+    uint64_t start = SimClock::us;
+    simUsb.send(job.data(), job.size() * sizeof(BalorCommand));
+
+    while (true) {
+        while (simUsb.replyAvailable() >= REPORT_SIZE) {
+            uint8_t report[REPORT_SIZE];
+            simUsb.readReply(report, sizeof(report));
+            r.polls++;
+        }
+
+        simUsb.step(SIM_STEP_US);
+        machine.update();
+        machine.run();
+        galvo.step(SIM_STEP_US);
+        SimClock::us += SIM_STEP_US;
+
+        if (simUsb.pendingOut() == 0 && simUsb.fifoAvailable() == 0 && machine.drained() && galvo.idle()) break;
+        if (SimClock::us - start > SIM_TIME_LIMIT_US) {
+            r.timed_out = true;
+            break;
+        }
+    }
+
+    r.sim_us = SimClock::us - start;
+    return r;
+}
+
+// Streams a job for a while, then hits stop: a backlog of job records more
+// than the job queue can take with a 0x0012 right behind it, like a host that
+// has already sent ahead when the user aborts.
+// Returns the simulated time from sending the abort to the laser going off.
+static uint64_t abortLatency(BenchLaser& machine, const Job& job, uint64_t runFor_us) {
+    simUsb.reset();
+    galvo.requestAbort();
+    uint64_t start = SimClock::us;
+    uint32_t abortsBefore = machine.abortStats().aborts;
+
+    size_t next = 0;
+    bool awaitingReply = false;
+    bool aborted = false;
+    uint64_t abortSent = 0;
+
+    while (SimClock::us - start < SIM_TIME_LIMIT_US) {
+        if (awaitingReply && simUsb.replyAvailable() >= REPORT_SIZE) {
+            uint8_t report[REPORT_SIZE];
+            simUsb.readReply(report, sizeof(report));
+            awaitingReply = false;
+            if ((report[6] & LMC_STATUS_READY) && next + HOST_CHUNK_RECORDS < job.size()) {
+                simUsb.send(&job[next], HOST_CHUNK_RECORDS * sizeof(BalorCommand));
+                next += HOST_CHUNK_RECORDS;
+            }
+        }
+        if (!aborted && SimClock::us - start >= runFor_us) {
+            simUsb.send(&job[next], ABORT_BACKLOG_RECORDS * sizeof(BalorCommand));
+            BalorCommand stop = rec(0x0012);
+            simUsb.send(&stop, sizeof(stop));
+            abortSent = SimClock::us;
+            aborted = true;
+        }
+        if (!aborted && !awaitingReply) {
+            BalorCommand poll = rec(0x0025);
+            simUsb.send(&poll, sizeof(poll));
+            awaitingReply = true;
+        }
+
+        simUsb.step(SIM_STEP_US);
+        machine.update();
+        machine.run();
+        galvo.step(SIM_STEP_US);
+        SimClock::us += SIM_STEP_US;
+
+        if (aborted && machine.abortStats().aborts != abortsBefore) return SimClock::us - abortSent;
+    }
+    return 0;
+}
+
+// Sustained receive: the host pushes one long stream of records that cost the
+// galvo nothing (the same power over and over, dropped by the path optimizer)
+// without waiting for READY, while core 0 only gets round to update() every
+// `passUs`. Returns the bytes moved over the link per simulated second.
+static double usbThroughput(BenchLaser& machine, uint32_t passUs) {
+    Job job;
+    job.push_back(rec(0x8051));
+    for (int i = 0; i < 20000; i++) job.push_back(rec(0x8012, 2048));
+    job.push_back(rec(0x8002));
+
+    simUsb.reset();
+    galvo.requestAbort();
+    simUsb.send(job.data(), job.size() * sizeof(BalorCommand));
+    uint64_t start = SimClock::us;
+    uint64_t nextPass = start;
+    while (SimClock::us - start < SIM_TIME_LIMIT_US) {
+        simUsb.step(SIM_STEP_US);
+        if (SimClock::us >= nextPass) {
+            machine.update();
+            nextPass = SimClock::us + passUs;
+        }
+        machine.run();
+        galvo.step(SIM_STEP_US);
+        SimClock::us += SIM_STEP_US;
+        if (simUsb.pendingOut() == 0 && simUsb.fifoAvailable() == 0 && machine.drained()) break;
+    }
+    return simUsb.stats().bytes_out / ((SimClock::us - start) / 1e6);
+}
+
+// The RX callback landing inside update(): at every LMCV4_USB_IRQ_POINT() the
+// link runs on for `busyUs` while update() holds the stream buffer's write end
+// (the callback has to leave the data in the FIFO) and for `idleUs` anywhere
+// else (the callback takes it there and then). With `stallOnce` only the first
+// busy point of an update() pass runs the link, for a whole-pass stall.
+struct IrqLink {
+    BenchLaser* machine = nullptr;
+    uint32_t busyUs = 0, idleUs = 0;
+    bool stallOnce = false;
+    uint64_t stalledPass = ~0ull; // SimClock::us of the pass that had its stall
+    uint32_t callbacks = 0;   // RX callbacks from inside update()
+    uint64_t stalledUs = 0;   // held at a busy point with the host sending and room in the stream buffer
+    uint64_t stallNakUs = 0;  // of which the host was NAKed for a full FIFO
+};
+static IrqLink irqLink;
+
+static void linkInsideUpdate() {
+    bool busy = irqLink.machine->rxBusy();
+    uint32_t us = busy ? irqLink.busyUs : irqLink.idleUs;
+    if (busy && irqLink.stallOnce) {
+        // Simulated time stands still inside update()
+        if (irqLink.stalledPass == SimClock::us) us = 0;
+        irqLink.stalledPass = SimClock::us;
+    }
+    // Nothing moves the read end meanwhile, a FIFO the stream buffer could
+    // take is only stuck for the stall
+    bool stall = busy && simUsb.pendingOut() > 0 && irqLink.machine->streamFree() >= simUsb.rx_fifo_size;
+    uint32_t callbacks = simUsb.stats().rx_callbacks;
+    uint64_t nak = simUsb.stats().nak_us;
+    for (uint32_t t = 0; t < us; t += SIM_STEP_US) simUsb.step(SIM_STEP_US);
+    irqLink.callbacks += simUsb.stats().rx_callbacks - callbacks;
+    if (stall) {
+        irqLink.stalledUs += us;
+        irqLink.stallNakUs += simUsb.stats().nak_us - nak;
+    }
+}
+
+// The job with a status poll after every 16 records, sent at once: the polls
+// land behind a full job queue and are scanned out while more is coming in
+static Job withPolls(const Job& job) {
+    Job polled;
+    for (size_t i = 0; i < job.size(); i++) {
+        polled.push_back(job[i]);
+        if (i % 16 == 15) polled.push_back(rec(0x0025));
+    }
+    return polled;
+}
+
+// Runs the job with the RX callback coming in from inside update() as set up
+// in irqLink, and checks every poll was answered and the galvo drew what the
+// same job draws with the callback only ever between passes
+static void usbInterrupts(BenchLaser& machine, const char* name, const Job& job, uint32_t busyUs, uint32_t idleUs,
+                          bool stallOnce = false) {
+    Job polled = withPolls(job);
+    uint32_t polls = (uint32_t)(polled.size() - job.size());
+    machine.setPathOptimizer(false);
+    Result ref = sendAtOnce(machine, polled);
+    XY2Galvo::Stats expect = galvo.stats();
+
+    irqLink = IrqLink();
+    irqLink.machine = &machine;
+    irqLink.busyUs = busyUs;
+    irqLink.idleUs = idleUs;
+    irqLink.stallOnce = stallOnce;
+    simUsb.irq_point = linkInsideUpdate;
+    BenchLaser::RxStats before = machine.rxStats();
+    Result r = sendAtOnce(machine, polled);
+    simUsb.irq_point = nullptr;
+    machine.setPathOptimizer(true);
+    uint32_t deferred = machine.rxStats().deferred - before.deferred;
+
+    bool same = !ref.timed_out && !r.timed_out && ref.polls == polls && r.polls == polls &&
+                galvo.stats().vectors == expect.vectors && galvo.stats().path_hash == expect.path_hash;
+    printf("%-14s %8u %8u %10u %9u %10.1f %9.2f %6s\n", name, busyUs, idleUs, irqLink.callbacks, deferred,
+           irqLink.stalledUs / 1000.0, irqLink.stallNakUs / 1000.0, same ? "yes" : "NO");
+    check(same, "usb: records lost or reordered with the RX callback inside update()");
+    check(irqLink.callbacks > 0 && deferred > 0, "usb: no RX callback landed while update() held the stream buffer");
+}
+
+// --------------------------------------------------------------------------
+// INGEST
+// --------------------------------------------------------------------------
+
+// From the RX FIFO to records in the job queue, with the stream buffer and the
+// job queue of the driver, but nothing behind them: records go into the queue
+// raw and core 1 throws them away. Each update() pass the FIFO offers up to
+// 4 KB more of the job.
+typedef RingBuffer<uint8_t, LMCV4Config::STREAM_BUFFER_SIZE> IngestStream;
+typedef RingBuffer<BalorCommand, LMCV4Config::JOB_QUEUE_SIZE> IngestQueue;
+static const size_t INGEST_PASS_BYTES = 4096;
+
+struct IngestFifo {
+    const uint8_t* data;
+    size_t len, pos = 0, offered = 0;
+    void nextPass() { offered = std::min(len, pos + INGEST_PASS_BYTES); }
+    size_t available() const { return offered - pos; }
+    size_t read(uint8_t* buf, size_t n) {
+        n = std::min(n, available());
+        memcpy(buf, data + pos, n);
+        pos += n;
+        return n;
+    }
+};
+
+// update() as it was before parsing in place: the FIFO read into a temp
+// buffer and pushed into the stream byte by byte, every record peeked at and
+// popped a byte at a time. Kept here as the reference to measure against.
+static void ingestByCopy(IngestFifo& fifo, IngestStream& stream, IngestQueue& queue, uint32_t& system) {
+    static uint8_t temp[INGEST_PASS_BYTES];
+    size_t room = stream.capacity() - stream.available();
+    uint32_t count = (uint32_t)fifo.read(temp, std::min(sizeof(temp), room));
+    for (uint32_t i = 0; i < count; i++) stream.push(temp[i]);
+
+    while (stream.available() >= CMD_SIZE) {
+        uint8_t raw[CMD_SIZE];
+        for (int i = 0; i < CMD_SIZE; i++) stream.peekAt(i, raw[i]);
+        const BalorCommand* cmd = (const BalorCommand*)raw;
+        if (cmd->opcode >= 0x8000 && queue.isFull()) return;
+        BalorCommand rec;
+        for (int i = 0; i < CMD_SIZE; i++) stream.pop(((uint8_t*)&rec)[i]);
+        if (rec.opcode < 0x8000) system++;
+        else queue.push(rec);
+    }
+}
+
+// update() as the driver does it: the FIFO read straight into the free window
+// of the stream, runs of job records moved into the queue in one copy
+static void ingestInPlace(IngestFifo& fifo, IngestStream& stream, IngestQueue& queue, uint32_t& system) {
+    for (int pass = 0; pass < 2; pass++) {
+        size_t pending = fifo.available();
+        if (pending == 0) break;
+        uint8_t* window;
+        size_t room = stream.reserve_contiguous(window);
+        if (room == 0) break;
+        size_t count = fifo.read(window, std::min(pending, room));
+        stream.commit(count);
+        if (count < room) break;
+    }
+
+    while (stream.available() >= CMD_SIZE) {
+        const uint8_t* window;
+        size_t len = stream.peek_contiguous(window);
+        if (len < CMD_SIZE) {
+            BalorCommand rec;
+            for (int i = 0; i < CMD_SIZE; i++) stream.peekAt(i, ((uint8_t*)&rec)[i]);
+            if (rec.opcode >= 0x8000 && !queue.push(rec)) return;
+            if (rec.opcode < 0x8000) system++;
+            stream.consume(CMD_SIZE);
+            continue;
+        }
+        const BalorCommand* cmds = (const BalorCommand*)window;
+        size_t records = len / CMD_SIZE, i = 0;
+        while (i < records && cmds[i].opcode >= 0x8000) i++;
+        if (i == 0) {
+            system++;
+            stream.consume(CMD_SIZE);
+            continue;
+        }
+        size_t pushed = queue.push_span(cmds, i);
+        stream.consume(pushed * CMD_SIZE);
+        if (pushed < i) return;
+    }
+}
+
+// Streams the job through one of the above pass by pass, core 1 emptying the
+// queue in between. With `out`, keeps what came out of the queue.
+static uint32_t ingestJob(void (*ingest)(IngestFifo&, IngestStream&, IngestQueue&, uint32_t&), const Job& job,
+                          Job* out) {
+    static IngestStream stream;
+    static IngestQueue queue;
+    IngestFifo fifo = {(const uint8_t*)job.data(), job.size() * sizeof(BalorCommand)};
+    uint32_t system = 0;
+    while (fifo.pos < fifo.len || stream.available() || queue.available()) {
+        fifo.nextPass();
+        ingest(fifo, stream, queue, system);
+        BalorCommand rec;
+        if (!out) queue.consume(queue.available());
+        else while (queue.pop(rec)) out->push_back(rec);
+    }
+    return system;
+}
+
+// Host CPU per record from the RX FIFO to the job queue, copy-then-parse vs.
+// in place. The two take turns and each keeps its best time. Returns the
+// speedup, 0 if they did not queue the same records.
+static double ingestCost(const char* name, const Job& job) {
+    Job byCopy, inPlace;
+    uint32_t systemByCopy = ingestJob(ingestByCopy, job, &byCopy);
+    uint32_t systemInPlace = ingestJob(ingestInPlace, job, &inPlace);
+    bool same = systemByCopy == systemInPlace && byCopy.size() == inPlace.size() &&
+                memcmp(byCopy.data(), inPlace.data(), byCopy.size() * sizeof(BalorCommand)) == 0;
+
+    const int tries = 7;
+    double bestCopy = 1e9, bestInPlace = 1e9;
+    for (int t = 0; t < tries; t++) {
+        auto t0 = std::chrono::steady_clock::now();
+        ingestJob(ingestByCopy, job, nullptr);
+        auto t1 = std::chrono::steady_clock::now();
+        ingestJob(ingestInPlace, job, nullptr);
+        auto t2 = std::chrono::steady_clock::now();
+        bestCopy = std::min(bestCopy, std::chrono::duration<double>(t1 - t0).count());
+        bestInPlace = std::min(bestInPlace, std::chrono::duration<double>(t2 - t1).count());
+    }
+
+    double n = (double)job.size();
+    printf("%-14s %8zu %10.2f %10.2f %8.1f %10.1f %6s\n", name, job.size(), bestCopy * 1e9 / n, bestInPlace * 1e9 / n,
+           n / bestCopy / 1e6, n / bestInPlace / 1e6, same ? "yes" : "NO");
+    check(same, "ingest: the two paths queued different records");
+    return same ? bestCopy / bestInPlace : 0.0;
+}
+
+// --------------------------------------------------------------------------
+// DISPATCH
+// --------------------------------------------------------------------------
+
+// decodeJobCommand() as it was before the opcode table, a switch on the
+// sparse wire opcodes. Kept here as the reference to measure against.
+static bool __attribute__((noinline)) decodeBySwitch(const BalorCommand& cmd, JobOp& op, float speedFactor) {
+    op.opcode = cmd.opcode;
+    op.flags = 0;
+
+    switch (cmd.opcode) {
+        case 0x8001:
+        case 0x8005:
+            op.kind = (cmd.opcode == 0x8001) ? OP_JUMP : OP_CUT;
+            op.move.x = cmd.params[1];
+            op.move.y = cmd.params[0];
+            op.move.tx = (float)op.move.x - 32768.0f;
+            op.move.ty = (float)op.move.y - 32768.0f;
+            return true;
+
+        case 0x8021: op.kind = OP_LASER_CTRL; break;
+        case 0x8012: op.kind = OP_POWER; break;
+        case 0x801B:
+        case 0x800A: op.kind = OP_FREQUENCY; break;
+        case 0x8004: op.kind = OP_END_DELAY; break;
+        case 0x800F: op.kind = OP_POLY_DELAY; break;
+        case 0x8007: op.kind = OP_LASER_ON_DELAY; break;
+        case 0x8008: op.kind = OP_LASER_OFF_DELAY; break;
+        case 0x800D: op.kind = OP_JUMP_DELAY; break;
+        case 0x8002: op.kind = OP_END_OF_LIST; break;
+
+        case 0x800C:
+        case 0x8006:
+            op.kind = (cmd.opcode == 0x800C) ? OP_MARK_SPEED : OP_JUMP_SPEED;
+            op.param.raw = cmd.params[0];
+            op.param.value = (float)cmd.params[0] * LMC_SPEED_UNIT * speedFactor;
+            return true;
+
+        default:
+            return false;
+    }
+
+    op.param.raw = cmd.params[0];
+    op.param.value = (float)cmd.params[0];
+    return true;
+}
+
+// Getting from a decoded op to its handler, as executeCommand() does it with a
+// switch on the op kind, and through a table of handler pointers indexed by
+// kind. The handlers only fold the op into a sum, about what an inlined hw_*
+// hook costs.
+struct HandlerSum {
+    uint32_t sum = 0;
+};
+
+template <int Kind>
+static void handleKind(HandlerSum& h, const JobOp& op) {
+    h.sum = h.sum * 31 + Kind + ((Kind == OP_JUMP || Kind == OP_CUT) ? op.move.x + op.move.y : op.param.raw);
+}
+
+static void (*const KIND_HANDLERS[OP_KIND_COUNT])(HandlerSum&, const JobOp&) = {
+    handleKind<0>,  handleKind<1>,  handleKind<2>,  handleKind<3>,  handleKind<4>,  handleKind<5>,
+    handleKind<6>,  handleKind<7>,  handleKind<8>,  handleKind<9>,  handleKind<10>, handleKind<11>,
+    handleKind<12>, handleKind<13>, handleKind<14>, handleKind<15>, handleKind<16>,
+};
+
+static void __attribute__((noinline)) executeBySwitch(HandlerSum& h, const std::vector<JobOp>& ops) {
+    for (const JobOp& op : ops) {
+        switch (op.kind) {
+#define KIND_CASE(k) case k: handleKind<k>(h, op); break;
+            KIND_CASE(0) KIND_CASE(1) KIND_CASE(2) KIND_CASE(3) KIND_CASE(4) KIND_CASE(5)
+            KIND_CASE(6) KIND_CASE(7) KIND_CASE(8) KIND_CASE(9) KIND_CASE(10) KIND_CASE(11)
+            KIND_CASE(12) KIND_CASE(13) KIND_CASE(14) KIND_CASE(15) KIND_CASE(16)
+#undef KIND_CASE
+        }
+    }
+}
+
+static void __attribute__((noinline)) executeByPointer(HandlerSum& h, const std::vector<JobOp>& ops) {
+    for (const JobOp& op : ops) KIND_HANDLERS[op.kind](h, op);
+}
+
+// Prints ns per op for both, best of interleaved tries like dispatchCost()
+static void handlerCost(BenchLaser& machine, const Job& job) {
+    static_assert(OP_KIND_COUNT == 17, "one handler per JobOpKind");
+    std::vector<JobOp> ops;
+    for (const BalorCommand& cmd : job) {
+        JobOp op;
+        if (machine.decode(cmd, op)) ops.push_back(op);
+    }
+    const int tries = 7, rounds = 10;
+    HandlerSum bySwitch, byPointer;
+    double bestSwitch = 1e9, bestPointer = 1e9;
+    for (int t = 0; t < tries; t++) {
+        auto t0 = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; r++) executeBySwitch(bySwitch, ops);
+        auto t1 = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; r++) executeByPointer(byPointer, ops);
+        auto t2 = std::chrono::steady_clock::now();
+        bestSwitch = std::min(bestSwitch, std::chrono::duration<double>(t1 - t0).count());
+        bestPointer = std::min(bestPointer, std::chrono::duration<double>(t2 - t1).count());
+    }
+    double n = (double)ops.size() * rounds;
+    printf(" %10.2f %10.2f\n", bestSwitch * 1e9 / n, bestPointer * 1e9 / n);
+    check(bySwitch.sum == byPointer.sum, "dispatch: handler pointers ran differently from the switch");
+}
+
+// Host CPU per decoded job record, switch vs. opcode table, on the scenario
+// jobs and on a uniform mix of every job opcode (worst case for prediction).
+// The two take turns and each keeps its best time, so both see the same
+// caches and the same noise from the rest of the machine.
+static void dispatchCost(BenchLaser& machine, const char* name, const Job& job) {
+    const int tries = 7, rounds = 10;
+    float factor = machine.speedFactor();
+    uint32_t checkSwitch = 0, checkTable = 0;
+    double bestSwitch = 1e9, bestTable = 1e9;
+
+    for (int t = 0; t < tries; t++) {
+        auto t0 = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; r++) {
+            for (const BalorCommand& cmd : job) {
+                JobOp op;
+                if (decodeBySwitch(cmd, op, factor)) checkSwitch += op.kind;
+            }
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; r++) {
+            for (const BalorCommand& cmd : job) {
+                JobOp op;
+                if (machine.decode(cmd, op)) checkTable += op.kind;
+            }
+        }
+        auto t2 = std::chrono::steady_clock::now();
+        bestSwitch = std::min(bestSwitch, std::chrono::duration<double>(t1 - t0).count());
+        bestTable = std::min(bestTable, std::chrono::duration<double>(t2 - t1).count());
+    }
+
+    double n = (double)job.size() * rounds;
+    printf("%-14s %8zu %10.2f %10.2f", name, job.size(), bestSwitch * 1e9 / n, bestTable * 1e9 / n);
+    handlerCost(machine, job);
+    check(checkSwitch == checkTable, "dispatch: the opcode table decodes differently from the switch");
+}
+
+static Job opcodeMix() {
+    Job job;
+    std::mt19937 rng(3);
+    std::uniform_int_distribution<size_t> pick(0, LMCV4_OPCODE_COUNT - 1);
+    while (job.size() < 100000) {
+        const OpcodeDesc& d = LMCV4_OPCODES[pick(rng)];
+        if (d.opcode >= 0x8000 && d.opcode != LMC_OPCODE_HANDLED) job.push_back(rec(d.opcode, (uint16_t)rng(), (uint16_t)rng()));
+    }
+    return job;
+}
+
+// A frame and a hatch across most of the field: long cuts, which is where
+// lens correction has to split
+static Job longLines() {
+    Job job;
+    preamble(job);
+    for (int frame = 0; frame < 3; frame++) {
+        jump(job, 4000, 4000);
+        cut(job, 61000, 4000);
+        cut(job, 61000, 61000);
+        cut(job, 4000, 61000);
+        cut(job, 4000, 4000);
+        for (int i = 0; i < 50; i++) {
+            uint16_t y = 5000 + i * 1100;
+            jump(job, (i & 1) ? 60000 : 5000, y);
+            cut(job, (i & 1) ? 5000 : 60000, y);
+        }
+    }
+    job.push_back(rec(0x8002));
+    return job;
+}
+
+// Pincushion as a 110 mm F-theta lens shows it: 0.3 mm out in the corners
+static LensGrid pincushionGrid() {
+    LensGrid grid;
+    const float stepsPerMm = GALVO_RANGE / FIELD_SIZE_MM;
+    const float corner = 2.0f * 32768.0f * 32768.0f;
+    for (int j = 0; j < LENS_GRID_SIZE; j++) {
+        for (int i = 0; i < LENS_GRID_SIZE; i++) {
+            float x = i * 4096.0f - 32768.0f, y = j * 4096.0f - 32768.0f;
+            float k = -0.3f * stepsPerMm * (x * x + y * y) / corner / sqrtf(corner);
+            grid.dx[j * LENS_GRID_SIZE + i] = (int16_t)lroundf(k * x);
+            grid.dy[j * LENS_GRID_SIZE + i] = (int16_t)lroundf(k * y);
+        }
+    }
+    return grid;
+}
+
+// Host CPU per corrected point and per cut (random cuts up to 1/4 of the
+// field), and how far the pieces of a cut stray from the corrected line,
+// sampled every 1/64 of it at the nearest whole step
+static void lensCost(const LensGrid& grid) {
+    LensCorrection lens;
+    lens.load(grid);
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<int32_t> pos(0, 0xFFFF), step(-16384, 16384);
+    std::vector<LensPoint> points(1 << 16), cuts(1 << 16);
+    for (size_t i = 0; i < points.size(); i++) {
+        points[i] = {pos(rng), pos(rng)};
+        cuts[i] = {std::min(0xFFFF, std::max(0, points[i].x + step(rng))), std::min(0xFFFF, std::max(0, points[i].y + step(rng)))};
+    }
+
+    const int rounds = 20;
+    int64_t sum = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (const LensPoint& p : points) sum += lens.apply(p.x, p.y).x;
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    size_t pieces = 0;
+    LensPoint ends[LensCorrection::MAX_PIECES];
+    for (int r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < points.size(); i++) pieces += lens.cut(points[i].x, points[i].y, cuts[i].x, cuts[i].y, ends);
+    }
+    auto t2 = std::chrono::steady_clock::now();
+
+    // Deviation: distance of each corrected sample from the nearest piece
+    double worst = 0;
+    for (size_t i = 0; i < 20000; i++) {
+        const LensPoint a = points[i], b = cuts[i];
+        int n = lens.cut(a.x, a.y, b.x, b.y, ends);
+        LensPoint from = lens.apply(a.x, a.y);
+        for (int s = 1; s < 64; s++) {
+            LensPoint c = lens.apply((int32_t)lround(a.x + (b.x - a.x) * s / 64.0), (int32_t)lround(a.y + (b.y - a.y) * s / 64.0));
+            double best = 1e9;
+            LensPoint p = from;
+            for (int k = 0; k < n; k++) {
+                double vx = ends[k].x - p.x, vy = ends[k].y - p.y, wx = c.x - p.x, wy = c.y - p.y;
+                double len2 = vx * vx + vy * vy;
+                double t = len2 > 0 ? std::min(1.0, std::max(0.0, (vx * wx + vy * wy) / len2)) : 0.0;
+                best = std::min(best, std::hypot(wx - t * vx, wy - t * vy));
+                p = ends[k];
+            }
+            worst = std::max(worst, best);
+        }
+    }
+
+    double n = (double)points.size() * rounds;
+    static volatile int64_t sink;
+    sink = sum; // keep the loop
+    (void)sink;
+    printf("lens cost: %.2f ns/point, %.2f ns/cut at %.2f pieces/cut, max %.2f steps off the corrected line\n",
+           std::chrono::duration<double>(t1 - t0).count() * 1e9 / n, std::chrono::duration<double>(t2 - t1).count() * 1e9 / n,
+           pieces / n, worst);
+    // The tolerance, and a step for rounding samples and piece ends to whole steps
+    check(worst <= lens.tolerance() + 1, "lens: pieces stray from the corrected line");
+}
+
+// Outlines for hatching, about `r` steps across around (cx, cy):
+// 0 a square (lines through its vertices at 0 and 90 degrees), 1 a star,
+// 2 a ring (a hole), 3 a random blob, 4 a block with two holes
+static const int HATCH_SHAPES = 5;
+static const char* const HATCH_SHAPE_NAMES[HATCH_SHAPES] = {"square", "star", "ring", "blob", "holes"};
+
+static HatchOutline hatchShape(int kind, int cx, int cy, int r, uint16_t angle, uint16_t spacing, uint16_t flags,
+                               std::mt19937& rng) {
+    HatchOutline o = {};
+    o.angle = angle;
+    o.spacing = spacing;
+    o.flags = flags;
+    auto add = [&](int x, int y) {
+        o.x[o.vertices] = (uint16_t)x;
+        o.y[o.vertices] = (uint16_t)y;
+        o.vertices++;
+    };
+    auto close = [&]() { o.ends[o.contours++] = o.vertices; };
+    auto circle = [&](int n, float radius, float wobble) {
+        std::uniform_real_distribution<float> w(1.0f - wobble, 1.0f);
+        for (int i = 0; i < n; i++) {
+            float a = 6.2831853f * i / n, ri = radius * w(rng);
+            add(cx + (int)lroundf(ri * cosf(a)), cy + (int)lroundf(ri * sinf(a)));
+        }
+        close();
+    };
+    auto rect = [&](int x0, int y0, int x1, int y1) {
+        add(x0, y0);
+        add(x1, y0);
+        add(x1, y1);
+        add(x0, y1);
+        close();
+    };
+    switch (kind) {
+        case 0: rect(cx - r, cy - r, cx + r, cy + r); break;
+        case 1:
+            for (int i = 0; i < 10; i++) {
+                float a = 6.2831853f * i / 10, ri = (i & 1) ? r * 0.4f : r;
+                add(cx + (int)lroundf(ri * cosf(a)), cy + (int)lroundf(ri * sinf(a)));
+            }
+            close();
+            break;
+        case 2:
+            circle(48, r, 0.0f);
+            circle(24, r * 0.5f, 0.0f);
+            break;
+        case 3: circle(40, r, 0.5f); break;
+        default:
+            rect(cx - r, cy - r, cx + r, cy + r);
+            rect(cx - r / 2, cy - r / 2, cx - r / 8, cy + r / 2);
+            rect(cx + r / 8, cy - r / 2, cx + r / 2, cy + r / 2);
+            break;
+    }
+    return o;
+}
+
+struct HatchSegment {
+    int x0, y0, x1, y1;
+};
+
+// The fill done the obvious way, in double precision: every line is cut with
+// every edge, the crossings sorted and paired
+static std::vector<HatchSegment> referenceHatch(const HatchOutline& o) {
+    std::vector<HatchSegment> out;
+    bool reverse = true;
+    for (int pass = 0; pass < ((o.flags & HATCH_CROSS) ? 2 : 1); pass++) {
+        double a = (o.angle + pass * 9000) * M_PI / 18000.0, c = cos(a), s = sin(a);
+        std::vector<double> u(o.vertices), v(o.vertices);
+        double lo = 1e9, hi = -1e9;
+        for (int i = 0; i < o.vertices; i++) {
+            double dx = o.x[i] - 32768.0, dy = o.y[i] - 32768.0;
+            u[i] = dx * c + dy * s;
+            v[i] = dy * c - dx * s;
+            lo = std::min(lo, v[i]);
+            hi = std::max(hi, v[i]);
+        }
+        for (long k = (long)ceil(lo / o.spacing - 0.5); k <= (long)floor(hi / o.spacing - 0.5); k++) {
+            double line = (k + 0.5) * o.spacing;
+            std::vector<double> hits;
+            int first = 0;
+            for (int ci = 0; ci < o.contours; ci++) {
+                int end = o.ends[ci];
+                for (int i = first; i < end; i++) {
+                    int j = (i == first) ? end - 1 : i - 1;
+                    if ((v[i] <= line) != (v[j] <= line)) hits.push_back(u[j] + (line - v[j]) * (u[i] - u[j]) / (v[i] - v[j]));
+                }
+                first = end;
+            }
+            if (hits.size() < 2) continue;
+            std::sort(hits.begin(), hits.end());
+            reverse = (o.flags & HATCH_ALTERNATE) ? !reverse : false;
+            size_t pairs = hits.size() / 2;
+            for (size_t p = 0; p < pairs; p++) {
+                size_t i = reverse ? pairs - 1 - p : p;
+                double u0 = hits[2 * i], u1 = hits[2 * i + 1];
+                if (reverse) std::swap(u0, u1);
+                auto field = [&](double uu, int& x, int& y) {
+                    x = (int)std::min(65535.0, std::max(0.0, floor(32768.0 + uu * c - line * s + 0.5)));
+                    y = (int)std::min(65535.0, std::max(0.0, floor(32768.0 + uu * s + line * c + 0.5)));
+                };
+                HatchSegment seg;
+                field(u0, seg.x0, seg.y0);
+                field(u1, seg.x1, seg.y1);
+                if (seg.x0 != seg.x1 || seg.y0 != seg.y1) out.push_back(seg);
+            }
+        }
+    }
+    return out;
+}
+
+// The cuts the executor's fill makes, starting from (x, y)
+static std::vector<HatchSegment> deviceHatch(HatchFill& fill, const HatchOutline& o, uint16_t x, uint16_t y) {
+    std::vector<HatchSegment> out;
+    HatchMove m;
+    fill.begin(o, x, y);
+    while (fill.next(m)) {
+        if (m.cut) out.push_back({x, y, m.x, m.y});
+        x = m.x;
+        y = m.y;
+    }
+    return out;
+}
+
+// Shapes across the field, hatched at 0.1 mm as a host hands them over:
+// alternating lines at 45 degrees, every third shape cross-hatched
+static std::vector<HatchOutline> hatchedShapes() {
+    std::vector<HatchOutline> shapes;
+    std::mt19937 rng(9);
+    std::uniform_int_distribution<int> pos(10000, 55000), size(1500, 6000), kind(0, HATCH_SHAPES - 1);
+    for (int i = 0; i < 120; i++) {
+        uint16_t flags = HATCH_ALTERNATE | ((i % 3 == 0) ? HATCH_CROSS : 0);
+        shapes.push_back(hatchShape(kind(rng), pos(rng), pos(rng), size(rng), 4500, 60, flags, rng));
+    }
+    return shapes;
+}
+
+// As LightBurn sends them: a jump and a cut per hatch line
+static Job hatchPlain(const std::vector<HatchOutline>& shapes) {
+    Job job;
+    preamble(job);
+    int x = -1, y = -1;
+    for (const HatchOutline& o : shapes) {
+        for (const HatchSegment& seg : referenceHatch(o)) {
+            if (seg.x0 != x || seg.y0 != y) jump(job, seg.x0, seg.y0);
+            cut(job, seg.x1, seg.y1);
+            x = seg.x1;
+            y = seg.y1;
+        }
+    }
+    job.push_back(rec(0x8002));
+    return job;
+}
+
+static Job hatchRecords(const std::vector<HatchOutline>& shapes) {
+    Job job;
+    preamble(job);
+    uint8_t bytes[HATCH_RECORD_SIZE + HATCH_MAX_PAYLOAD + HATCH_RECORD_SIZE];
+    for (const HatchOutline& o : shapes) {
+        size_t len = hatchWrite(bytes, o);
+        const BalorCommand* recs = (const BalorCommand*)bytes;
+        job.insert(job.end(), recs, recs + len / sizeof(BalorCommand));
+    }
+    job.push_back(rec(0x8002));
+    return job;
+}
+
+// Every shape at several angles, spacings and flag combinations against the
+// reference: same cuts in the same order, endpoints at most a step apart
+// (`worst` is the largest distance seen). Also times the fill on the host.
+static void hatchCheck() {
+    static const uint16_t angles[] = {0, 1500, 4500, 9000, 13750};
+    static const uint16_t spacings[] = {60, 250};
+    printf("%-14s %8s %8s %10s %8s %8s %10s\n", "hatch check", "fills", "lines", "cuts", "worst", "differ", "ns/cut");
+    static HatchFill fill;
+    for (int kind = 0; kind < HATCH_SHAPES; kind++) {
+        uint32_t fills = 0, differ = 0;
+        size_t cuts = 0;
+        int worst = 0;
+        double seconds = 0;
+        uint32_t linesBefore = fill.stats().lines;
+        std::mt19937 rng(10 + kind);
+        for (uint16_t angle : angles) {
+            for (uint16_t spacing : spacings) {
+                for (uint16_t flags = 0; flags < 4; flags++) {
+                    HatchOutline o = hatchShape(kind, 32000, 33000, 9000, angle, spacing, flags, rng);
+                    std::vector<HatchSegment> ref = referenceHatch(o);
+                    auto t0 = std::chrono::steady_clock::now();
+                    std::vector<HatchSegment> dev = deviceHatch(fill, o, 0x8000, 0x8000);
+                    seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+                    fills++;
+                    cuts += dev.size();
+                    bool same = ref.size() == dev.size();
+                    for (size_t i = 0; same && i < ref.size(); i++) {
+                        int d = std::max(std::max(abs(ref[i].x0 - dev[i].x0), abs(ref[i].y0 - dev[i].y0)),
+                                         std::max(abs(ref[i].x1 - dev[i].x1), abs(ref[i].y1 - dev[i].y1)));
+                        worst = std::max(worst, d);
+                        if (d > 1) same = false;
+                    }
+                    if (!same) differ++;
+                }
+            }
+        }
+        printf("%-14s %8u %8u %10zu %8d %8u %10.1f\n", HATCH_SHAPE_NAMES[kind], fills, fill.stats().lines - linesBefore,
+               cuts, worst, differ, cuts ? seconds * 1e9 / cuts : 0.0);
+        check(differ == 0, "hatch: fill differs from the reference");
+    }
+}
+
+// Flattens random arcs and cubics across the field and measures how far the
+// exact curve (sampled densely, in double precision) gets from the pieces.
+// "over" counts curves further off than the tolerance and a step for piece
+// ends rounded to whole steps.
+// "uniform" is the pieces a cubic would take cut evenly for the same bound.
+// Also times the flattening on the host.
+static double distanceToSegment(double px, double py, double x0, double y0, double x1, double y1) {
+    double dx = x1 - x0, dy = y1 - y0, len = dx * dx + dy * dy;
+    double t = len ? ((px - x0) * dx + (py - y0) * dy) / len : 0.0;
+    t = std::min(1.0, std::max(0.0, t));
+    return hypot(px - x0 - t * dx, py - y0 - t * dy);
+}
+
+static void flattenCheck() {
+    printf("%-14s %6s %8s %10s %10s %8s %8s %10s\n", "flatten check", "tol", "curves", "pieces", "uniform", "worst", "over",
+           "ns/piece");
+    const double pi = 3.14159265358979;
+    static CurveFlattener flat;
+    for (int cubic = 0; cubic < 2; cubic++) {
+        for (uint16_t tol : {1, 4}) {
+            flat.setTolerance(tol);
+            std::mt19937 rng(20 + cubic);
+            std::uniform_int_distribution<int> pos(4000, 61000), radius(20, 20000);
+            std::uniform_real_distribution<double> angle(0, 2 * pi);
+            uint32_t curves = 0, over = 0;
+            size_t pieces = 0;
+            double uniform = 0, worst = 0, seconds = 0;
+            for (int n = 0; n < 400; n++) {
+                double px[4], py[4];
+                double cx = 0, cy = 0, r = 0, a0 = 0, sweep = 0;
+                bool ccw = n & 1;
+                if (cubic) {
+                    for (int i = 0; i < 4; i++) {
+                        px[i] = pos(rng);
+                        py[i] = pos(rng);
+                    }
+                    // Every fourth one a cusp or loop: control points crossed over
+                    if (n % 4 == 3) std::swap(px[1], px[2]);
+                    double e0 = hypot(px[0] - 2 * px[1] + px[2], py[0] - 2 * py[1] + py[2]);
+                    double e1 = hypot(px[1] - 2 * px[2] + px[3], py[1] - 2 * py[2] + py[3]);
+                    uniform += ceil(sqrt(6 * std::max(e0, e1) / (8.0 * tol)));
+                } else {
+                    r = radius(rng);
+                    cx = std::uniform_int_distribution<int>(r, 65535 - r)(rng);
+                    cy = std::uniform_int_distribution<int>(r, 65535 - r)(rng);
+                    a0 = angle(rng);
+                    sweep = (n % 5 == 0) ? 2 * pi : angle(rng);
+                    px[0] = lround(cx + r * cos(a0));
+                    py[0] = lround(cy + r * sin(a0));
+                    double a1 = a0 + (ccw ? sweep : -sweep);
+                    px[3] = (n % 5 == 0) ? px[0] : lround(cx + r * cos(a1));
+                    py[3] = (n % 5 == 0) ? py[0] : lround(cy + r * sin(a1));
+                    r = hypot(px[0] - cx, py[0] - cy);
+                }
+
+                std::vector<double> xs = {px[0]}, ys = {py[0]};
+                auto t0 = std::chrono::steady_clock::now();
+                if (cubic) flat.beginCubic(px[0], py[0], px[1], py[1], px[2], py[2], px[3], py[3]);
+                else flat.beginArc(px[0], py[0], cx, cy, px[3], py[3], ccw);
+                CurvePiece piece;
+                while (flat.next(piece)) {
+                    xs.push_back(piece.x);
+                    ys.push_back(piece.y);
+                }
+                seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+                curves++;
+                pieces += xs.size() - 1;
+
+                // Walk the exact curve along the pieces
+                int samples = std::max(4096, 64 * (int)xs.size());
+                size_t k = 0;
+                double far = 0;
+                for (int j = 0; j <= samples; j++) {
+                    double t = (double)j / samples, x, y;
+                    if (cubic) {
+                        double u = 1 - t;
+                        x = u * u * u * px[0] + 3 * u * u * t * px[1] + 3 * u * t * t * px[2] + t * t * t * px[3];
+                        y = u * u * u * py[0] + 3 * u * u * t * py[1] + 3 * u * t * t * py[2] + t * t * t * py[3];
+                    } else {
+                        double a = a0 + (ccw ? sweep : -sweep) * t;
+                        x = cx + r * cos(a);
+                        y = cy + r * sin(a);
+                    }
+                    double best = 1e18;
+                    size_t bestK = k;
+                    for (size_t i = k; i < std::min(k + 4, xs.size() - 1); i++) {
+                        double d = distanceToSegment(x, y, xs[i], ys[i], xs[i + 1], ys[i + 1]);
+                        if (d < best) {
+                            best = d;
+                            bestK = i;
+                        }
+                    }
+                    if (xs.size() == 1) best = hypot(x - xs[0], y - ys[0]);
+                    k = bestK;
+                    far = std::max(far, best);
+                }
+                worst = std::max(worst, far);
+                if (far > tol + 1.0) over++;
+            }
+            char uni[16];
+            snprintf(uni, sizeof(uni), cubic ? "%.0f" : "-", uniform);
+            printf("%-14s %6u %8u %10zu %10s %8.2f %8u %10.1f\n", cubic ? "cubics" : "arcs", tol, curves, pieces, uni,
+                   worst, over, pieces ? seconds * 1e9 / pieces : 0.0);
+            check(over == 0, "flatten: pieces stray from the exact curve");
+        }
+    }
+}
+
+struct Scenario {
+    const char* name;
+    Job (*make)();
+};
+
+static const Scenario scenarios[] = {
+    {"short-vectors", shortVectors},
+    {"raster", raster},
+    {"param-heavy", paramHeavy},
+    {"redundant", redundant},
+    {"curves", curves},
+};
+
+static bool wanted(int argc, char** argv, const char* name) {
+    if (argc <= 1) return true;
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == name) return true;
+    }
+    return false;
+}
+
+int main(int argc, char** argv) {
+    static BenchLaser machine;
+    machine.begin(&galvo, &laser_queue);
+
+    printf("%-14s %8s %9s %8s %8s %10s %7s %9s %8s %7s %7s %9s %7s %9s\n", "scenario", "records", "sim ms", "KB/s", "kcmd/s", "cpu ns/cmd", "polls",
+           "not-ready", "nr ms", "poll us", "writes", "underruns", "reuse%", "corrupted");
+
+    for (const Scenario& s : scenarios) {
+        if (!wanted(argc, argv, s.name)) continue;
+
+        Job job = s.make();
+        uint32_t underrunsBefore = machine.runStats().underruns;
+        uint32_t notReadyBefore = machine.flowNotReadyUs();
+        Result r = replay(machine, job);
+
+        double simS = r.sim_us / 1e6;
+        printf("%-14s %8zu %9.1f %8.1f %8.2f %10.1f %7u %9u %8.1f %7.1f %7u %9u %7.1f %9u%s\n", s.name, r.records, r.sim_us / 1000.0,
+               simUsb.stats().bytes_out / 1024.0 / simS, r.records / simS / 1000.0, r.cpu_s * 1e9 / r.records, r.polls, r.not_ready,
+               (machine.flowNotReadyUs() - notReadyBefore) / 1000.0, r.polls ? (double)r.poll_wait_us / r.polls : 0.0,
+               simUsb.stats().in_writes,
+               machine.runStats().underruns - underrunsBefore, machine.settingsPoolReuseRate() * 100.0f,
+               galvo.stats().set_corrupted, r.timed_out ? "  TIMEOUT" : "");
+    }
+
+    if (wanted(argc, argv, "optimizer")) {
+        printf("\n%-14s %10s %10s %10s %10s %8s %8s %8s %10s\n", "optimizer", "off ms", "on ms", "off segs", "on segs",
+               "dropped", "merged", "params", "est. ms");
+        for (const Scenario& s : scenarios) {
+            Job job = s.make();
+            machine.setPathOptimizer(false);
+            Result off = replay(machine, job);
+            uint32_t offSegs = galvo.stats().vectors;
+            machine.setPathOptimizer(true);
+            PathOptimizer::Stats before = machine.pathOptimizerStats();
+            Result on = replay(machine, job);
+            const PathOptimizer::Stats& after = machine.pathOptimizerStats();
+            printf("%-14s %10.1f %10.1f %10u %10u %8u %8u %8u %10.1f\n", s.name, off.sim_us / 1000.0, on.sim_us / 1000.0,
+                   offSegs, galvo.stats().vectors, after.dropped_moves - before.dropped_moves,
+                   after.merged_moves - before.merged_moves, after.dropped_params - before.dropped_params,
+                   (after.saved_mark_us - before.saved_mark_us) / 1000.0);
+        }
+    }
+
+    if (wanted(argc, argv, "corners")) {
+        printf("\n%-14s %10s %10s %7s %7s %7s %7s %7s %7s %7s\n", "corners", "off ms", "on ms", "saved%", "q0", "q1", "q2",
+               "q3", "q4", "unseen");
+        for (const Scenario& s : scenarios) {
+            Job job = s.make();
+            machine.setCornerPlanner(false);
+            Result off = replay(machine, job);
+            machine.setCornerPlanner(true);
+            BenchLaser::CornerStats before = machine.cornerStats();
+            Result on = replay(machine, job);
+            const BenchLaser::CornerStats& after = machine.cornerStats();
+            printf("%-14s %10.1f %10.1f %7.1f", s.name, off.sim_us / 1000.0, on.sim_us / 1000.0,
+                   100.0 * ((double)off.sim_us - (double)on.sim_us) / off.sim_us);
+            for (int q = 0; q <= JOB_CORNER_FULL; q++) printf(" %7u", after.cuts[q] - before.cuts[q]);
+            printf(" %7u\n", after.unseen - before.unseen);
+        }
+    }
+
+    if (wanted(argc, argv, "jumps")) {
+        printf("\n%-14s %10s %10s %7s %8s\n", "jumps", "flat ms", "table ms", "saved%", "reuse%");
+        // Flat: every jump waits the whole jump delay, with the default 100 us
+        // the fixed laser_set[0].delay_m jumps got before the table. No jump
+        // may wait longer with the table.
+        static const JumpSettlePoint flat[] = {{0, 1000}};
+        JumpSettleTable fixed, table;
+        fixed.setPoints(flat, 1);
+        bool longer = false;
+        for (int32_t dx = 0; dx <= 0xFFFF; dx += 97) {
+            for (int32_t dy = 0; dy <= 0xFFFF; dy += 4099)
+                longer |= fixed.ticks(dx, dy) != laser_set[0].delay_m || table.ticks(dx, dy) > laser_set[0].delay_m;
+        }
+        check(!longer, "jumps: the settle table waits longer than the fixed jump settle");
+        for (const Scenario& s : scenarios) {
+            Job job = s.make();
+            machine.setJumpSettle(flat, 1);
+            Result off = replay(machine, job);
+            machine.setJumpSettle(JUMP_SETTLE_DEFAULTS, sizeof(JUMP_SETTLE_DEFAULTS) / sizeof(JUMP_SETTLE_DEFAULTS[0]));
+            Result on = replay(machine, job);
+            double saved = 100.0 * ((double)off.sim_us - (double)on.sim_us) / off.sim_us;
+            printf("%-14s %10.1f %10.1f %7.1f %8.1f\n", s.name, off.sim_us / 1000.0, on.sim_us / 1000.0, saved,
+                   machine.settingsPoolReuseRate() * 100.0f);
+            check(!off.timed_out && !on.timed_out && on.sim_us <= off.sim_us, "jumps: the settle table made a job slower");
+            // Raster is all jumps across the gaps in a row, 34.5 s -> 32.9 s
+            if (std::string(s.name) == "raster") check(saved >= 4.6, "jumps: raster gains less than 4.6% from the settle table");
+        }
+    }
+
+    if (wanted(argc, argv, "replay")) {
+        printf("\n%-14s %8s %10s %10s %10s %8s %9s\n", "replay", "passes", "sim ms", "host KB", "segments", "on dev", "overflows");
+        Job once = logo();
+        Job everyPass;
+        for (int p = 0; p < REPLAY_PASSES; p++) everyPass.insert(everyPass.end(), once.begin(), once.end());
+
+        machine.setJobReplay(false);
+        Result r = replay(machine, everyPass);
+        printf("%-14s %8u %10.1f %10.1f %10u %8u %9u\n", "host-resend", REPLAY_PASSES, r.sim_us / 1000.0,
+               simUsb.stats().bytes_out / 1024.0, galvo.stats().vectors, 0u, 0u);
+
+        machine.setJobReplay(true);
+        BenchLaser::Replay::Stats before = machine.replayStats();
+        r = replay(machine, withMarkCount(once, REPLAY_PASSES));
+        printf("%-14s %8u %10.1f %10.1f %10u %8u %9u\n", "mark-count", REPLAY_PASSES, r.sim_us / 1000.0,
+               simUsb.stats().bytes_out / 1024.0, galvo.stats().vectors, machine.replayStats().passes - before.passes,
+               machine.replayStats().overflows - before.overflows);
+
+        // Too long to record: runs once, the host has to send the other passes
+        before = machine.replayStats();
+        r = replay(machine, withMarkCount(shortVectors(), REPLAY_PASSES));
+        printf("%-14s %8u %10.1f %10.1f %10u %8u %9u\n", "too-long", REPLAY_PASSES, r.sim_us / 1000.0,
+               simUsb.stats().bytes_out / 1024.0, galvo.stats().vectors, machine.replayStats().passes - before.passes,
+               machine.replayStats().overflows - before.overflows);
+
+        // Polls handled out of band inside the list take no room in the recording
+        uint32_t segments[2];
+        for (int polls = 0; polls < 2; polls++) {
+            before = machine.replayStats();
+            r = sendAtOnce(machine, fullRecording(2, polls));
+            segments[polls] = galvo.stats().vectors;
+            uint32_t passes = machine.replayStats().passes - before.passes;
+            uint32_t overflows = machine.replayStats().overflows - before.overflows;
+            printf("%-14s %8u %10.1f %10.1f %10u %8u %9u\n", polls ? "full+polls" : "full list", 2, r.sim_us / 1000.0,
+                   simUsb.stats().bytes_out / 1024.0, segments[polls], passes, overflows);
+            check(!r.timed_out && passes == 1 && overflows == 0, "replay: a full list was not repeated on the device");
+        }
+        check(segments[0] == segments[1], "replay: polls in the list changed what was marked");
+    }
+
+    if (wanted(argc, argv, "cache")) {
+        printf("\n%-14s %10s %10s %9s %6s %6s %6s %6s\n", "cache", "marked ms", "cpu ns/cmd", "ttfm us", "hits", "misses",
+               "diff", "faults");
+        machine.setJobCache(false);
+        cacheRuns(machine, "off", sameLogo);
+        machine.setJobCache(true);
+        cacheRuns(machine, "verified", sameLogo);
+        machine.setJobCache(true, CACHE_RUN_AHEAD);
+        cacheRuns(machine, "run-ahead", sameLogo);
+        machine.setJobCache(true);
+        cacheRuns(machine, "serial", serialPlate);
+        machine.setJobCache(true, CACHE_RUN_AHEAD);
+        cacheRuns(machine, "serial ahead", serialPlate);
+        machine.clearFault();
+
+        // Where running ahead pays: a link slower than the galvo
+        double linkRate = simUsb.bytes_per_us;
+        simUsb.bytes_per_us = SLOW_LINK_BYTES_PER_US;
+        machine.setJobCache(true);
+        cacheRuns(machine, "slow verified", sameLogo);
+        machine.setJobCache(true, CACHE_RUN_AHEAD);
+        cacheRuns(machine, "slow ahead", sameLogo);
+        simUsb.bytes_per_us = linkRate;
+        machine.setJobCache(true);
+    }
+
+    if (wanted(argc, argv, "photo")) {
+        printf("\n%-14s %9s %9s %10s %10s %10s %10s %8s %8s\n", "photo", "plain KB", "rows KB", "plain ms", "rows ms",
+               "slow plain", "slow rows", "+segs", "bad");
+        double linkRate = simUsb.bytes_per_us;
+        for (int eightBit = 0; eightBit < 2; eightBit++) {
+            std::vector<uint8_t> pixels = photo(eightBit);
+            Job plain = photoPlain(pixels, eightBit);
+            Job rows = photoRaster(pixels, eightBit);
+            double ms[2][2];
+            for (int slow = 0; slow < 2; slow++) {
+                simUsb.bytes_per_us = slow ? BULK_SLOW_LINK_BYTES_PER_US : linkRate;
+                machine.enableExtensions(0);
+                ms[slow][0] = replay(machine, plain).sim_us / 1000.0;
+                machine.enableExtensions(LMC_EXT_RASTER);
+                ms[slow][1] = replay(machine, rows).sim_us / 1000.0;
+            }
+            simUsb.bytes_per_us = linkRate;
+
+            uint32_t segs[2];
+            machine.setPathOptimizer(false);
+            machine.enableExtensions(0);
+            replay(machine, plain);
+            segs[0] = galvo.stats().vectors;
+            machine.enableExtensions(LMC_EXT_RASTER);
+            replay(machine, rows);
+            segs[1] = galvo.stats().vectors;
+            machine.setPathOptimizer(true);
+            printf("%-14s %9.1f %9.1f %10.1f %10.1f %10.1f %10.1f %8d %8u\n", eightBit ? "8-bit" : "1-bit",
+                   plain.size() * 12 / 1024.0, rows.size() * 12 / 1024.0, ms[0][0], ms[0][1], ms[1][0], ms[1][1],
+                   (int)(segs[1] - segs[0]), machine.rasterStats().malformed);
+        }
+        machine.enableExtensions(0);
+    }
+
+    if (wanted(argc, argv, "bulk")) {
+        printf("\n%-14s %9s %9s %10s %10s %10s %10s %8s %8s\n", "bulk", "plain KB", "bulk KB", "plain ms", "bulk ms",
+               "slow plain", "slow bulk", "segs ok", "bad");
+        double linkRate = simUsb.bytes_per_us;
+        for (const Scenario& s : scenarios) {
+            Job plain = s.make();
+            Job bulk = packBulk(plain);
+            double ms[2][2];
+            for (int slow = 0; slow < 2; slow++) {
+                simUsb.bytes_per_us = slow ? BULK_SLOW_LINK_BYTES_PER_US : linkRate;
+                machine.enableExtensions(0);
+                ms[slow][0] = replay(machine, plain).sim_us / 1000.0;
+                machine.enableExtensions(LMC_EXT_BULK_VECTORS);
+                ms[slow][1] = replay(machine, bulk).sim_us / 1000.0;
+            }
+            simUsb.bytes_per_us = linkRate;
+
+            uint32_t segs[2];
+            machine.setPathOptimizer(false);
+            machine.enableExtensions(0);
+            replay(machine, plain);
+            segs[0] = galvo.stats().vectors;
+            machine.enableExtensions(LMC_EXT_BULK_VECTORS);
+            replay(machine, bulk);
+            segs[1] = galvo.stats().vectors;
+            machine.setPathOptimizer(true);
+            printf("%-14s %9.1f %9.1f %10.1f %10.1f %10.1f %10.1f %8s %8u\n", s.name, plain.size() * 12 / 1024.0,
+                   bulk.size() * 12 / 1024.0, ms[0][0], ms[0][1], ms[1][0], ms[1][1], segs[0] == segs[1] ? "yes" : "NO",
+                   machine.bulkStats().malformed);
+        }
+        machine.enableExtensions(0);
+    }
+
+    if (wanted(argc, argv, "lens")) {
+        printf("\n%-14s %10s %10s %10s %10s %8s %8s\n", "lens", "off ms", "on ms", "off segs", "on segs", "split%", "bad");
+        LensGrid grid = pincushionGrid();
+        std::vector<Scenario> lensScenarios(std::begin(scenarios), std::end(scenarios));
+        lensScenarios.push_back({"long-lines", longLines});
+        for (const Scenario& s : lensScenarios) {
+            Job job = s.make();
+            machine.setLensCorrection(nullptr);
+            double off = replay(machine, job).sim_us / 1000.0;
+            uint32_t offSegs = galvo.stats().vectors;
+
+            uint8_t flags = machine.loadLens(grid);
+            LensCorrection::Stats before = machine.lensStats();
+            double on = replay(machine, job).sim_us / 1000.0;
+            uint32_t cuts = machine.lensStats().cuts - before.cuts;
+            uint32_t split = machine.lensStats().split - before.split;
+            printf("%-14s %10.1f %10.1f %10u %10u %8.1f %8s\n", s.name, off, on, offSegs, galvo.stats().vectors,
+                   cuts ? 100.0 * split / cuts : 0.0, flags ? "yes" : "no");
+        }
+        machine.setLensCorrection(nullptr);
+        lensCost(grid);
+    }
+
+    if (wanted(argc, argv, "hatch")) {
+        printf("\n");
+        hatchCheck();
+
+        printf("\n%-14s %9s %9s %10s %10s %10s %10s %8s %8s %8s %8s\n", "hatch", "plain KB", "fill KB", "plain ms",
+               "fill ms", "slow plain", "slow fill", "plain q", "fill q", "+segs", "bad");
+        std::vector<HatchOutline> shapes = hatchedShapes();
+        Job plain = hatchPlain(shapes);
+        Job fills = hatchRecords(shapes);
+        double linkRate = simUsb.bytes_per_us;
+        double ms[2][2];
+        size_t peak[2] = {};
+        for (int slow = 0; slow < 2; slow++) {
+            simUsb.bytes_per_us = slow ? BULK_SLOW_LINK_BYTES_PER_US : linkRate;
+            machine.enableExtensions(0);
+            Result r = replay(machine, plain);
+            ms[slow][0] = r.sim_us / 1000.0;
+            peak[0] = std::max(peak[0], r.peak_queued);
+            machine.enableExtensions(LMC_EXT_HATCH);
+            r = replay(machine, fills);
+            ms[slow][1] = r.sim_us / 1000.0;
+            peak[1] = std::max(peak[1], r.peak_queued);
+        }
+        simUsb.bytes_per_us = linkRate;
+
+        uint32_t segs[2];
+        machine.setPathOptimizer(false);
+        machine.enableExtensions(0);
+        replay(machine, plain);
+        segs[0] = galvo.stats().vectors;
+        machine.enableExtensions(LMC_EXT_HATCH);
+        replay(machine, fills);
+        segs[1] = galvo.stats().vectors;
+        machine.setPathOptimizer(true);
+        printf("%-14s %9.1f %9.1f %10.1f %10.1f %10.1f %10.1f %8zu %8zu %8d %8u\n", "shapes", plain.size() * 12 / 1024.0,
+               fills.size() * 12 / 1024.0, ms[0][0], ms[0][1], ms[1][0], ms[1][1], peak[0], peak[1],
+               (int)(segs[1] - segs[0]), machine.hatchStats().malformed);
+        check(segs[1] - segs[0] == shapes.size() && machine.hatchStats().malformed == 0,
+              "hatch: outlines did not mark what the plain records did");
+        machine.enableExtensions(0);
+    }
+
+    if (wanted(argc, argv, "flatten")) {
+        printf("\n");
+        flattenCheck();
+
+        // The curves scenario as plain cuts, with curves switched on but not
+        // used, and as curve records
+        printf("\n%-14s %9s %10s %10s %8s %10s %8s\n", "flatten", "KB", "sim ms", "slow ms", "job ops", "segs", "dropped");
+        Job plain = curves();
+        Job records = curveRecords();
+        double linkRate = simUsb.bytes_per_us;
+        const struct {
+            const char* name;
+            const Job& job;
+            uint16_t extensions;
+        } runs[] = {{"lines", plain, 0}, {"lines+ext", plain, LMC_EXT_CURVES}, {"curves", records, LMC_EXT_CURVES}};
+        for (const auto& run : runs) {
+            machine.enableExtensions(run.extensions);
+            simUsb.bytes_per_us = BULK_SLOW_LINK_BYTES_PER_US;
+            double slow = replay(machine, run.job).sim_us / 1000.0;
+            simUsb.bytes_per_us = linkRate;
+            uint32_t executed = machine.runStats().executed;
+            Result r = replay(machine, run.job);
+            printf("%-14s %9.1f %10.1f %10.1f %8u %10u %8u\n", run.name, run.job.size() * 12 / 1024.0, r.sim_us / 1000.0,
+                   slow, machine.runStats().executed - executed, galvo.stats().vectors, machine.curveStats().dropped);
+        }
+        machine.enableExtensions(0);
+    }
+
+    if (wanted(argc, argv, "usb")) {
+        printf("\n%-14s %12s %12s %12s %10s %9s\n", "usb pass us", "poll 8K KB/s", "poll KB/s", "rx cb KB/s",
+               "callbacks", "full");
+        static const uint32_t passes[] = {5, 100, 250, 500, 1000, 4000, 8000};
+        size_t fifo = simUsb.rx_fifo_size;
+        for (uint32_t passUs : passes) {
+            machine.setRxCallback(false);
+            simUsb.rx_fifo_size = 8184;
+            double bigFifo = usbThroughput(machine, passUs) / 1024.0;
+            simUsb.rx_fifo_size = fifo;
+            double polled = usbThroughput(machine, passUs) / 1024.0;
+            machine.setRxCallback(true);
+            BenchLaser::RxStats before = machine.rxStats();
+            double callback = usbThroughput(machine, passUs) / 1024.0;
+            const BenchLaser::RxStats& after = machine.rxStats();
+            printf("%-14u %12.1f %12.1f %12.1f %10u %9u\n", passUs, bigFifo, polled, callback,
+                   after.callbacks - before.callbacks, after.full - before.full);
+        }
+
+        printf("\n%-14s %8s %8s %10s %9s %10s %9s %6s\n", "usb irq", "busy us", "idle us", "callbacks", "deferred",
+               "stalled ms", "nak ms", "same");
+        usbInterrupts(machine, "callback", shortVectors(), 64, 64);
+        // The longest the callback has to leave the FIFO alone: an update()
+        // pass, 1 ms at most, at 19 packets per 1 ms frame
+        double rate = simUsb.bytes_per_us;
+        simUsb.bytes_per_us = 19 * SimUsbHost::PACKET_SIZE / 1000.0;
+        usbInterrupts(machine, "stall 1 ms", shortVectors(), 1000, 0, true);
+        simUsb.bytes_per_us = rate;
+        check(irqLink.stalledUs > 0 && irqLink.stallNakUs == 0, "usb: the RX FIFO does not ride out a 1 ms stall");
+    }
+
+    if (wanted(argc, argv, "ingest")) {
+        printf("\n%-14s %8s %10s %10s %8s %10s %6s\n", "ingest", "records", "copy ns", "inplace ns", "copy M/s",
+               "inplace M/s", "same");
+        double worst = 1e9;
+        for (const Scenario& s : scenarios) worst = std::min(worst, ingestCost(s.name, s.make()));
+        worst = std::min(worst, ingestCost("with polls", withPolls(shortVectors())));
+        printf("speedup at least %.1fx\n", worst);
+        check(worst >= 5.0, "ingest: parsing in place is not 5x the copy-then-parse path");
+    }
+
+    if (wanted(argc, argv, "dispatch")) {
+        printf("\n%-14s %8s %10s %10s %10s %10s\n", "dispatch", "records", "switch ns", "table ns", "exec sw ns",
+               "exec ptr ns");
+        for (const Scenario& s : scenarios) dispatchCost(machine, s.name, s.make());
+        dispatchCost(machine, "opcode-mix", opcodeMix());
+    }
+
+    if (wanted(argc, argv, "abort")) {
+        // The backlog and the 0x0012 have to get over the link, after that
+        // the laser has to be off within a millisecond
+        uint64_t limitUs = (uint64_t)((ABORT_BACKLOG_RECORDS + 1) * sizeof(BalorCommand) / simUsb.bytes_per_us) + 1000;
+        printf("\n%-14s %10s %10s %10s %10s %10s\n", "abort", "at 1.0 s", "at 1.5 s", "at 2.0 s", "at 2.5 s", "limit us");
+        Job job = shortVectors();
+        for (int planner = 0; planner < 2; planner++) {
+            machine.setCornerPlanner(planner);
+            uint64_t worstUs = 0;
+            bool lost = false;
+            printf("%-14s", planner ? "corners on" : "corners off");
+            for (uint64_t at = 1000000; at <= 2500000; at += 500000) {
+                uint64_t hostUs = abortLatency(machine, job, at);
+                printf(" %10llu", (unsigned long long)hostUs);
+                worstUs = std::max(worstUs, hostUs);
+                lost |= (hostUs == 0);
+            }
+            printf(" %10llu\n", (unsigned long long)limitUs);
+            check(!lost && worstUs <= limitUs, "abort: host->laser off over the limit");
+        }
+    }
+    return failures ? 1 : 0;
+}
@@ -121,8 +121,13 @@ extern "C" {
 #define CFG_TUD_MIDI_RX_BUFSIZE 0
 #define CFG_TUD_MIDI_TX_BUFSIZE 0
 
-// Vendor FIFO size of TX and RX
-#define CFG_TUD_VENDOR_RX_BUFSIZE 8184
+// Vendor FIFO size of TX and RX. The driver's RX callback moves RX packets
+// into its stream buffer as they arrive, except while update() holds the
+// buffer's write end; then the FIFO has to take what comes until the end of
+// that pass or the host is NAKed. A pass stays under 1 ms and full speed bulk
+// moves at most 19 packets of 64 bytes per 1 ms frame, 1216 bytes: 20 packets
+// (bench "usb", row "stall 1 ms" checks it).
+#define CFG_TUD_VENDOR_RX_BUFSIZE 1280
 #define CFG_TUD_VENDOR_TX_BUFSIZE 256
 
 //--------------------------------------------------------------------
@@ -0,0 +1,64 @@
+#ifndef SIM_ADAFRUIT_TINYUSB_H
+#define SIM_ADAFRUIT_TINYUSB_H
+
+// Native stand-in for Adafruit_TinyUSB: enough of the device/interface classes
+// for LMCV4Driver to register itself, and a vendor class whose endpoints are
+// wired to SimUsbHost (see SimUsb.h), RX callback included.
+
+#include <Arduino.h>
+
+#define TUSB_DIR_OUT 0x00
+#define TUSB_DIR_IN  0x80
+
+// Interface + bulk OUT + bulk IN, same layout as TinyUSB's macro
+#define TUD_VENDOR_DESCRIPTOR(_itfnum, _stridx, _epout, _epin, _epsize) \
+    9, 4, _itfnum, 0, 2, 0xFF, 0x00, 0x00, _stridx, \
+    7, 5, _epout, 2, (uint8_t)((_epsize) & 0xFF), (uint8_t)((_epsize) >> 8), 0, \
+    7, 5, _epin, 2, (uint8_t)((_epsize) & 0xFF), (uint8_t)((_epsize) >> 8), 0
+
+class Adafruit_USBD_Interface {
+public:
+    virtual ~Adafruit_USBD_Interface() {}
+    virtual uint16_t getInterfaceDescriptor(uint8_t itfnum, uint8_t* buf, uint16_t bufsize) = 0;
+    void setStringDescriptor(const char*) { _strid = 4; }
+
+protected:
+    uint8_t _strid = 0;
+};
+
+class Adafruit_USBD_Device {
+public:
+    void clearConfiguration() {}
+    void setID(uint16_t, uint16_t) {}
+    void setProductDescriptor(const char*) {}
+    uint8_t allocInterface(uint8_t count = 1) { uint8_t n = _itf; _itf += count; return n; }
+    bool addInterface(Adafruit_USBD_Interface& itf) {
+        uint8_t buf[64];
+        itf.getInterfaceDescriptor(0, buf, sizeof(buf));
+        return true;
+    }
+    uint8_t allocEndpoint(uint8_t dir) { return (dir == TUSB_DIR_IN) ? 0x88 : 0x02; }
+    bool mounted() { return true; }
+    void detach() {}
+    void attach() {}
+
+private:
+    uint8_t _itf = 0;
+};
+
+extern Adafruit_USBD_Device TinyUSBDevice;
+
+uint32_t tud_vendor_n_available(uint8_t itf);
+uint32_t tud_vendor_n_read(uint8_t itf, void* buffer, uint32_t bufsize);
+uint32_t tud_vendor_n_write(uint8_t itf, const void* buffer, uint32_t bufsize);
+uint32_t tud_vendor_n_flush(uint8_t itf);
+
+// Called once a packet is in the RX FIFO (weak, the driver defines it)
+void tud_vendor_rx_cb(uint8_t itf, uint8_t const* buffer, uint16_t bufsize);
+
+// Points inside update() where the USB interrupt may come in, see
+// SimUsbHost::irq_point
+void simUsbIrqPoint();
+#define LMCV4_USB_IRQ_POINT() simUsbIrqPoint()
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef SIM_ARDUINO_H
+#define SIM_ARDUINO_H
+
+// Native stand-in for the parts of the Arduino/earlephilhower core the driver
+// uses. Time is simulated: micros() returns SimClock, which the benchmark
+// advances explicitly.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+typedef unsigned int uint;
+
+#define HIGH 1
+#define LOW 0
+#define OUTPUT 1
+#define LED_BUILTIN 25
+
+struct SimClock {
+    static uint64_t us;
+};
+
+inline unsigned long micros() { return (unsigned long)SimClock::us; }
+inline unsigned long millis() { return (unsigned long)(SimClock::us / 1000); }
+inline void delay(unsigned long ms) { SimClock::us += ms * 1000; }
+inline void delayMicroseconds(unsigned int us) { SimClock::us += us; }
+
+inline void pinMode(int, int) {}
+inline void digitalWrite(int, int) {}
+
+inline long map(long x, long in_min, long in_max, long out_min, long out_max) {
+    return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+// Output goes to a FILE (stdout by default), or nowhere when file is null
+class Stream {
+public:
+    FILE* file = nullptr;
+
+    void begin(unsigned long) {}
+    void flush() { if (file) fflush(file); }
+    size_t write(uint8_t c) { return write(&c, 1); }
+    size_t write(const uint8_t* buf, size_t len) { return file ? fwrite(buf, 1, len, file) : len; }
+    size_t print(const char* s) { return file ? (size_t)fputs(s, file) : strlen(s); }
+    size_t println(const char* s) { size_t n = print(s); return n + print("\r\n"); }
+    int printf(const char* fmt, ...) {
+        if (!file) return 0;
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vfprintf(file, fmt, ap);
+        va_end(ap);
+        return n;
+    }
+};
+
+extern Stream Serial;
+extern Stream Serial1;
+
+// rp2040 helper object: inter-core FIFO and cycle counter
+class RP2040Fifo {
+public:
+    void push(uint32_t) {}
+    uint32_t pop() { return 0; }
+};
+
+class RP2040 {
+public:
+    RP2040Fifo fifo;
+    // 150 MHz worth of cycles per simulated microsecond
+    uint32_t getCycleCount() { return (uint32_t)(SimClock::us * 150); }
+};
+
+extern RP2040 rp2040;
+
+#endif
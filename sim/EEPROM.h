@@ -0,0 +1,43 @@
+#ifndef SIM_EEPROM_H
+#define SIM_EEPROM_H
+
+// Native stand-in for the core's EEPROM library (a flash sector emulating
+// EEPROM): the bytes live in RAM, start out erased (0xFF) and commit() always
+// succeeds. Counts commits so the benchmark can tell flash was written.
+
+#include <Arduino.h>
+
+class EEPROMClass {
+public:
+    uint32_t commits = 0;
+
+    void begin(size_t size) {
+        if (size > sizeof(_data)) size = sizeof(_data);
+        if (!_begun) memset(_data, 0xFF, sizeof(_data));
+        _size = size;
+        _begun = true;
+    }
+    template <typename T>
+    T& get(int address, T& t) {
+        if (address + sizeof(T) <= _size) memcpy(&t, _data + address, sizeof(T));
+        return t;
+    }
+    template <typename T>
+    const T& put(int address, const T& t) {
+        if (address + sizeof(T) <= _size) memcpy(_data + address, &t, sizeof(T));
+        return t;
+    }
+    bool commit() {
+        commits++;
+        return true;
+    }
+
+private:
+    uint8_t _data[4096];
+    size_t _size = 0;
+    bool _begun = false;
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
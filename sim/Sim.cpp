@@ -0,0 +1,163 @@
+// Globals and behaviour behind the native stand-ins in this directory.
+
+#include <Arduino.h>
+#include <Adafruit_TinyUSB.h>
+#include "XY2Galvo.h"
+#include "SimUsb.h"
+#include <EEPROM.h>
+#include <math.h>
+
+uint64_t SimClock::us = 0;
+
+Stream Serial;
+Stream Serial1;
+RP2040 rp2040;
+Adafruit_USBD_Device TinyUSBDevice;
+SimUsbHost simUsb;
+EEPROMClass EEPROM;
+
+// Same roles as the XY2Galvo library defaults: 0 = jump, 1 = dot, 2 = mark
+LaserSet laser_set[] = {
+    {600.0f, 0x000, 0, 10, 0},
+    {60.0f,  0x3ff, 0, 0,  0},
+    {60.0f,  0x3ff, 10, 5, 10},
+};
+LaserQueue laser_queue;
+
+// --------------------------------------------------------------------------
+// GALVO
+// --------------------------------------------------------------------------
+
+uint64_t XY2Galvo::startEntry(const LaserQueue::Entry& e) {
+    const LaserSet& set = e.set ? *e.set : e.copy;
+    if (e.set && memcmp(e.set, &e.copy, sizeof(LaserSet)) != 0) _stats.set_corrupted++;
+
+    float dx = e.target.x - _pos.x;
+    float dy = e.target.y - _pos.y;
+    float dist = sqrtf(dx * dx + dy * dy);
+    float speed = (set.speed > 0.0f) ? set.speed : 1.0f;
+    uint64_t move = (uint64_t)ceilf(dist / speed);
+
+    bool on = e.set && set.pattern != 0;
+    uint64_t ticks = move + set.delay_m;
+    if (on && !_laserOn) ticks += set.delay_a;
+    if (!on && _laserOn) ticks += _currentCopy.delay_e;
+
+    _stats.vectors++;
+    const uint32_t words[3] = {(uint32_t)lroundf(e.target.x), (uint32_t)lroundf(e.target.y), on};
+    for (uint32_t w : words) _stats.path_hash = (_stats.path_hash ^ w) * 1099511628211ull;
+    if (on) {
+        _stats.marks++;
+        _stats.mark_ticks += move;
+    }
+
+    _pos = e.target;
+    _laserOn = on;
+    _current = e.set;
+    _currentCopy = e.copy;
+    return ticks ? ticks : 1;
+}
+
+void XY2Galvo::step(uint32_t us) {
+    _usCarry += us;
+    while (_usCarry >= TICK_US) {
+        _usCarry -= TICK_US;
+
+        if (_remaining == 0) {
+            // Still drawing the previous one? Its set must not have moved
+            if (_current && memcmp(_current, &_currentCopy, sizeof(LaserSet)) != 0) _stats.set_corrupted++;
+            _current = nullptr;
+
+            LaserQueue::Entry e;
+            if (!laser_queue.pop(e)) {
+                _usCarry = 0; // idle, nothing to catch up on
+                return;
+            }
+            _remaining = startEntry(e);
+        }
+        _remaining--;
+        _stats.busy_ticks++;
+    }
+}
+
+// --------------------------------------------------------------------------
+// USB LINK
+// --------------------------------------------------------------------------
+
+void SimUsbHost::send(const void* data, size_t len) {
+    const uint8_t* p = (const uint8_t*)data;
+    _out.insert(_out.end(), p, p + len);
+}
+
+size_t SimUsbHost::readReply(uint8_t* buf, size_t len) {
+    size_t n = (len < _in.size()) ? len : _in.size();
+    for (size_t i = 0; i < n; i++) {
+        buf[i] = _in.front();
+        _in.pop_front();
+    }
+    return n;
+}
+
+void SimUsbHost::step(uint32_t us) {
+    if (_out.empty()) {
+        _credit = 0;
+        return;
+    }
+    _credit += bytes_per_us * us;
+
+    // Whole packets only, and only if the FIFO can take them
+    while (!_out.empty() && _credit >= 1.0) {
+        size_t packet = (_out.size() < PACKET_SIZE) ? _out.size() : PACKET_SIZE;
+        if (_fifo.size() + packet > rx_fifo_size) {
+            _stats.nak_us += us;
+            _credit = 0;
+            return;
+        }
+        if (_credit < (double)packet) return;
+        uint8_t buf[PACKET_SIZE];
+        std::copy(_out.begin(), _out.begin() + packet, buf);
+        _fifo.insert(_fifo.end(), buf, buf + packet);
+        _out.erase(_out.begin(), _out.begin() + packet);
+        _credit -= packet;
+        _stats.bytes_out += packet;
+        _stats.rx_callbacks++;
+        tud_vendor_rx_cb(0, buf, (uint16_t)packet);
+    }
+}
+
+size_t SimUsbHost::fifoRead(uint8_t* buf, size_t len) {
+    size_t n = (len < _fifo.size()) ? len : _fifo.size();
+    std::copy(_fifo.begin(), _fifo.begin() + n, buf);
+    _fifo.erase(_fifo.begin(), _fifo.begin() + n);
+    return n;
+}
+
+size_t SimUsbHost::deviceWrite(const uint8_t* buf, size_t len) {
+    _in.insert(_in.end(), buf, buf + len);
+    _stats.bytes_in += len;
+    _stats.in_writes++;
+    return len;
+}
+
+void SimUsbHost::reset() {
+    _out.clear();
+    _fifo.clear();
+    _in.clear();
+    _credit = 0;
+    _stats = Stats();
+}
+
+uint32_t tud_vendor_n_available(uint8_t) { return (uint32_t)simUsb.fifoAvailable(); }
+uint32_t tud_vendor_n_read(uint8_t, void* buffer, uint32_t bufsize) { return (uint32_t)simUsb.fifoRead((uint8_t*)buffer, bufsize); }
+uint32_t tud_vendor_n_write(uint8_t, const void* buffer, uint32_t bufsize) { return (uint32_t)simUsb.deviceWrite((const uint8_t*)buffer, bufsize); }
+uint32_t tud_vendor_n_flush(uint8_t) { simUsb.deviceFlush(); return 0; }
+__attribute__((weak)) void tud_vendor_rx_cb(uint8_t, uint8_t const*, uint16_t) {}
+
+// The interrupt does not nest: a point reached from irq_point itself is passed
+void simUsbIrqPoint() {
+    static bool inside = false;
+    if (!simUsb.irq_point || inside) return;
+    inside = true;
+    simUsb.irq_point();
+    inside = false;
+}
@@ -0,0 +1,64 @@
+#ifndef SIM_USB_H
+#define SIM_USB_H
+
+// Simulated full-speed bulk link between a host and the vendor interface.
+//
+// The host queues OUT data with send(); step() moves it into the device's RX
+// FIFO in 64-byte packets at the link rate, but only while the FIFO has room
+// (otherwise the host is NAKed, like the real thing), and calls the RX
+// callback after each packet like tud_task() would. Whatever the device
+// writes to the IN endpoint is collected for the host to read back.
+//
+// Between step() calls the driver is only ever called back from outside
+// update(). On the device the USB interrupt lands anywhere in it; irq_point,
+// when set, runs at the points the driver marks with LMCV4_USB_IRQ_POINT()
+// and usually steps the link from there.
+
+#include <Arduino.h>
+#include <deque>
+#include <vector>
+
+class SimUsbHost {
+public:
+    static const size_t PACKET_SIZE = 64;
+
+    size_t rx_fifo_size = 1280;   // CFG_TUD_VENDOR_RX_BUFSIZE
+    double bytes_per_us = 1.0;    // ~1 MB/s usable full-speed bulk
+    void (*irq_point)() = nullptr;
+
+    struct Stats {
+        uint64_t bytes_out = 0;       // host -> device
+        uint64_t bytes_in = 0;        // device -> host
+        uint32_t in_writes = 0;       // tud_vendor_n_write calls
+        uint32_t in_flushes = 0;      // tud_vendor_n_flush calls
+        uint64_t nak_us = 0;          // time the host had data but the FIFO was full
+        uint32_t rx_callbacks = 0;    // tud_vendor_rx_cb calls
+    };
+
+    // Host side
+    void send(const void* data, size_t len);
+    size_t pendingOut() const { return _out.size(); }
+    size_t replyAvailable() const { return _in.size(); }
+    size_t readReply(uint8_t* buf, size_t len);
+    void step(uint32_t us);
+
+    // Device side (tud_vendor_n_*)
+    size_t fifoAvailable() const { return _fifo.size(); }
+    size_t fifoRead(uint8_t* buf, size_t len);
+    size_t deviceWrite(const uint8_t* buf, size_t len);
+    void deviceFlush() { _stats.in_flushes++; }
+
+    const Stats& stats() const { return _stats; }
+    void reset();
+
+private:
+    std::deque<uint8_t> _out;   // queued by the host, not yet on the wire
+    std::deque<uint8_t> _fifo;  // device RX FIFO
+    std::deque<uint8_t> _in;    // device -> host
+    double _credit = 0;
+    Stats _stats;
+};
+
+extern SimUsbHost simUsb;
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef SIM_XY2GALVO_H
+#define SIM_XY2GALVO_H
+
+// Native stand-in for the XY2Galvo library.
+//
+// drawTo()/moveTo() push one entry each onto laser_queue, and step() consumes
+// them in simulated time the way the PIO would: travel at LaserSet::speed
+// steps per 10 us tick, plus laser on/off and polygon delays (also in ticks).
+// The LaserSet is referenced by pointer like on the hardware, and each entry
+// keeps a copy so the simulator can flag a set that changed while queued.
+
+#include <Arduino.h>
+
+struct Point {
+    float x, y;
+};
+
+struct LaserSet {
+    float speed;      // galvo steps per tick
+    uint32_t pattern; // laser on/off pattern, 0 = off
+    uint delay_a;     // ticks: laser on delay at the start of a mark
+    uint delay_m;     // ticks: delay at each vertex (polygon delay)
+    uint delay_e;     // ticks: laser off delay at the end of a mark
+};
+
+extern LaserSet laser_set[];
+
+class LaserQueue {
+public:
+    static const uint SIZE = 1024;
+
+    struct Entry {
+        Point target;
+        const LaserSet* set; // null for a plain moveTo
+        LaserSet copy;
+    };
+
+    uint free() const { return SIZE - avail(); }
+    uint avail() const { return _wi - _ri; }
+
+    bool push(const Entry& e) {
+        if (avail() >= SIZE) return false;
+        _entries[_wi % SIZE] = e;
+        _wi++;
+        return true;
+    }
+    bool pop(Entry& e) {
+        if (avail() == 0) return false;
+        e = _entries[_ri % SIZE];
+        _ri++;
+        return true;
+    }
+    void clear() { _ri = _wi; }
+
+private:
+    Entry _entries[SIZE];
+    uint _wi = 0;
+    uint _ri = 0;
+};
+
+extern LaserQueue laser_queue;
+
+class XY2Galvo {
+public:
+    static const uint TICK_US = 10;
+
+    struct Stats {
+        uint32_t vectors = 0;        // queue entries consumed
+        uint32_t marks = 0;          // of which with the laser on
+        uint64_t busy_ticks = 0;     // ticks spent moving or waiting on delays
+        uint64_t mark_ticks = 0;     // ticks spent moving with the laser on
+        uint32_t set_corrupted = 0;  // LaserSets that changed while still queued
+        uint64_t path_hash = 0;      // FNV-1a of the targets and laser on/off, in order
+    };
+
+    void init() {}
+    void start() {}
+
+    void drawTo(const Point& p, const LaserSet& set) {
+        LaserQueue::Entry e = {p, &set, set};
+        laser_queue.push(e);
+    }
+    void moveTo(const Point& p) {
+        LaserQueue::Entry e = {p, nullptr, laser_set[0]};
+        laser_queue.push(e);
+    }
+    void requestAbort() {
+        laser_queue.clear();
+        _remaining = 0;
+        _current = nullptr;
+    }
+
+    // Advances the simulated galvo by `us` microseconds
+    void step(uint32_t us);
+
+    bool idle() const { return _remaining == 0 && laser_queue.avail() == 0; }
+    const Stats& stats() const { return _stats; }
+    void resetStats() { _stats = Stats(); }
+
+private:
+    Point _pos = {0, 0};
+    bool _laserOn = false;
+    const LaserSet* _current = nullptr;
+    LaserSet _currentCopy;
+    uint64_t _remaining = 0; // ticks left on the entry being drawn
+    uint32_t _usCarry = 0;
+    Stats _stats;
+
+    uint64_t startEntry(const LaserQueue::Entry& e);
+};
+
+#endif
@@ -0,0 +1,149 @@
+#ifndef BULK_VECTORS_H
+#define BULK_VECTORS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// Bulk vector records (vendor extension), shared by the firmware and host
+// tools (no Arduino dependencies). A host links this to encode, the driver
+// uses the same code to decode.
+//
+// A plain jump or cut costs a whole 12-byte record. A bulk record carries a
+// run of them as deltas from the previous vector's end:
+//
+//   header   one 12-byte record: opcode 0x80F0, params[0] = payload bytes,
+//            params[1] = vectors, params[2..4] = 0
+//   payload  per vector: varint(zigzag(dx) << 1 | cut), varint(zigzag(dy)),
+//            LEB128, then zero padding up to a multiple of 12 bytes so the
+//            stream stays record aligned
+//
+// Short vectors take 2 bytes instead of 12. The first delta is from the end
+// of the last move the driver parsed, whether that came in a plain record or
+// a bulk one.
+//
+// A bulk record has to go out in one piece: nothing, not even a status poll,
+// may be sent in the middle of it. Start each job with a plain jump so host
+// and driver agree on the position the first delta is taken from.
+//
+// Stock LightBurn never sends 0x80F0; a host has to switch the extension on
+// with vendor opcode 0x00F3 (params[0] = LMC_EXT_BULK_VECTORS) first and
+// check the reply, bytes 0-1 = supported, 2-3 = enabled extensions.
+
+#define LMC_OPCODE_BULK_VECTORS 0x80F0
+#define LMC_OPCODE_EXTENSIONS   0x00F3
+#define LMC_EXT_BULK_VECTORS    0x0001
+
+#define BULK_RECORD_SIZE  12
+#define BULK_MAX_PAYLOAD  240 // 20 records
+#define BULK_MAX_VECTORS  120 // 2 bytes each at best
+
+struct BulkVector {
+    bool cut;
+    uint16_t x, y;
+};
+
+inline uint32_t bulkZigzag(int32_t v) { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+inline int32_t bulkUnzigzag(uint32_t v) { return (int32_t)(v >> 1) ^ -(int32_t)(v & 1); }
+
+// Bytes of header + padded payload for a payload of `payload` bytes
+inline size_t bulkRecordBytes(size_t payload) {
+    return BULK_RECORD_SIZE + (payload + BULK_RECORD_SIZE - 1) / BULK_RECORD_SIZE * BULK_RECORD_SIZE;
+}
+
+// Decodes `count` vectors from a payload, starting at (x, y), which is left
+// at the end of the last one. Returns false if the payload is malformed (runs
+// out, or a coordinate leaves 0..65535).
+inline bool bulkDecode(const uint8_t* payload, size_t len, size_t count, uint16_t& x, uint16_t& y, BulkVector* out) {
+    size_t pos = 0;
+    int32_t cx = x, cy = y;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t v[2];
+        for (int k = 0; k < 2; k++) {
+            uint32_t value = 0;
+            int shift = 0;
+            while (true) {
+                if (pos >= len || shift > 21) return false;
+                uint8_t b = payload[pos++];
+                value |= (uint32_t)(b & 0x7F) << shift;
+                shift += 7;
+                if (!(b & 0x80)) break;
+            }
+            v[k] = value;
+        }
+        cx += bulkUnzigzag(v[0] >> 1);
+        cy += bulkUnzigzag(v[1]);
+        if (cx < 0 || cx > 0xFFFF || cy < 0 || cy > 0xFFFF) return false;
+        out[i].cut = v[0] & 1;
+        out[i].x = (uint16_t)cx;
+        out[i].y = (uint16_t)cy;
+    }
+    x = (uint16_t)cx;
+    y = (uint16_t)cy;
+    return true;
+}
+
+// Reference encoder. Feed it moves with add() until it is full, then write()
+// the record out and start the next one; the position carries over.
+class BulkVectorEncoder {
+public:
+    // (x, y): where the driver's last parsed move ended
+    explicit BulkVectorEncoder(uint16_t x = 0x8000, uint16_t y = 0x8000) : _x(x), _y(y) {}
+
+    // Returns false (and adds nothing) if the vector does not fit any more
+    bool add(bool cut, uint16_t x, uint16_t y) {
+        uint8_t buf[8];
+        size_t n = put(buf, bulkZigzag((int32_t)x - _x) << 1 | (cut ? 1 : 0));
+        n += put(buf + n, bulkZigzag((int32_t)y - _y));
+        if (_count == BULK_MAX_VECTORS || _len + n > BULK_MAX_PAYLOAD) return false;
+        memcpy(_payload + _len, buf, n);
+        _len += n;
+        _count++;
+        _x = x;
+        _y = y;
+        return true;
+    }
+
+    size_t count() const { return _count; }
+    bool empty() const { return _count == 0; }
+
+    // Bytes write() will produce
+    size_t bytes() const { return bulkRecordBytes(_len); }
+
+    // Writes header, payload and padding (little endian, like every record)
+    // to `out`, which needs room for bytes(). Returns the bytes written and
+    // starts a new record.
+    size_t write(uint8_t* out) {
+        size_t total = bytes();
+        memset(out, 0, total);
+        const uint16_t header[2] = {LMC_OPCODE_BULK_VECTORS, (uint16_t)_len};
+        out[0] = header[0] & 0xFF;
+        out[1] = header[0] >> 8;
+        out[2] = header[1] & 0xFF;
+        out[3] = header[1] >> 8;
+        out[4] = _count & 0xFF;
+        out[5] = _count >> 8;
+        memcpy(out + BULK_RECORD_SIZE, _payload, _len);
+        _len = 0;
+        _count = 0;
+        return total;
+    }
+
+private:
+    uint8_t _payload[BULK_MAX_PAYLOAD];
+    size_t _len = 0;
+    size_t _count = 0;
+    uint16_t _x, _y;
+
+    static size_t put(uint8_t* out, uint32_t v) {
+        size_t n = 0;
+        while (v >= 0x80) {
+            out[n++] = (uint8_t)(v | 0x80);
+            v >>= 7;
+        }
+        out[n++] = (uint8_t)v;
+        return n;
+    }
+};
+
+#endif
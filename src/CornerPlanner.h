@@ -0,0 +1,34 @@
+#ifndef CORNER_PLANNER_H
+#define CORNER_PLANNER_H
+
+#include <stdint.h>
+#include <math.h>
+#include "JobOp.h"
+
+// Polygon delay by corner angle.
+//
+// The polygon delay (0x800F) lets the mirrors catch up with a change of
+// direction before the next mark segment starts. Going straight on needs none
+// of it, a full reversal needs all of it. The parser looks past every cut for
+// the next move and tags the cut with the share of the delay its end joint
+// needs (JobOp.flags, in quarters), the hardware layer scales delay_m by it.
+//
+// Quarters rather than a continuous value so the LaserSet pool only ever sees
+// five distinct mark delays.
+
+// Quarters of the polygon delay for a joint turning from direction (ax, ay)
+// into (bx, by). Uses (1 - cos(turn)) / 2, rounded up: 0 for straight on,
+// 2 at 90 degrees, 4 for a reversal. Turns under ~8 degrees count as straight.
+inline uint8_t cornerQuarters(int32_t ax, int32_t ay, int32_t bx, int32_t by) {
+    float la = (float)ax * ax + (float)ay * ay;
+    float lb = (float)bx * bx + (float)by * by;
+    if (la == 0.0f || lb == 0.0f) return JOB_CORNER_FULL;
+
+    float cosTurn = ((float)ax * bx + (float)ay * by) / sqrtf(la * lb);
+    float share = (1.0f - cosTurn) * 0.5f;
+    if (share < 0.005f) return 0;
+    int quarters = (int)ceilf(share * JOB_CORNER_FULL);
+    return (quarters > JOB_CORNER_FULL) ? JOB_CORNER_FULL : (uint8_t)quarters;
+}
+
+#endif
@@ -0,0 +1,348 @@
+#ifndef CURVE_FLATTEN_H
+#define CURVE_FLATTEN_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include "CornerPlanner.h"
+
+// Arc and cubic Bezier records (vendor extension), shared by the firmware and
+// host tools (no Arduino dependencies).
+//
+// A circle sent as plain records is dozens of short cuts, a record and a job
+// queue entry each. A curve record carries the curve instead and the executor
+// cuts it into pieces itself, as short as the tolerance needs and no shorter:
+//
+//   arc      one 12-byte record: opcode 0x80F3, params[0] = end Y, params[1]
+//            = end X, params[2] = centre Y, params[3] = centre X, params[4] =
+//            CURVE_* flags. Starts where the last move ended, the radius is
+//            taken from there. An end equal to the start is a full circle.
+//   cubic    one 12-byte record: opcode 0x80F4, params[0] = first control
+//            point Y, params[1] = its X, params[2] = second control point Y,
+//            params[3] = its X, params[4] = 0; then a plain cut (0x8005) to
+//            where the curve ends. A jump, an arc or End of List before the
+//            cut drops the control points.
+//
+// Both are made with the power, speeds and delays in force, as a run of cuts
+// from where the last move ended.
+//
+// Curve records are only understood once the host switched them on with
+// vendor opcode 0x00F3 (params[0] = LMC_EXT_CURVES). Before that they are
+// ignored like any unknown opcode, and a cubic comes out as its chord. A list
+// with a curve record is not repeated on the device or cached: it is reported
+// like a MARK_COUNT list too long to record.
+
+#define LMC_OPCODE_ARC   0x80F3
+#define LMC_OPCODE_CUBIC 0x80F4
+#define LMC_EXT_CURVES   0x0008
+
+#define CURVE_CCW 0x0001 // arc turns from +X towards +Y, else the other way
+
+#define CURVE_RECORD_SIZE 12
+
+// Reference encoders (little endian, like every record). Return the bytes
+// written to `out`: 12 for an arc, 24 for a cubic's two records.
+inline size_t curveWriteArc(uint8_t* out, uint16_t x, uint16_t y, uint16_t cx, uint16_t cy, uint16_t flags) {
+    const uint16_t words[6] = {LMC_OPCODE_ARC, y, x, cy, cx, flags};
+    for (int i = 0; i < 6; i++) {
+        out[2 * i] = words[i] & 0xFF;
+        out[2 * i + 1] = words[i] >> 8;
+    }
+    return CURVE_RECORD_SIZE;
+}
+
+inline size_t curveWriteCubic(uint8_t* out, uint16_t ax, uint16_t ay, uint16_t bx, uint16_t by, uint16_t x, uint16_t y) {
+    const uint16_t words[12] = {LMC_OPCODE_CUBIC, ay, ax, by, bx, 0, 0x8005, y, x, 0, 0, 0};
+    for (int i = 0; i < 12; i++) {
+        out[2 * i] = words[i] & 0xFF;
+        out[2 * i + 1] = words[i] >> 8;
+    }
+    return 2 * CURVE_RECORD_SIZE;
+}
+
+struct CurvePiece {
+    uint16_t x, y;  // where the piece ends
+    uint8_t corner; // polygon delay quarters for the joint at its end (JobOp.h)
+    bool last;      // ends the curve, its joint is the next move's business
+};
+
+// Cuts a curve into pieces that stay within the tolerance of it, one piece
+// at a time, in integer arithmetic once the curve is set up:
+//
+// A chord over a stretch of a cubic strays from it by at most 1/8 of the
+// largest second derivative there, times the stretch squared, and the second
+// derivative of a cubic is largest at one end of the stretch. So a cubic is
+// halved (down to 1/16) while its halves need fewer pieces between them than
+// it does by that bound, and each part is stepped in as many equal pieces as
+// the bound asks for, by forward differences in 32.32 fixed point. The bound
+// holds exactly, up to rounding the ends of the pieces to whole steps.
+//
+// An arc turns the radius by the same angle every piece (18.14 fixed point
+// against a 2.30 rotation), the angle from the sagitta the tolerance allows.
+//
+// Pieces that round to no move are left out. The last piece always ends
+// exactly on the curve's end.
+//
+// Core 1 (the executor's copy).
+class CurveFlattener {
+public:
+    static const int MAX_PIECES = 1024; // per arc, or per part of a cubic
+
+    struct Stats {
+        uint32_t arcs = 0;
+        uint32_t cubics = 0;
+        uint32_t pieces = 0;
+    };
+
+    // Largest distance a piece may keep from the curve, in steps
+    void setTolerance(uint16_t steps) { _tolerance = steps ? steps : 1; }
+
+    // From (x0, y0) around (cx, cy) to (x1, y1)
+    void beginArc(uint16_t x0, uint16_t y0, uint16_t cx, uint16_t cy, uint16_t x1, uint16_t y1, bool ccw) {
+        const float pi = 3.14159265358979f;
+        _cubic = false;
+        _cx = cx;
+        _cy = cy;
+        _endX = x1;
+        _endY = y1;
+        float vx = (float)x0 - cx, vy = (float)y0 - cy;
+        float r = sqrtf(vx * vx + vy * vy);
+        float sweep = atan2f((float)y1 - cy, (float)x1 - cx) - atan2f(vy, vx);
+        if (!ccw) sweep = -sweep;
+        while (sweep <= 0.0f) sweep += 2.0f * pi;
+        if (x1 == x0 && y1 == y0) sweep = 2.0f * pi;
+
+        // Sagitta r (1 - cos(a / 2)) within the tolerance
+        float step = (r > _tolerance) ? 2.0f * acosf(1.0f - _tolerance / r) : pi;
+        if (step > 0.5f * pi) step = 0.5f * pi;
+        int32_t n = (int32_t)ceilf(sweep / step);
+        _pieces = (n < 1) ? 1 : (n > MAX_PIECES) ? MAX_PIECES : n;
+        float a = (ccw ? sweep : -sweep) / _pieces;
+        _cos = (int64_t)lroundf(cosf(a) * (float)(1 << 30));
+        _sin = (int64_t)lroundf(sinf(a) * (float)(1 << 30));
+        _vx = (int64_t)((int32_t)x0 - cx) * (1 << ARC_SHIFT);
+        _vy = (int64_t)((int32_t)y0 - cy) * (1 << ARC_SHIFT);
+        _done = 0;
+        _stats.arcs++;
+        start(x0, y0);
+    }
+
+    // From (x0, y0) to (x1, y1), control points (ax, ay) and (bx, by)
+    void beginCubic(uint16_t x0, uint16_t y0, uint16_t ax, uint16_t ay, uint16_t bx, uint16_t by, uint16_t x1, uint16_t y1) {
+        _cubic = true;
+        _endX = x1;
+        _endY = y1;
+        setupCubic(0, x0, ax, bx, x1);
+        setupCubic(1, y0, ay, by, y1);
+        _partStart[0] = 0;
+        _partWidth[0] = GRID;
+        _parts = 1;
+        _left = 0;
+        _stats.cubics++;
+        start(x0, y0);
+    }
+
+    // Begun and next() has not returned false yet
+    bool active() const { return _active; }
+    void cancel() { _active = false; }
+
+    // Next piece, false once the curve is done
+    bool next(CurvePiece& piece) {
+        if (!_active) return false;
+        if (!_ahead) {
+            _active = false;
+            return false;
+        }
+        piece.x = _aheadX;
+        piece.y = _aheadY;
+        uint16_t x = 0, y = 0;
+        bool more = false;
+        while (advance(x, y)) {
+            if (x != _aheadX || y != _aheadY) {
+                more = true;
+                break;
+            }
+        }
+        piece.last = !more;
+        piece.corner = more ? cornerQuarters((int32_t)_aheadX - _atX, (int32_t)_aheadY - _atY,
+                                             (int32_t)x - _aheadX, (int32_t)y - _aheadY)
+                            : (uint8_t)JOB_CORNER_FULL;
+        _atX = _aheadX;
+        _atY = _aheadY;
+        _aheadX = x;
+        _aheadY = y;
+        _ahead = more;
+        _stats.pieces++;
+        return true;
+    }
+
+    const Stats& stats() const { return _stats; }
+
+private:
+    static const int FRAC = 32;       // cubic: 32.32
+    static const int SPLIT = 4;       // cubic parts down to 1/16
+    static const int GRID = 1 << SPLIT;
+    static const int ARC_SHIFT = 14;  // arc radius: 18.14
+
+    uint16_t _tolerance = 1;
+    bool _active = false;
+    bool _cubic = false;
+    uint16_t _atX = 0, _atY = 0;      // end of the last piece handed out
+    uint16_t _aheadX = 0, _aheadY = 0; // end of the piece after it
+    bool _ahead = false;
+    bool _finished = false;           // advance() made the end point
+    uint16_t _endX = 0, _endY = 0;
+
+    // Cubic, per axis: power basis a t^3 + b t^2 + c t + d in whole steps;
+    // the parts still to do (start and width in 1/GRID of t, the next one on
+    // top); the point in the part being stepped and its first three forward
+    // differences, and where the part ends, in 32.32
+    int64_t _a[2] = {}, _b[2] = {}, _c[2] = {}, _d[2] = {};
+    uint8_t _partStart[SPLIT + 1], _partWidth[SPLIT + 1];
+    int _parts = 0;
+    int64_t _p[2] = {}, _d1[2] = {}, _d2[2] = {}, _d3[2] = {}, _partEnd[2] = {};
+    int32_t _left = 0; // pieces left in the part
+
+    // Arc: centre, radius vector and the rotation per piece
+    int32_t _cx = 0, _cy = 0;
+    int64_t _vx = 0, _vy = 0;
+    int64_t _cos = 0, _sin = 0;
+    int32_t _pieces = 0, _done = 0;
+
+    Stats _stats;
+
+    void start(uint16_t x0, uint16_t y0) {
+        _atX = x0;
+        _atY = y0;
+        _finished = false;
+        _active = true;
+        _ahead = true;
+        _aheadX = _endX;
+        _aheadY = _endY;
+        // First point that moves, or straight to the end (a dot, or a curve
+        // that never leaves its start by a whole step)
+        uint16_t x, y;
+        while (advance(x, y)) {
+            if (x != x0 || y != y0) {
+                _aheadX = x;
+                _aheadY = y;
+                return;
+            }
+        }
+    }
+
+    void setupCubic(int i, int32_t p0, int32_t p1, int32_t p2, int32_t p3) {
+        _a[i] = -p0 + 3 * p1 - 3 * p2 + p3;
+        _b[i] = 3 * p0 - 6 * p1 + 3 * p2;
+        _c[i] = 3 * (p1 - p0);
+        _d[i] = p0;
+    }
+
+    // Next point along the curve, false once the end point was made
+    bool advance(uint16_t& x, uint16_t& y) {
+        if (_finished) return false;
+        if (_cubic ? stepCubic(x, y) : stepArc(x, y)) return true;
+        _finished = true;
+        x = _endX;
+        y = _endY;
+        return true;
+    }
+
+    bool stepArc(uint16_t& x, uint16_t& y) {
+        if (++_done >= _pieces) return false;
+        int64_t vx = (_vx * _cos - _vy * _sin + (1 << 29)) >> 30;
+        _vy = (_vx * _sin + _vy * _cos + (1 << 29)) >> 30;
+        _vx = vx;
+        x = clamp(((int64_t)_cx << ARC_SHIFT) + _vx, ARC_SHIFT);
+        y = clamp(((int64_t)_cy << ARC_SHIFT) + _vy, ARC_SHIFT);
+        return true;
+    }
+
+    // Part [u, u + w] / GRID of the cubic as A s^3 + B s^2 + C s + D, s = 0..1,
+    // in 32.32 (exact: GRID^3 divides 2^32)
+    void partCoefficients(int i, int64_t u, int64_t w, int64_t& A, int64_t& B, int64_t& C, int64_t& D) const {
+        const int64_t scale = (int64_t)1 << (FRAC - 3 * SPLIT);
+        A = _a[i] * w * w * w * scale;
+        B = (3 * _a[i] * u + _b[i] * GRID) * w * w * scale;
+        C = (3 * _a[i] * u * u + 2 * _b[i] * u * GRID + _c[i] * GRID * GRID) * w * scale;
+        D = (((_a[i] * u + _b[i] * GRID) * u + _c[i] * GRID * GRID) * u + _d[i] * GRID * GRID * GRID) * scale;
+    }
+
+    // Equal pieces a stretch needs whose second derivative reaches `m` steps
+    int32_t piecesFor(float m) const {
+        float n = ceilf(sqrtf(m / (8.0f * _tolerance)));
+        return (n < 1.0f) ? 1 : (n > MAX_PIECES) ? MAX_PIECES : (int32_t)n;
+    }
+
+    static float norm(int64_t x, int64_t y) {
+        const float unit = 1.0f / 4294967296.0f;
+        float fx = (float)x * unit, fy = (float)y * unit;
+        return sqrtf(fx * fx + fy * fy);
+    }
+
+    // Takes the next part off the stack, halving it while that saves pieces,
+    // and sets up its forward differences. False once there are none left.
+    bool nextPart() {
+        while (_parts > 0) {
+            int64_t u = _partStart[_parts - 1], w = _partWidth[_parts - 1];
+            int64_t A[2], B[2], C[2], D[2];
+            for (int i = 0; i < 2; i++) partCoefficients(i, u, w, A[i], B[i], C[i], D[i]);
+
+            // Second derivative 6 A s + 2 B at the start, middle and end
+            float e0 = norm(2 * B[0], 2 * B[1]);
+            float em = norm(3 * A[0] + 2 * B[0], 3 * A[1] + 2 * B[1]);
+            float e1 = norm(6 * A[0] + 2 * B[0], 6 * A[1] + 2 * B[1]);
+            int32_t n = piecesFor(fmaxf(e0, e1));
+            // A half has a quarter of the second derivative over its own s
+            if (w > 1 && piecesFor(0.25f * fmaxf(e0, em)) + piecesFor(0.25f * fmaxf(em, e1)) < n) {
+                _partStart[_parts - 1] = (uint8_t)(u + w / 2);
+                _partWidth[_parts - 1] = (uint8_t)(w / 2);
+                _partStart[_parts] = (uint8_t)u;
+                _partWidth[_parts] = (uint8_t)(w / 2);
+                _parts++;
+                continue;
+            }
+            _parts--;
+
+            int64_t n2 = (int64_t)n * n, n3 = n2 * n;
+            for (int i = 0; i < 2; i++) {
+                _p[i] = D[i];
+                _d1[i] = A[i] / n3 + B[i] / n2 + C[i] / n;
+                _d2[i] = 6 * A[i] / n3 + 2 * B[i] / n2;
+                _d3[i] = 6 * A[i] / n3;
+                _partEnd[i] = A[i] + B[i] + C[i] + D[i];
+            }
+            _left = n;
+            return true;
+        }
+        return false;
+    }
+
+    bool stepCubic(uint16_t& x, uint16_t& y) {
+        while (_left == 0) {
+            if (!nextPart()) return false;
+        }
+        if (--_left == 0) {
+            // The part's end, exactly
+            x = clamp(_partEnd[0], FRAC);
+            y = clamp(_partEnd[1], FRAC);
+            return true;
+        }
+        for (int i = 0; i < 2; i++) {
+            _p[i] += _d1[i];
+            _d1[i] += _d2[i];
+            _d2[i] += _d3[i];
+        }
+        x = clamp(_p[0], FRAC);
+        y = clamp(_p[1], FRAC);
+        return true;
+    }
+
+    static uint16_t clamp(int64_t v, int shift) {
+        int64_t r = (v + ((int64_t)1 << (shift - 1))) >> shift;
+        return (r < 0) ? 0 : (r > 0xFFFF) ? 0xFFFF : (uint16_t)r;
+    }
+};
+
+#endif
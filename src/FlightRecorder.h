@@ -0,0 +1,87 @@
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+// Always-on record of the most recent commands, for post-mortems of jobs that
+// stutter. Recording is a handful of stores into a fixed RAM ring; nothing is
+// formatted or sent until someone asks for a dump.
+//
+// One recorder per writer (the parser on core 0, the executor on core 1), so
+// record() needs no locking. Shared with the host decoder in tools/, keep it
+// free of Arduino dependencies.
+
+#ifndef LMCV4_FLIGHT_RECORDER
+#define LMCV4_FLIGHT_RECORDER 1
+#endif
+
+#ifndef LMCV4_FLIGHT_RECORDER_SIZE
+#define LMCV4_FLIGHT_RECORDER_SIZE 512 // records per core, power of two
+#endif
+
+enum FlightSource : uint8_t {
+    FR_PARSED = 1,   // job record parsed off the USB stream
+    FR_SYSTEM = 2,   // system command handled
+    FR_EXECUTED = 3, // job op executed into the galvo queue
+};
+
+// 16 bytes, little endian, exactly as it goes out in a dump
+struct FlightRecord {
+    uint32_t time_us;
+    uint16_t opcode;
+    uint16_t p0;
+    uint16_t p1;
+    uint8_t source;       // FlightSource
+    uint8_t reserved;
+    uint16_t job_depth;   // _jobQueue entries
+    uint16_t other_depth; // parsed/system: stream buffer bytes, executed: LaserQueue slots
+} __attribute__((packed));
+
+// Dump layout: header, then `count` FlightRecords oldest first
+struct FlightDumpHeader {
+    char magic[4];        // "LMFR"
+    uint16_t version;     // 1
+    uint16_t record_size; // sizeof(FlightRecord)
+    uint32_t count;
+} __attribute__((packed));
+
+template <size_t Size>
+class FlightRecorder {
+    static_assert((Size & (Size - 1)) == 0, "FlightRecorder Size must be a power of two");
+
+public:
+    void record(uint32_t time_us, uint8_t source, uint16_t opcode, uint16_t p0, uint16_t p1, uint16_t job_depth,
+                uint16_t other_depth) {
+        if (_frozen.load(std::memory_order_relaxed)) return;
+        FlightRecord& r = _records[_next & (Size - 1)];
+        r.time_us = time_us;
+        r.opcode = opcode;
+        r.p0 = p0;
+        r.p1 = p1;
+        r.source = source;
+        r.job_depth = job_depth;
+        r.other_depth = other_depth;
+        _next++;
+    }
+
+    // Stops recording so a reader on another core sees a stable ring.
+    // Give the writer a moment to finish a record it had already started.
+    void freeze(bool frozen) { _frozen.store(frozen, std::memory_order_release); }
+
+    size_t count() const { return (_next < Size) ? _next : Size; }
+
+    // i = 0 is the oldest record still held
+    const FlightRecord& at(size_t i) const {
+        size_t first = (_next < Size) ? 0 : _next;
+        return _records[(first + i) & (Size - 1)];
+    }
+
+private:
+    FlightRecord _records[Size] = {};
+    size_t _next = 0;
+    std::atomic<bool> _frozen{false};
+};
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef FLOW_CONTROL_H
+#define FLOW_CONTROL_H
+
+#include <stdint.h>
+
+// Decides the READY status bit from the fill of the three buffers between the
+// host and the galvo, with hysteresis so it does not flicker every poll.
+//
+// Fills and watermarks are in command units (12-byte records for the stream
+// buffer, ops for the job queue, slots for the LaserQueue). READY drops as soon
+// as any buffer reaches its high watermark and only comes back once every
+// buffer is at or below its low watermark.
+
+enum FlowBuffer : uint8_t {
+    FLOW_STREAM = 0,  // _usbStreamBuffer
+    FLOW_JOB,         // _jobQueue
+    FLOW_GALVO,       // LaserQueue
+    FLOW_BUFFER_COUNT
+};
+
+class FlowControl {
+public:
+    struct Stats {
+        uint32_t episodes = 0;              // times READY was dropped
+        uint32_t trips[FLOW_BUFFER_COUNT] = {}; // which buffer dropped it
+        uint32_t not_ready_us = 0;          // total time not ready (finished episodes)
+        uint32_t longest_not_ready_us = 0;
+    };
+
+    FlowControl() {
+        for (int i = 0; i < FLOW_BUFFER_COUNT; i++) {
+            _high[i] = 0xFFFF;
+            _low[i] = 0xFFFF;
+        }
+    }
+
+    void setWatermarks(FlowBuffer buffer, uint16_t high, uint16_t low) {
+        _high[buffer] = high;
+        _low[buffer] = (low < high) ? low : high;
+    }
+
+    // Feed the current fills, returns the READY state to report
+    bool update(const uint16_t fill[FLOW_BUFFER_COUNT], uint32_t now_us) {
+        if (_ready) {
+            for (int i = 0; i < FLOW_BUFFER_COUNT; i++) {
+                if (fill[i] >= _high[i]) {
+                    _ready = false;
+                    _since = now_us;
+                    _stats.episodes++;
+                    _stats.trips[i]++;
+                    break;
+                }
+            }
+        } else {
+            bool drained = true;
+            for (int i = 0; i < FLOW_BUFFER_COUNT; i++) {
+                if (fill[i] > _low[i]) drained = false;
+            }
+            if (drained) {
+                uint32_t episode = now_us - _since;
+                _stats.not_ready_us += episode;
+                if (episode > _stats.longest_not_ready_us) _stats.longest_not_ready_us = episode;
+                _ready = true;
+            }
+        }
+        return _ready;
+    }
+
+    bool ready() const { return _ready; }
+
+    // Total time not ready, including an episode still in progress
+    uint32_t notReadyUs(uint32_t now_us) const {
+        return _stats.not_ready_us + (_ready ? 0 : now_us - _since);
+    }
+
+    const Stats& stats() const { return _stats; }
+
+private:
+    uint16_t _high[FLOW_BUFFER_COUNT];
+    uint16_t _low[FLOW_BUFFER_COUNT];
+    bool _ready = true;
+    uint32_t _since = 0;
+    Stats _stats;
+};
+
+#endif
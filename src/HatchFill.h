@@ -0,0 +1,285 @@
+#ifndef HATCH_FILL_H
+#define HATCH_FILL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+// Hatch fill records (vendor extension), shared by the firmware and host
+// tools (no Arduino dependencies).
+//
+// A hatched shape sent as plain records costs a jump and a cut per hatch line,
+// hundreds of job queue entries for a single shape. A hatch record carries the
+// outline instead and the executor makes the lines itself:
+//
+//   header   one 12-byte record: opcode 0x80F2, params[0] = vertices,
+//            params[1] = contours, params[2] = angle of the lines in 0.01
+//            degrees (0..17999), params[3] = spacing in steps, params[4] =
+//            HATCH_* flags
+//   payload  the vertex count of each contour (uint16), then every vertex as
+//            x, y (uint16), zero padding up to a multiple of 12 bytes
+//
+// Every contour is closed back to its first vertex. Inside is even-odd, so a
+// contour inside another one is a hole. Lines lie on a grid through the field
+// centre, (k + 1/2) spacings off it, so shapes next to each other line up.
+//
+// The fill is made with the power, speeds and delays in force: each line is a
+// jump to where it enters the shape and a cut to where it leaves, and the fill
+// ends with a jump back to the first vertex, where the driver takes the next
+// move (and the first delta of a bulk record) from.
+//
+// A hatch record has to go out in one piece and is only understood once the
+// host switched it on with vendor opcode 0x00F3 (params[0] = LMC_EXT_HATCH).
+// A list with a hatch record is not repeated on the device or cached: it is
+// reported like a MARK_COUNT list too long to record.
+
+#define LMC_OPCODE_HATCH_FILL 0x80F2
+#define LMC_EXT_HATCH         0x0004
+
+#define HATCH_CROSS     0x0001 // a second pass at angle + 90 degrees
+#define HATCH_ALTERNATE 0x0002 // every other line backwards, else all the same way
+
+#define HATCH_RECORD_SIZE  12
+#define HATCH_MAX_VERTICES 256
+#define HATCH_MAX_CONTOURS 16
+#define HATCH_ANGLE_RANGE  18000 // 180 degrees
+#define HATCH_MAX_PAYLOAD  (2 * HATCH_MAX_CONTOURS + 4 * HATCH_MAX_VERTICES)
+
+struct HatchOutline {
+    uint16_t vertices, contours;
+    uint16_t angle, spacing, flags;
+    uint16_t ends[HATCH_MAX_CONTOURS]; // one past the last vertex of each contour
+    uint16_t x[HATCH_MAX_VERTICES];
+    uint16_t y[HATCH_MAX_VERTICES];
+};
+
+struct HatchMove {
+    bool cut;
+    uint16_t x, y;
+};
+
+inline size_t hatchPayloadBytes(size_t vertices, size_t contours) { return 2 * contours + 4 * vertices; }
+
+// Bytes of header + padded payload, 0 if the header is bad and there is no
+// telling where the record ends
+inline size_t hatchRecordBytes(size_t vertices, size_t contours) {
+    if (contours < 1 || contours > HATCH_MAX_CONTOURS || vertices > HATCH_MAX_VERTICES || vertices < 3 * contours) return 0;
+    size_t payload = hatchPayloadBytes(vertices, contours);
+    return HATCH_RECORD_SIZE + (payload + HATCH_RECORD_SIZE - 1) / HATCH_RECORD_SIZE * HATCH_RECORD_SIZE;
+}
+
+// Fills `out` from the header's params[0..4] and its payload. Returns false if
+// the record is malformed: contour sizes that do not add up, a contour of
+// fewer than 3 vertices, an angle out of range or zero spacing.
+inline bool hatchDecode(const uint16_t* params, const uint8_t* payload, HatchOutline& out) {
+    if (!hatchRecordBytes(params[0], params[1]) || params[2] >= HATCH_ANGLE_RANGE || params[3] == 0) return false;
+    out.vertices = params[0];
+    out.contours = params[1];
+    out.angle = params[2];
+    out.spacing = params[3];
+    out.flags = params[4];
+    size_t end = 0;
+    for (size_t c = 0; c < out.contours; c++) {
+        size_t n = payload[2 * c] | payload[2 * c + 1] << 8;
+        if (n < 3) return false;
+        end += n;
+        out.ends[c] = (uint16_t)end;
+    }
+    if (end != out.vertices) return false;
+    const uint8_t* p = payload + 2 * out.contours;
+    for (size_t i = 0; i < out.vertices; i++, p += 4) {
+        out.x[i] = p[0] | p[1] << 8;
+        out.y[i] = p[2] | p[3] << 8;
+    }
+    return true;
+}
+
+// Reference encoder: writes header, payload and padding (little endian, like
+// every record). `out` needs room for hatchRecordBytes(). Returns the bytes
+// written, 0 if the outline does not fit one record.
+inline size_t hatchWrite(uint8_t* out, const HatchOutline& outline) {
+    const uint16_t header[6] = {LMC_OPCODE_HATCH_FILL, outline.vertices, outline.contours,
+                                outline.angle, outline.spacing, outline.flags};
+    size_t total = hatchRecordBytes(outline.vertices, outline.contours);
+    if (!total) return 0;
+    memset(out, 0, total);
+    for (int i = 0; i < 6; i++) {
+        out[2 * i] = header[i] & 0xFF;
+        out[2 * i + 1] = header[i] >> 8;
+    }
+    uint8_t* p = out + HATCH_RECORD_SIZE;
+    for (size_t c = 0; c < outline.contours; c++, p += 2) {
+        uint16_t n = outline.ends[c] - (c ? outline.ends[c - 1] : 0);
+        p[0] = n & 0xFF;
+        p[1] = n >> 8;
+    }
+    for (size_t i = 0; i < outline.vertices; i++, p += 4) {
+        p[0] = outline.x[i] & 0xFF;
+        p[1] = outline.x[i] >> 8;
+        p[2] = outline.y[i] & 0xFF;
+        p[3] = outline.y[i] >> 8;
+    }
+    return total;
+}
+
+// Makes the moves of a fill one at a time, a scan line at a time: the outline
+// is turned so the lines run along u, each line is cut with every edge, and
+// the crossings, sorted along u, pair up into the stretches inside the shape.
+// Holds one line's crossings, whatever the size of the fill.
+//
+// Core 1 (the executor's copy).
+class HatchFill {
+public:
+    struct Stats {
+        uint32_t fills = 0;
+        uint32_t lines = 0; // scan lines that crossed the shape
+        uint32_t cuts = 0;
+    };
+
+    // (x, y): where the head is, a fill starting there needs no first jump
+    void begin(const HatchOutline& outline, uint16_t x, uint16_t y) {
+        _outline = &outline;
+        _atX = x;
+        _atY = y;
+        _pass = 0;
+        _reverse = true; // flipped to forward by the first line
+        _cutPending = false;
+        _homed = false;
+        _active = true;
+        startPass();
+        _stats.fills++;
+    }
+
+    // Begun and next() has not returned false yet
+    bool active() const { return _active; }
+    void cancel() { _active = false; }
+
+    // Next move, false once the fill is done
+    bool next(HatchMove& move) {
+        if (!_active) return false;
+        if (_cutPending) {
+            _cutPending = false;
+            return moveTo(true, _cutX, _cutY, move);
+        }
+        while (true) {
+            if (_pair < _hits / 2) {
+                int i = _reverse ? _hits / 2 - 1 - _pair : _pair;
+                _pair++;
+                float u0 = _hit[2 * i], u1 = _hit[2 * i + 1];
+                if (_reverse) {
+                    float t = u0;
+                    u0 = u1;
+                    u1 = t;
+                }
+                uint16_t x0, y0;
+                toField(u0, x0, y0);
+                toField(u1, _cutX, _cutY);
+                if (x0 == _cutX && y0 == _cutY) continue;
+                _stats.cuts++;
+                if (x0 == _atX && y0 == _atY) return moveTo(true, _cutX, _cutY, move);
+                _cutPending = true;
+                return moveTo(false, x0, y0, move);
+            }
+            if (_line <= _lastLine) {
+                crossLine(_line++);
+                continue;
+            }
+            if (++_pass < ((_outline->flags & HATCH_CROSS) ? 2 : 1)) {
+                startPass();
+                continue;
+            }
+            // Back to the first vertex, so the driver knows where the head is
+            if (!_homed) {
+                _homed = true;
+                if (_atX != _outline->x[0] || _atY != _outline->y[0]) return moveTo(false, _outline->x[0], _outline->y[0], move);
+            }
+            _active = false;
+            return false;
+        }
+    }
+
+    const Stats& stats() const { return _stats; }
+
+private:
+    const HatchOutline* _outline = nullptr;
+    bool _active = false;
+    int _pass = 0;
+    float _c = 1.0f, _s = 0.0f;       // direction of the lines
+    float _u[HATCH_MAX_VERTICES];     // outline turned: along the lines
+    float _v[HATCH_MAX_VERTICES];     // and across them
+    int32_t _line = 0, _lastLine = -1;
+    float _v0 = 0.0f;                 // v of the line being cut
+    float _hit[HATCH_MAX_VERTICES];   // its crossings, sorted along u
+    int _hits = 0;
+    int _pair = 0;
+    bool _reverse = false;
+    uint16_t _atX = 0, _atY = 0;
+    bool _cutPending = false;
+    bool _homed = false;
+    uint16_t _cutX = 0, _cutY = 0;
+    Stats _stats;
+
+    void startPass() {
+        const float pi = 3.14159265358979f;
+        float a = (_outline->angle + (_pass ? HATCH_ANGLE_RANGE / 2 : 0)) * (pi / HATCH_ANGLE_RANGE);
+        _c = cosf(a);
+        _s = sinf(a);
+        float lo = 1e9f, hi = -1e9f;
+        for (size_t i = 0; i < _outline->vertices; i++) {
+            float dx = (float)_outline->x[i] - 32768.0f, dy = (float)_outline->y[i] - 32768.0f;
+            _u[i] = dx * _c + dy * _s;
+            _v[i] = dy * _c - dx * _s;
+            if (_v[i] < lo) lo = _v[i];
+            if (_v[i] > hi) hi = _v[i];
+        }
+        float spacing = _outline->spacing;
+        _line = (int32_t)ceilf(lo / spacing - 0.5f);
+        _lastLine = (int32_t)floorf(hi / spacing - 0.5f);
+        _hits = 0;
+        _pair = 0;
+    }
+
+    // Crossings of line k with every edge. An edge counts if one end is at or
+    // below the line and the other above it, so a line through a vertex
+    // crosses once and one along an edge not at all.
+    void crossLine(int32_t k) {
+        _v0 = ((float)k + 0.5f) * _outline->spacing;
+        _hits = 0;
+        _pair = 0;
+        size_t first = 0;
+        for (size_t c = 0; c < _outline->contours; c++) {
+            size_t end = _outline->ends[c];
+            for (size_t i = first, j = end - 1; i < end; j = i++) {
+                if ((_v[i] <= _v0) == (_v[j] <= _v0)) continue;
+                float u = _u[j] + (_v0 - _v[j]) * (_u[i] - _u[j]) / (_v[i] - _v[j]);
+                int n = _hits++;
+                while (n > 0 && _hit[n - 1] > u) {
+                    _hit[n] = _hit[n - 1];
+                    n--;
+                }
+                _hit[n] = u;
+            }
+            first = end;
+        }
+        if (_hits < 2) return;
+        _stats.lines++;
+        if (_outline->flags & HATCH_ALTERNATE) _reverse = !_reverse;
+        else _reverse = false;
+    }
+
+    void toField(float u, uint16_t& x, uint16_t& y) const {
+        x = clamp(32768.0f + u * _c - _v0 * _s);
+        y = clamp(32768.0f + u * _s + _v0 * _c);
+    }
+    static uint16_t clamp(float v) { return (v <= 0.0f) ? 0 : (v >= 65535.0f) ? 0xFFFF : (uint16_t)(v + 0.5f); }
+
+    bool moveTo(bool cut, uint16_t x, uint16_t y, HatchMove& move) {
+        move = {cut, x, y};
+        _atX = x;
+        _atY = y;
+        return true;
+    }
+};
+
+#endif
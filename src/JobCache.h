@@ -0,0 +1,142 @@
+#ifndef JOB_CACHE_H
+#define JOB_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "JobReplay.h"
+
+// Recently completed job lists, as they were queued (JobRecord: decoded
+// opcode, params and the corner planner's tags), for production runs that
+// send the same job over and over.
+//
+// A list is keyed by a hash of its first KeyRecords records. Once that many
+// records of a new list have arrived and the key is found, the driver follows
+// the cached list: job ops come from the cache instead of being decoded and
+// planned again, optionally up to a run-ahead limit before the host's records
+// for them have arrived, and every record that does arrive is compared with
+// the cached one.
+//
+// Lists live back to back in one arena of Records records, at most Entries
+// of them; the least recently used ones go first when a new list needs room.
+//
+// Core 0 only.
+
+template <size_t Records, size_t Entries, size_t KeyRecords>
+class JobCache {
+public:
+    static const int NONE = -1;
+    static const size_t KEY_RECORDS = KeyRecords;
+
+    struct Stats {
+        uint32_t hits = 0;       // list keys found
+        uint32_t misses = 0;     // list keys not found
+        uint32_t completed = 0;  // lists followed from the cache up to their End of List
+        uint32_t mismatches = 0; // lists that turned out different from the cached one
+        uint32_t faults = 0;     // mismatches after ops had already been queued ahead
+        uint32_t inserts = 0;
+        uint32_t evictions = 0;
+        uint32_t too_large = 0;  // lists longer than the arena
+    };
+
+    // FNV-1a over the fields a JobRecord keeps
+    static uint32_t hashStart() { return 2166136261u; }
+    static uint32_t hash(uint32_t h, uint16_t opcode, uint16_t p0, uint16_t p1) {
+        const uint16_t words[3] = {opcode, p0, p1};
+        for (uint16_t w : words) {
+            h = (h ^ (w & 0xFF)) * 16777619u;
+            h = (h ^ (w >> 8)) * 16777619u;
+        }
+        return h;
+    }
+
+    int find(uint32_t key) {
+        for (size_t i = 0; i < _count; i++) {
+            if (_entries[i].key != key) continue;
+            _entries[i].lastUse = ++_clock;
+            return (int)i;
+        }
+        return NONE;
+    }
+
+    const JobRecord* records(int entry) const { return _arena + _entries[entry].offset; }
+    size_t length(int entry) const { return _entries[entry].length; }
+
+    // Stores a copy of a complete list, replacing any list with the same key.
+    // Invalidates entry numbers handed out before.
+    void insert(uint32_t key, const JobRecord* records, size_t length) {
+        if (length > Records) {
+            _stats.too_large++;
+            return;
+        }
+        for (size_t i = 0; i < _count; i++) {
+            if (_entries[i].key == key) {
+                remove(i);
+                break;
+            }
+        }
+        while (_count > 0 && (_count == Entries || used() + length > Records)) {
+            remove(leastRecentlyUsed());
+            _stats.evictions++;
+        }
+
+        size_t offset = used();
+        Entry& e = _entries[_count++];
+        e.key = key;
+        e.offset = offset;
+        e.length = length;
+        e.lastUse = ++_clock;
+        memcpy(_arena + e.offset, records, length * sizeof(JobRecord));
+        _stats.inserts++;
+    }
+
+    void evict(int entry) {
+        remove((size_t)entry);
+        _stats.evictions++;
+    }
+
+    void clear() { _count = 0; }
+
+    size_t entries() const { return _count; }
+    Stats& stats() { return _stats; }
+    const Stats& stats() const { return _stats; }
+
+private:
+    struct Entry {
+        uint32_t key;
+        size_t offset;
+        size_t length;
+        uint32_t lastUse;
+    };
+
+    JobRecord _arena[Records];
+    Entry _entries[Entries];  // in arena order
+    size_t _count = 0;
+    uint32_t _clock = 0;
+    Stats _stats;
+
+    size_t used() const { return _count ? _entries[_count - 1].offset + _entries[_count - 1].length : 0; }
+
+    size_t leastRecentlyUsed() const {
+        size_t lru = 0;
+        for (size_t i = 1; i < _count; i++) {
+            if (_entries[i].lastUse < _entries[lru].lastUse) lru = i;
+        }
+        return lru;
+    }
+
+    // Closes the gap, lists after it move down
+    void remove(size_t i) {
+        size_t end = used();
+        size_t gap = _entries[i].length;
+        size_t from = _entries[i].offset + gap;
+        memmove(_arena + _entries[i].offset, _arena + from, (end - from) * sizeof(JobRecord));
+        for (size_t j = i + 1; j < _count; j++) {
+            _entries[j - 1] = _entries[j];
+            _entries[j - 1].offset -= gap;
+        }
+        _count--;
+    }
+};
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef JOB_OP_H
+#define JOB_OP_H
+
+#include <stdint.h>
+
+// Pre-decoded job command.
+//
+// The parser on core 0 turns every 0x8xxx BalorCommand into one of these, doing
+// all the unit conversion up front, so the executor on core 1 only has to
+// stream them into the galvo. Opcodes the executor ignores never get queued.
+enum JobOpKind : uint8_t {
+    OP_NOP = 0,
+
+    // Motion: move.x/y = logical position, move.tx/ty = galvo target
+    OP_JUMP,
+    OP_CUT,
+
+    // Parameters: param.value already in the unit the hw_set* hook takes
+    OP_LASER_CTRL,      // value != 0 -> on
+    OP_POWER,           // raw 0..4095
+    OP_FREQUENCY,       // raw period
+    OP_MARK_SPEED,      // galvo steps per tick
+    OP_JUMP_SPEED,      // galvo steps per tick
+    OP_END_DELAY,       // us
+    OP_POLY_DELAY,      // us
+    OP_LASER_ON_DELAY,  // us
+    OP_LASER_OFF_DELAY, // us
+    OP_JUMP_DELAY,      // us, settle after the longest jumps
+
+    OP_END_OF_LIST,
+
+    // Hatch fill: param.raw = outline slot, the executor makes the moves
+    OP_HATCH,
+
+    // Curves: curve.x/y = end, the executor cuts them into pieces
+    OP_ARC,             // curve.ax/ay = centre, JOB_ARC_CCW in flags
+    OP_CUBIC,           // curve.ax/ay, curve.bx/by = control points
+
+    OP_KIND_COUNT
+};
+
+// JobOp.flags of an OP_CUT (or the end of a curve): how much of the polygon
+// delay the joint at its end needs, in quarters (0 = straight on,
+// JOB_CORNER_FULL = reversal or unknown). Filled in by the corner planner on
+// core 0.
+#define JOB_CORNER_MASK  0x07
+#define JOB_CORNER_FULL  4
+#define JOB_ARC_CCW      0x08 // OP_ARC turns from +X towards +Y
+
+struct JobOp {
+    uint8_t kind;       // JobOpKind
+    uint8_t flags;      // JOB_CORNER_* for cuts
+    uint16_t opcode;    // original wire opcode, for logging
+    union {
+        struct {
+            uint16_t x, y;
+            float tx, ty;
+        } move;
+        struct {
+            uint16_t raw;   // original parameter
+            uint16_t pad;
+            float value;
+        } param;
+        struct {
+            uint16_t x, y;  // as move.x/y
+            uint16_t ax, ay;
+            uint16_t bx, by;
+        } curve;
+    };
+};
+
+#endif
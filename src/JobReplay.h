@@ -0,0 +1,141 @@
+#ifndef JOB_REPLAY_H
+#define JOB_REPLAY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Device-side repeats of a job list (0x8023 MARK_COUNT).
+//
+// Every job list is recorded as it is parsed, from its first job record up to
+// 0x8002 End of List. If the list carried a MARK_COUNT of N > 1, the driver
+// feeds the recording back into the job queue N - 1 more times instead of the
+// host sending it again, and holds new job records from the host back until
+// it is done.
+//
+// A list that does not fit in the buffer is not repeated: that pass runs as
+// streamed and lastOverflowed() is set (also in the 0x00F2 report), so the
+// host knows to send the remaining passes itself.
+//
+// Lists are recorded even with repeats disabled, the job cache (JobCache.h)
+// is filled from the last complete one.
+//
+// Core 0 only.
+
+#define JOB_REPLAY_MARK_COUNT  0x8023
+#define JOB_REPLAY_END_OF_LIST 0x8002
+
+// A job record as it went into the job queue, in 6 bytes: the opcode is
+// always on the 0x80 page, and no job opcode uses more than two params. The
+// corner planner's tag is kept with each cut, so a cut fed again needs no
+// look-ahead.
+struct JobRecord {
+    uint8_t code;   // opcode & 0xFF
+    uint8_t flags;  // JobOp.flags it was queued with
+    uint16_t p0, p1;
+
+    bool matches(uint16_t opcode, uint16_t q0, uint16_t q1) const {
+        return opcode == (0x8000 | code) && p0 == q0 && p1 == q1;
+    }
+};
+
+template <size_t Size>
+class JobReplay {
+public:
+    typedef JobRecord Record;
+
+    struct Stats {
+        uint32_t lists = 0;     // lists repeated on the device
+        uint32_t passes = 0;    // passes replayed without the host
+        uint32_t records = 0;   // records replayed
+        uint32_t overflows = 0; // repeated lists too long to record
+    };
+
+    void setEnabled(bool enabled) {
+        _enabled = enabled;
+        _passesLeft = 0;
+    }
+    bool enabled() const { return _enabled; }
+
+    // Job record just parsed from the host. Returns true if it ended a list
+    // that is to be repeated: replaying() is set, parsing has to stop here.
+    bool record(uint16_t opcode, uint16_t p0, uint16_t p1, uint8_t flags) {
+        if (_count < Size) _records[_count++] = {(uint8_t)opcode, flags, p0, p1};
+        else _overflowed = true;
+
+        if (opcode == JOB_REPLAY_MARK_COUNT) _passes = p0;
+        if (opcode != JOB_REPLAY_END_OF_LIST) return false;
+
+        _lastLength = _overflowed ? 0 : _count;
+        bool repeat = _enabled && _passes > 1 && !_overflowed;
+        if (_enabled && _passes > 1) {
+            _lastOverflowed = _overflowed;
+            if (_overflowed) _stats.overflows++;
+        }
+        if (repeat) {
+            _passesLeft = _passes - 1;
+            _length = _count;
+            _pos = 0;
+            _stats.lists++;
+        }
+        _count = 0;
+        _passes = 0;
+        _overflowed = false;
+        return repeat;
+    }
+
+    // The record just passed to record() stands for data the recording does
+    // not keep (a hatch outline): the list is not repeated, nor cached, as if
+    // it were too long
+    void dropList() { _overflowed = true; }
+
+    bool replaying() const { return _passesLeft > 0; }
+    uint16_t passesLeft() const { return _passesLeft; }
+
+    // Next record to queue again, nullptr once the last pass is out
+    const Record* next() {
+        if (_passesLeft == 0) return nullptr;
+        const Record* r = &_records[_pos++];
+        _stats.records++;
+        if (_pos == _length) {
+            _pos = 0;
+            _passesLeft--;
+            _stats.passes++;
+        }
+        return r;
+    }
+
+    // Abort: drop the replay and the list being recorded
+    void cancel() {
+        _passesLeft = 0;
+        _lastLength = 0;
+        _count = 0;
+        _passes = 0;
+        _overflowed = false;
+    }
+
+    // Records of the list being recorded
+    size_t recorded() const { return _count; }
+    // The list that just ended, if it fit: valid until the next record()
+    const Record* lastList() const { return _records; }
+    size_t lastLength() const { return _lastLength; }
+    // The last list with a MARK_COUNT did not fit and ran only once
+    bool lastOverflowed() const { return _lastOverflowed; }
+    const Stats& stats() const { return _stats; }
+
+private:
+    bool _enabled = true;
+    Record _records[Size];
+    size_t _count = 0;         // recording
+    size_t _lastLength = 0;
+    uint16_t _passes = 0;      // MARK_COUNT of the list being recorded
+    bool _overflowed = false;
+    bool _lastOverflowed = false;
+
+    size_t _length = 0;        // replay
+    size_t _pos = 0;
+    uint16_t _passesLeft = 0;
+
+    Stats _stats;
+};
+
+#endif
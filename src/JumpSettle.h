@@ -0,0 +1,99 @@
+#ifndef JUMP_SETTLE_H
+#define JUMP_SETTLE_H
+
+#include <stdint.h>
+
+// Settle time after a jump, by jump length.
+//
+// The mirrors overshoot and ring after a jump, the longer the jump the longer
+// it takes. A single delay for every jump either burns marks at the end of
+// long jumps or wastes time after short hops. The settle time is described
+// by a few (length, share of the jump delay) points, interpolated linearly
+// between them and flat past the last one. The jump delay itself is 0x800D,
+// it is what the longest jumps get.
+//
+// Everything is expanded into a table of galvo ticks per length bucket when
+// the jump delay or the points change, so a jump only costs an approximate
+// length and one lookup.
+
+struct JumpSettlePoint {
+    uint32_t length;    // galvo steps
+    uint16_t permille;  // of the jump delay
+};
+
+// Hops barely ring, full-field jumps need the whole jump delay
+inline constexpr JumpSettlePoint JUMP_SETTLE_DEFAULTS[] = {
+    {0, 100},
+    {1000, 250},
+    {8000, 600},
+    {32000, 1000},
+};
+
+class JumpSettleTable {
+public:
+    static const int MAX_POINTS = 8;
+    static const int BUCKET_SHIFT = 9;   // 512 steps per bucket
+    static const int BUCKETS = 256;      // up to 128k steps, past the field diagonal
+    static const uint32_t TICK_US = 10;
+
+    JumpSettleTable() {
+        setPoints(JUMP_SETTLE_DEFAULTS, sizeof(JUMP_SETTLE_DEFAULTS) / sizeof(JUMP_SETTLE_DEFAULTS[0]));
+    }
+
+    // Points must be sorted by length. Returns false (and keeps the old
+    // ones) if there are none or too many.
+    bool setPoints(const JumpSettlePoint* points, int count) {
+        if (count <= 0 || count > MAX_POINTS) return false;
+        for (int i = 0; i < count; i++) _points[i] = points[i];
+        _count = count;
+        rebuild();
+        return true;
+    }
+
+    // 0x800D, in us
+    void setJumpDelay(uint16_t us) {
+        if (us == _jumpDelayUs) return;
+        _jumpDelayUs = us;
+        rebuild();
+    }
+    uint16_t jumpDelay() const { return _jumpDelayUs; }
+
+    // Settle ticks for a jump of (dx, dy) galvo steps
+    uint16_t ticks(int32_t dx, int32_t dy) const {
+        uint32_t ax = (dx < 0) ? -dx : dx;
+        uint32_t ay = (dy < 0) ? -dy : dy;
+        // max + 3/8 min: within 7% of the true length, no sqrt
+        uint32_t len = (ax > ay) ? ax + (ay * 3 >> 3) : ay + (ax * 3 >> 3);
+        uint32_t bucket = len >> BUCKET_SHIFT;
+        return _ticks[(bucket < BUCKETS) ? bucket : BUCKETS - 1];
+    }
+
+private:
+    JumpSettlePoint _points[MAX_POINTS];
+    int _count = 0;
+    uint16_t _jumpDelayUs = 100;
+    uint16_t _ticks[BUCKETS];
+
+    void rebuild() {
+        for (int b = 0; b < BUCKETS; b++) {
+            // Bucket middle, so rounding errs neither way
+            uint32_t len = ((uint32_t)b << BUCKET_SHIFT) + (1u << (BUCKET_SHIFT - 1));
+            uint32_t permille = interpolate(len);
+            _ticks[b] = (uint16_t)(((uint32_t)_jumpDelayUs * permille / 1000 + TICK_US / 2) / TICK_US);
+        }
+    }
+
+    uint32_t interpolate(uint32_t len) const {
+        if (len <= _points[0].length) return _points[0].permille;
+        for (int i = 1; i < _count; i++) {
+            const JumpSettlePoint& a = _points[i - 1];
+            const JumpSettlePoint& b = _points[i];
+            if (len > b.length) continue;
+            int32_t span = (int32_t)b.permille - a.permille;
+            return a.permille + span * (int32_t)(len - a.length) / (int32_t)(b.length - a.length);
+        }
+        return _points[_count - 1].permille;
+    }
+};
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef LMCV4_CONFIG_H
+#define LMCV4_CONFIG_H
+
+#include <stddef.h>
+
+// Build-time sizing of the driver buffers. Override any of these from the
+// build flags (e.g. -DLMCV4_JOB_QUEUE_SIZE=1024 in platformio.ini) to trade
+// RAM for buffering depth without touching the headers.
+
+// Raw USB bytes waiting to be parsed, power of two
+#ifndef LMCV4_STREAM_BUFFER_SIZE
+#define LMCV4_STREAM_BUFFER_SIZE 16384
+#endif
+
+// Bytes a host may already have sent past READY when the user hits stop
+// (transfers it had queued). The stream buffer keeps this much room beyond a
+// chunk, so a 0x0012 behind them still gets in and is handled out of band
+// instead of waiting for the job queue to drain.
+#ifndef LMCV4_SEND_AHEAD
+#define LMCV4_SEND_AHEAD 12288
+#endif
+
+// Decoded JobOps (16 bytes each) waiting for core 1, power of two
+#ifndef LMCV4_JOB_QUEUE_SIZE
+#define LMCV4_JOB_QUEUE_SIZE 2048
+#endif
+
+// Largest transfer the host sends after one READY, in bytes
+#ifndef LMCV4_CHUNK_SIZE
+#define LMCV4_CHUNK_SIZE 3100
+#endif
+
+// LaserSet entries the galvo queue may reference at once (RP2350Laser)
+#ifndef LMCV4_SETTINGS_POOL_SIZE
+#define LMCV4_SETTINGS_POOL_SIZE 256
+#endif
+
+// Job records the corner planner looks past a cut for the next move
+#ifndef LMCV4_CORNER_LOOKAHEAD
+#define LMCV4_CORNER_LOOKAHEAD 8
+#endif
+
+// Job ops queued for core 1 above which a cut at the very end of the received
+// data waits for the next record, so its corner can be planned
+#ifndef LMCV4_CORNER_HOLD_QUEUED
+#define LMCV4_CORNER_HOLD_QUEUED 64
+#endif
+
+// Job records a MARK_COUNT list may have to be repeated on the device,
+// 6 bytes each (JobReplay.h). Longer lists are streamed once per pass.
+#ifndef LMCV4_REPLAY_RECORDS
+#define LMCV4_REPLAY_RECORDS 8192
+#endif
+
+// Job cache (JobCache.h): records kept over all cached lists (6 bytes
+// each), lists kept, and how many records of a list make up its key
+#ifndef LMCV4_JOB_CACHE_RECORDS
+#define LMCV4_JOB_CACHE_RECORDS 16384
+#endif
+#ifndef LMCV4_JOB_CACHE_ENTRIES
+#define LMCV4_JOB_CACHE_ENTRIES 8
+#endif
+#ifndef LMCV4_JOB_CACHE_KEY_RECORDS
+#define LMCV4_JOB_CACHE_KEY_RECORDS 32
+#endif
+
+// Hatch fill outlines (HatchFill.h) queued for core 1 at once, ~1 KB each,
+// and how many moves of a fill the executor makes per run() pass
+#ifndef LMCV4_HATCH_SLOTS
+#define LMCV4_HATCH_SLOTS 2
+#endif
+#ifndef LMCV4_HATCH_MOVES_PER_RUN
+#define LMCV4_HATCH_MOVES_PER_RUN 16
+#endif
+
+// Pieces of an arc or cubic (CurveFlatten.h) the executor makes per run() pass
+#ifndef LMCV4_CURVE_PIECES_PER_RUN
+#define LMCV4_CURVE_PIECES_PER_RUN 16
+#endif
+
+// wMaxPacketSize of the bulk endpoints, 64 is the most full speed allows. The
+// vendor RX FIFO (CFG_TUD_VENDOR_RX_BUFSIZE, include/tusb_config.h) only has
+// to hold two: the RX callback empties it into the stream buffer as packets
+// arrive, one waits there while the next is on the wire.
+#ifndef LMCV4_USB_PACKET_SIZE
+#define LMCV4_USB_PACKET_SIZE 64
+#endif
+
+struct LMCV4Config {
+    static constexpr size_t STREAM_BUFFER_SIZE = LMCV4_STREAM_BUFFER_SIZE;
+    static constexpr size_t JOB_QUEUE_SIZE = LMCV4_JOB_QUEUE_SIZE;
+    static constexpr size_t CHUNK_SIZE = LMCV4_CHUNK_SIZE;
+    static constexpr size_t SEND_AHEAD = LMCV4_SEND_AHEAD;
+    static constexpr size_t SETTINGS_POOL_SIZE = LMCV4_SETTINGS_POOL_SIZE;
+    static constexpr size_t CORNER_LOOKAHEAD = LMCV4_CORNER_LOOKAHEAD;
+    static constexpr size_t CORNER_HOLD_QUEUED = LMCV4_CORNER_HOLD_QUEUED;
+    static constexpr size_t REPLAY_RECORDS = LMCV4_REPLAY_RECORDS;
+    static constexpr size_t JOB_CACHE_RECORDS = LMCV4_JOB_CACHE_RECORDS;
+    static constexpr size_t JOB_CACHE_ENTRIES = LMCV4_JOB_CACHE_ENTRIES;
+    static constexpr size_t JOB_CACHE_KEY_RECORDS = LMCV4_JOB_CACHE_KEY_RECORDS;
+    static constexpr size_t HATCH_SLOTS = LMCV4_HATCH_SLOTS;
+    static constexpr size_t HATCH_MOVES_PER_RUN = LMCV4_HATCH_MOVES_PER_RUN;
+    static constexpr size_t CURVE_PIECES_PER_RUN = LMCV4_CURVE_PIECES_PER_RUN;
+    static constexpr size_t USB_PACKET_SIZE = LMCV4_USB_PACKET_SIZE;
+
+    static_assert(CHUNK_SIZE + SEND_AHEAD + 24 <= STREAM_BUFFER_SIZE,
+                  "a whole chunk, what was sent ahead and the abort behind it have to fit in the stream buffer");
+    static_assert(2 * (CHUNK_SIZE / 12) < JOB_QUEUE_SIZE, "the job queue has to hold two chunks");
+    static_assert(JOB_CACHE_KEY_RECORDS > 0, "a cached list needs a key");
+    static_assert(HATCH_SLOTS > 0 && HATCH_MOVES_PER_RUN > 0, "a hatch fill needs a slot and a move per pass");
+    static_assert(CURVE_PIECES_PER_RUN > 0, "a curve needs a piece per pass");
+    static_assert(USB_PACKET_SIZE == 8 || USB_PACKET_SIZE == 16 || USB_PACKET_SIZE == 32 || USB_PACKET_SIZE == 64,
+                  "full speed bulk packets are 8, 16, 32 or 64 bytes");
+};
+
+#endif
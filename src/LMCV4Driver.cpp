@@ -1,4 +1,37 @@
 #include "LMCV4Driver.h"
+#include <EEPROM.h>
+#include <type_traits>
+
+#ifdef CFG_TUD_VENDOR_RX_BUFSIZE
+static_assert(CFG_TUD_VENDOR_RX_BUFSIZE >= 2 * LMCV4Config::USB_PACKET_SIZE,
+              "the vendor RX FIFO has to hold a packet while the next one arrives");
+#endif
+
+// Where the USB interrupt can land in the middle of an update() pass. Nothing
+// here on the device, the interrupt comes whenever it comes; the host build
+// brings the simulated link in at these points (sim/SimUsb.h).
+#ifndef LMCV4_USB_IRQ_POINT
+#define LMCV4_USB_IRQ_POINT()
+#endif
+
+// The driver TinyUSB's RX callback goes to
+static LMCV4Driver* rxDriver = nullptr;
+
+// Older TinyUSB declares tud_vendor_rx_cb(uint8_t itf). The definition below
+// would then build as an overload nothing calls and reception would stall, so
+// insist on the signature the stack actually calls.
+static_assert(std::is_same<decltype(&tud_vendor_rx_cb), void (*)(uint8_t, uint8_t const*, uint16_t)>::value,
+              "TinyUSB with tud_vendor_rx_cb(itf, buffer, bufsize) needed, update the core");
+
+// TinyUSB's vendor RX callback, called from tud_task() once a packet is in the
+// RX FIFO. The RP2040/RP2350 port runs tud_task() from a low priority
+// interrupt on core 0, so this lands anywhere in an update() pass.
+void tud_vendor_rx_cb(uint8_t itf, uint8_t const* buffer, uint16_t bufsize) {
+    (void)itf;
+    (void)buffer;
+    (void)bufsize;
+    if (rxDriver) rxDriver->onUsbReceive();
+}
 
 // Constructor
 LMCV4Driver::LMCV4Driver() {
@@ -6,6 +39,28 @@ LMCV4Driver::LMCV4Driver() {
     state.y = 0x8000;
     _ep_out = 0;
     _ep_in = 0;
+
+    // READY drops while the stream buffer still has room for a chunk, what a
+    // host sent ahead of that and a 0x0012 behind it
+    const uint16_t chunkCommands = LMCV4Config::CHUNK_SIZE / CMD_SIZE;
+    const uint16_t streamHigh =
+        (_usbStreamBuffer.capacity() - LMCV4Config::CHUNK_SIZE - LMCV4Config::SEND_AHEAD) / CMD_SIZE - 1;
+    _flow.setWatermarks(FLOW_STREAM, streamHigh, streamHigh / 2);
+    _flow.setWatermarks(FLOW_JOB, _jobQueue.capacity() - 2 * chunkCommands, _jobQueue.capacity() / 2);
+    _flow.setWatermarks(FLOW_GALVO, 0xFFFF, 0xFFFF);
+
+    // Fixed parts of the cached reports (magic bytes seen in python blobs),
+    // byte 6 is the status byte and gets patched in by refreshStatus()
+    //00 00 12 c0 09 00 xx 02
+    static const uint8_t pollReport[REPORT_SIZE] = {0x00, 0x00, 0x12, 0xc0, 0x09, 0x00, 0x00, 0x02};
+    //00 00 21 84 09 00 xx 02
+    static const uint8_t versionReport[REPORT_SIZE] = {0x00, 0x00, 0x21, 0x84, 0x09, 0x00, 0x00, 0x02};
+    memcpy(_pollReport, pollReport, REPORT_SIZE);
+    memcpy(_versionReport, versionReport, REPORT_SIZE);
+    memset(_positionReport, 0, REPORT_SIZE);
+    memset(_inputsReport, 0, REPORT_SIZE);
+    _positionReport[1] = 0x80; // 0x8000, 0x8000
+    _positionReport[3] = 0x80;
 }
 
 void LMCV4Driver::begin(XY2Galvo* galvo, LaserQueue* queue) {
@@ -18,6 +73,10 @@ void LMCV4Driver::begin(XY2Galvo* galvo, LaserQueue* queue) {
 
     _itfnum = TinyUSBDevice.allocInterface(1);
     TinyUSBDevice.addInterface(*this);
+    rxDriver = this;
+    _rxDeferred = true; // whatever came before is in the FIFO with no callback to come
+
+    loadSavedLens();
 }
 
 uint16_t LMCV4Driver::getInterfaceDescriptor(uint8_t itfnum_deprecated, uint8_t *buf, uint16_t bufsize) {
@@ -29,7 +88,7 @@ uint16_t LMCV4Driver::getInterfaceDescriptor(uint8_t itfnum_deprecated, uint8_t
     }
     
     // Standard Interface Descriptor + 2 Endpoint Descriptors
-    uint8_t const desc[] = { TUD_VENDOR_DESCRIPTOR(_itfnum, _strid, _ep_out, _ep_in, 64) };
+    uint8_t const desc[] = { TUD_VENDOR_DESCRIPTOR(_itfnum, _strid, _ep_out, _ep_in, LMCV4Config::USB_PACKET_SIZE) };
     uint16_t len = sizeof(desc);
     
     if (bufsize < len) return 0;
@@ -42,51 +101,71 @@ uint16_t LMCV4Driver::getInterfaceDescriptor(uint8_t itfnum_deprecated, uint8_t
 // --------------------------------------------------------------------------
 
 void LMCV4Driver::update() {
+    PROFILE_SCOPE(_profiler, PROF_UPDATE);
+
+    // The executor has moved on since the last pass
+    _statusFresh = false;
+
     // 1. Read Raw USB Data
-    if (tud_vendor_n_available(_itfnum) > 0) {
-        uint32_t count = tud_vendor_n_read(_itfnum, _rx_buf_temp, sizeof(_rx_buf_temp));
-        
-        // Push into Ring Buffer to handle fragmented packets
-        for(uint32_t i=0; i<count; i++) {
-            if(!_usbStreamBuffer.push(_rx_buf_temp[i])) {
-                if(_debugStream) _debugStream->println("ERR: USB RX Overflow");
-                break; 
-            }
-        }
-    }
+    // The RX callback has already moved it into the stream buffer, unless it
+    // had to leave some in the FIFO. With the callback off, poll.
+    receiveDeferred();
 
     // 2. Process Stream into Commands
     processIncomingStream();
+
+    // Parsing made room for whatever the callback could not fit, don't leave
+    // the host NAKed until the next pass
+    if (_rxCallback) receiveDeferred();
+
+    // 3. Answer every system command of this pass in one go
+    flushReplies();
 }
 
-void LMCV4Driver::run() {
-    // Executes commands from the Job Queue physically
-    // This simulates the "Machine" consuming the buffer
-    
-    if (!_jobQueue.isEmpty()) {
-        //state.is_running = true; // We are processing data
-        
-        // TODO: Here you would normally check if the stepper/galvo driver is BUSY.
-        // For now, we assume instantaneous execution for logic checking.
-        // In a real machine, you would check: if(galvo.isMoving()) return;
-        if(_queue->free() > 1)
-        {
-        BalorCommand cmd;
-        _jobQueue.pop(cmd);
-        
-        if(_debug) log("EXE", cmd);
-        executeCommand(cmd);
-        }
-        else return;
-    } 
-    if(_jobQueue.isEmpty()){
-        // Queue is empty
-        // Keep is_running TRUE if we are physically moving (check hardware).
-        // For this template, if queue is empty, we are idle.
-        //state.is_running = false;
+void LMCV4Driver::onUsbReceive() {
+    if (!_rxCallback) return;
+    _rxStats.callbacks++;
+    if (_rxBusy) {
+        _rxDeferred = true;
+        _rxStats.deferred++;
+        return;
+    }
+    receive();
+}
+
+// update()'s share: what the callback had to leave in the FIFO, or everything
+// with the callback off
+void LMCV4Driver::receiveDeferred() {
+    if (_rxCallback && !_rxDeferred.exchange(false)) return;
+    _rxBusy = true;
+    receive();
+    _rxBusy = false;
+}
+
+// Reads the RX FIFO straight into the free window of the ring, so there is no
+// temp copy and no per-byte push. At most two reads: up to the wrap, then from
+// the start. Anything that does not fit stays in the FIFO for the next
+// update(): with the FIFO full the endpoint is not rearmed, so no callback
+// comes for it.
+void LMCV4Driver::receive() {
+    for (int pass = 0; pass < 2; pass++) {
+        uint32_t pending = tud_vendor_n_available(_vendorItf);
+        if (pending == 0) return;
+
+        uint8_t* window;
+        size_t room = _usbStreamBuffer.reserve_contiguous(window);
+        if (room == 0) break;
+
+        uint32_t count = tud_vendor_n_read(_vendorItf, window, (pending < room) ? pending : room);
+        _usbStreamBuffer.commit(count);
+        _oobUnscanned += count;
+        _rxStats.bytes += count;
+        if (count < room) return;
+    }
+    if (_rxCallback && tud_vendor_n_available(_vendorItf)) {
+        _rxDeferred = true;
+        _rxStats.full++;
     }
-    //if(_queue->avail()) state.is_running = true;
-   // else  state.is_running = false;
 }
 
 // --------------------------------------------------------------------------
@@ -94,276 +173,1218 @@ void LMCV4Driver::run() {
 // --------------------------------------------------------------------------
 
 void LMCV4Driver::processIncomingStream() {
+    PROFILE_SCOPE(_profiler, PROF_PARSE);
+
+    // A MARK_COUNT repeat goes before anything new from the host, a cached
+    // list may run ahead of it
+    pumpReplay();
+    pumpCache();
+
+    // Blocked on a job record: don't let the system commands behind it wait
+    // for the galvo to drain. The scan takes records back off the write end.
+    if (!parseStream()) {
+        _rxBusy = true;
+        scanOutOfBand();
+        _rxBusy = false;
+    }
+}
+
+// Parses records off the front of the stream buffer in order.
+// Returns false if it stopped at a job record that cannot be queued yet.
+bool LMCV4Driver::parseStream() {
     // We need at least 12 bytes for a valid command
     while (_usbStreamBuffer.available() >= CMD_SIZE) {
-        
-        // Peek the command first to decide logic
-        uint8_t rawBytes[CMD_SIZE];
-        for(int i=0; i<CMD_SIZE; i++) {
-            _usbStreamBuffer.peekAt(i, rawBytes[i]);
+        const uint8_t* window;
+        size_t len = _usbStreamBuffer.peek_contiguous(window);
+        LMCV4_USB_IRQ_POINT();
+
+        if (len < CMD_SIZE) {
+            // Slow path: one record split across the wrap boundary
+            BalorCommand cmd;
+            for (int i = 0; i < CMD_SIZE; i++) {
+                _usbStreamBuffer.peekAt(i, ((uint8_t*)&cmd)[i]);
+            }
+            if (cmd.opcode == LMC_OPCODE_HANDLED) {
+                _usbStreamBuffer.consume(CMD_SIZE);
+                continue;
+            }
+            if (payloadRecord(cmd.opcode)) {
+                PayloadResult r = parsePayload(cmd);
+                if (r == PAYLOAD_WAIT) return true;
+                if (r == PAYLOAD_BLOCKED) return false;
+                continue;
+            }
+            if (!dispatchRecord(cmd)) return false;
+            continue;
         }
 
-        BalorCommand* cmd = (BalorCommand*)rawBytes;
+        // Fast path: parse whole records in place
+        const BalorCommand* cmds = (const BalorCommand*)window;
+        size_t records = len / CMD_SIZE;
+        size_t i = 0;
 
-        if (cmd->opcode < 0x8000) {
-            // --- SYSTEM COMMAND (0x00xx) ---
-            // Consume immediately from buffer
-            BalorCommand sysCmd;
-            for(int i=0; i<CMD_SIZE; i++) { 
-                uint8_t b; _usbStreamBuffer.pop(b); 
-                ((uint8_t*)&sysCmd)[i] = b; 
-            }
-            
-            if((_debug) && (cmd->opcode != 0x07) && (cmd->opcode != 0x25)&& (cmd->opcode != 0x10)) log("SYS", sysCmd);
-            handleSystemCommand(sysCmd);
-        
-        } else {
-            // --- JOB COMMAND (0x8xxx) ---
-            // Only consume if we have space in the Job Queue
-            if (!_jobQueue.isFull()) {
-                BalorCommand jobCmd;
-                for(int i=0; i<CMD_SIZE; i++) { 
-                    uint8_t b; _usbStreamBuffer.pop(b); 
-                    ((uint8_t*)&jobCmd)[i] = b; 
+        while (i < records && cmds[i].opcode >= 0x8000 && !payloadRecord(cmds[i].opcode)) i++;
+
+        // A cut (or arc) that is the last thing received has no corner to
+        // plan yet. While the galvo has plenty queued, leave it for the next
+        // pass, the rest of the path is usually already on its way.
+        if (_cornerPlanner && i == records && len == _usbStreamBuffer.available() &&
+            (cmds[i - 1].opcode == 0x8005 || cmds[i - 1].opcode == LMC_OPCODE_ARC) &&
+            _jobQueue.available() >= LMCV4Config::CORNER_HOLD_QUEUED) {
+            if (--i == 0) return true;
+        }
+
+        if (i > 0) {
+            // --- JOB COMMANDS (0x8xxx) ---
+            // Held back while core 1 is still flushing for an abort, or while
+            // the previous list is being repeated
+            if (abortPending() || _replay.replaying()) return false;
+
+            // Decode the whole run straight into free job queue slots
+            size_t done = 0;
+            while (done < i) {
+                JobOp* slots;
+                size_t room = _jobQueue.reserve_contiguous(slots);
+                if (room == 0) break;
+                size_t n = (room < i - done) ? room : i - done;
+                size_t out = 0;
+                for (size_t k = 0; k < n; k++) {
+                    const BalorCommand& cmd = cmds[done + k];
+                    // Handled out of band already, and never part of the
+                    // list: not counted, cached or recorded for a repeat
+                    if (cmd.opcode == LMC_OPCODE_HANDLED) continue;
+                    recordParsed(FR_PARSED, cmd);
+                    uint8_t accepted = acceptJobRecord(cmd, slots[out], cmds + done + k + 1, records - done - k - 1);
+                    if (accepted & ACCEPT_QUEUED) out++;
+                    // End of a list to repeat, or a job stopped: the rest waits
+                    if (accepted & ACCEPT_STOP) n = k + 1;
                 }
-                
-                // Push to execution queue
-                _jobQueue.push(jobCmd);
-            } else {
-                // Queue full! Stop processing stream. 
+                _jobQueue.commit(out);
+                done += n;
+                _statusFresh = false;
+                if (_replay.replaying() || abortPending()) break;
+            }
+            _usbStreamBuffer.consume(done * CMD_SIZE);
+            if (done < i) {
+                // Queue full! Stop processing stream.
                 // This leaves data in _usbStreamBuffer.
                 // The system status report will tell Host we are not ready.
-                return; 
+                return false;
             }
+        } else if (payloadRecord(cmds[0].opcode)) {
+            // --- BULK VECTORS / RASTER ROWS (vendor) ---
+            PayloadResult r = parsePayload(cmds[0]);
+            if (r == PAYLOAD_WAIT) return true;
+            if (r == PAYLOAD_BLOCKED) return false;
+        } else {
+            // --- SYSTEM COMMAND (0x00xx) ---
+            // Take a copy first, handling it may clear the stream buffer
+            if (!dispatchRecord(cmds[0])) return false;
         }
     }
+    return true;
 }
 
-void LMCV4Driver::handleSystemCommand(const BalorCommand& cmd) {
-    uint8_t report[REPORT_SIZE] = {0};
+// Whole size of a bulk, raster or hatch record from its header, 0 if the
+// header is bad and there is no telling where the record ends
+size_t LMCV4Driver::payloadRecordBytes(const BalorCommand& header) const {
+    if (header.opcode == LMC_OPCODE_BULK_VECTORS)
+        return (header.params[0] <= BULK_MAX_PAYLOAD) ? bulkRecordBytes(header.params[0]) : 0;
+    if (header.opcode == LMC_OPCODE_HATCH_FILL) return hatchRecordBytes(header.params[0], header.params[1]);
+    if (rasterPayloadBytes(header.params[2], header.params[4]) > RASTER_MAX_PAYLOAD) return 0;
+    return rasterRecordBytes(header.params[2], header.params[4]);
+}
 
-    // 1. Gather Hardware State
-    uint16_t live_x, live_y;
-    hw_getPos(live_x, live_y, _galvo);
-    
-    uint16_t inputs = state.port_val;
-    // Simulate Laser Bit in port for ReadPort command
-    if (state.laser_on) inputs |= 0x100; 
-    else inputs &= ~0x100;
+LMCV4Driver::PayloadResult LMCV4Driver::parsePayload(const BalorCommand& header) {
+    if (header.opcode == LMC_OPCODE_BULK_VECTORS) return parseBulk(header);
+    if (header.opcode == LMC_OPCODE_HATCH_FILL) return parseHatch(header);
+    return parseRaster(header);
+}
 
-    // 2. Determine Status Byte (Byte 6)
-    // This is the most critical part for Lightburn/Python driver connection
-    uint8_t status = 0;
-    
-    // READY BIT (0x20): High if we have room in the buffer
-    // Lightburn waits for this before sending the next chunk
-    if (!_jobQueue.isFull() && (_queue->free() > 256) && _usbStreamBuffer.available() < (sizeof(_usbStreamBuffer)-CHUNK_SIZE)) {
-        status |= LMC_STATUS_READY;
-        state.is_ready = true;
-    } else {
-        state.is_ready = false;
+// Expands a bulk vector record at the front of the stream into plain jump
+// and cut records, which then go the same way as ones from the host. Only
+// taken once the whole record is in and the job queue has room for all of it.
+LMCV4Driver::PayloadResult LMCV4Driver::parseBulk(const BalorCommand& header) {
+    size_t payload = header.params[0];
+    size_t count = header.params[1];
+    if (payload > BULK_MAX_PAYLOAD || count > BULK_MAX_VECTORS) {
+        // No telling where it ends, drop the header and resync on what follows
+        _bulkStats.malformed++;
+        _usbStreamBuffer.consume(CMD_SIZE);
+        return PAYLOAD_DONE;
     }
+    size_t total = bulkRecordBytes(payload);
+    if (_usbStreamBuffer.available() < total) return PAYLOAD_WAIT;
+    if (abortPending() || _replay.replaying() || _jobQueue.space() < count) return PAYLOAD_BLOCKED;
 
-    if(_queue->avail()) state.is_running = true;
-    else state.is_running = false;
-    // RUNNING BIT (0x04): High if we are working
-    if (state.is_running) {
-        status |= LMC_STATUS_RUNNING;
+    uint8_t bytes[BULK_MAX_PAYLOAD];
+    for (size_t i = 0; i < payload; i++) _usbStreamBuffer.peekAt(CMD_SIZE + i, bytes[i]);
+
+    BulkVector vectors[BULK_MAX_VECTORS];
+    uint16_t x = _planX, y = _planY;
+    if (!bulkDecode(bytes, payload, count, x, y, vectors)) {
+        _bulkStats.malformed++;
+        _usbStreamBuffer.consume(total);
+        return PAYLOAD_DONE;
     }
 
-    // 3. Prepare Specific Responses
-    switch (cmd.opcode) {
-        case 0x000C: // Get Position
-            report[0] = live_x & 0xFF;
-            report[1] = live_x >> 8;
-            report[2] = live_y & 0xFF;
-            report[3] = live_y >> 8;
-            break;
+    BalorCommand cmds[BULK_MAX_VECTORS];
+    for (size_t i = 0; i < count; i++) {
+        cmds[i] = {(uint16_t)(vectors[i].cut ? 0x8005 : 0x8001), {vectors[i].y, vectors[i].x, 0, 0, 0}};
+    }
+    for (size_t i = 0; i < count; i++) {
+        recordParsed(FR_PARSED, cmds[i]);
+        JobOp op;
+        if (acceptJobRecord(cmds[i], op, cmds + i + 1, count - i - 1) & ACCEPT_QUEUED) _jobQueue.push(op);
+    }
+    _usbStreamBuffer.consume(total);
+    _statusFresh = false;
+
+    _bulkStats.records++;
+    _bulkStats.vectors += count;
+    _bulkStats.bytes += total;
+    return PAYLOAD_DONE;
+}
+
+// Turns a raster row into jump, cut and power records, a run of pixels at a
+// time (see RasterRows.h)
+struct RasterExpander {
+    RasterRuns runs;
+    bool eightBit, vertical;
+    int32_t start, pitch, shift; // along the scan, in steps
+    uint16_t across;             // the other coordinate
+    uint16_t power;              // the host's, 8-bit runs get a share of it
+    uint16_t lastPower;
+    int32_t at = -1;             // where the last cut ended, along the scan
+    bool done = false;
+
+    // (x, y): where the last move ended, a row carried on in the next record
+    // needs no jump to where the last one stopped
+    RasterExpander(const BalorCommand& header, const uint8_t* payload, int32_t lag, uint16_t hostPower, uint16_t x, uint16_t y)
+        : runs(payload, header.params[2], header.params[4]) {
+        eightBit = header.params[4] & RASTER_8BIT;
+        vertical = header.params[4] & RASTER_VERTICAL;
+        start = vertical ? header.params[1] : header.params[0];
+        across = vertical ? header.params[0] : header.params[1];
+        pitch = (int16_t)header.params[3];
+        shift = (pitch < 0) ? -lag : lag;
+        power = lastPower = hostPower;
+        if ((vertical ? x : y) == across) at = vertical ? y : x;
+    }
+
+    // Records for the next run, at most 3, or the power set back after the
+    // last one. Sets done once there is nothing more.
+    size_t next(BalorCommand* out) {
+        size_t first, end;
+        uint8_t value;
+        size_t n = 0;
+        if (!runs.next(first, end, value)) {
+            if (lastPower != power) out[n++] = {0x8012, {power, 0, 0, 0, 0}};
+            done = true;
+            return n;
+        }
+        int32_t from = along(first), to = along(end);
+        if (from != at) out[n++] = move(0x8001, from);
+        if (eightBit) {
+            uint16_t p = (uint16_t)((uint32_t)power * value / 255);
+            if (p != lastPower) out[n++] = {0x8012, {p, 0, 0, 0, 0}};
+            lastPower = p;
+        }
+        out[n++] = move(0x8005, to);
+        at = to;
+        return n;
+    }
+
+    int32_t along(size_t pixel) const {
+        int32_t v = start + (int32_t)pixel * pitch - shift;
+        return (v < 0) ? 0 : (v > 0xFFFF) ? 0xFFFF : v;
+    }
+    BalorCommand move(uint16_t opcode, int32_t v) const {
+        uint16_t x = vertical ? across : (uint16_t)v;
+        uint16_t y = vertical ? (uint16_t)v : across;
+        return {opcode, {y, x, 0, 0, 0}};
+    }
+};
+
+// Expands a raster row at the front of the stream into jump, cut and power
+// records, which then go the same way as ones from the host. Only taken once
+// the whole record is in and the job queue has room for everything it makes.
+// The records are made in batches, with enough of the next batch made ahead
+// for the corner planner to look into.
+LMCV4Driver::PayloadResult LMCV4Driver::parseRaster(const BalorCommand& header) {
+    size_t total = payloadRecordBytes(header);
+    if (!total) {
+        // No telling where it ends, drop the header and resync on what follows
+        _rasterStats.malformed++;
+        _usbStreamBuffer.consume(CMD_SIZE);
+        return PAYLOAD_DONE;
+    }
+    if (_usbStreamBuffer.available() < total) return PAYLOAD_WAIT;
+
+    size_t pixels = header.params[2];
+    int32_t pitch = (int16_t)header.params[3];
+    int32_t start = (header.params[4] & RASTER_VERTICAL) ? header.params[1] : header.params[0];
+    int32_t end = start + (int32_t)pixels * pitch;
+    if (pitch == 0 || end < 0 || end > 0xFFFF) {
+        _rasterStats.malformed++;
+        _usbStreamBuffer.consume(total);
+        return PAYLOAD_DONE;
+    }
+    if (abortPending() || _replay.replaying()) return PAYLOAD_BLOCKED;
+
+    uint8_t bytes[RASTER_MAX_PAYLOAD];
+    size_t payload = rasterPayloadBytes(pixels, header.params[4]);
+    for (size_t i = 0; i < payload; i++) _usbStreamBuffer.peekAt(CMD_SIZE + i, bytes[i]);
+
+    // Mirrors trail by the lag at mark speed (steps per 10 us tick)
+    int32_t lag = (int32_t)(_rasterLagUs * _planMarkSpeed / 10.0f + 0.5f);
 
-        case 0x0009: // Read Input Port
-            report[0] = inputs & 0xFF;
-            report[1] = inputs >> 8;
+    // Only count the runs when the queue could be too full for the worst case
+    size_t worst = (header.params[4] & RASTER_8BIT) ? 3 * pixels + 1 : pixels + 1;
+    if (_jobQueue.space() < worst) {
+        RasterExpander counter(header, bytes, lag, _planPower, _planX, _planY);
+        BalorCommand scratch[3];
+        size_t records = 0;
+        while (!counter.done) records += counter.next(scratch);
+        if (records > _jobQueue.capacity()) {
+            _rasterStats.malformed++;
+            _usbStreamBuffer.consume(total);
+            return PAYLOAD_DONE;
+        }
+        if (_jobQueue.space() < records) return PAYLOAD_BLOCKED;
+    }
+
+    static const size_t BATCH = 32;
+    const size_t lookahead = LMCV4Config::CORNER_LOOKAHEAD;
+    BalorCommand window[BATCH + LMCV4Config::CORNER_LOOKAHEAD + 3];
+    RasterExpander row(header, bytes, lag, _planPower, _planX, _planY);
+    size_t have = 0;
+    uint32_t made = 0;
+    while (!row.done || have) {
+        while (!row.done && have < BATCH + lookahead) have += row.next(window + have);
+        size_t n = row.done ? have : have - lookahead;
+        for (size_t i = 0; i < n; i++) {
+            recordParsed(FR_PARSED, window[i]);
+            JobOp op;
+            if (acceptJobRecord(window[i], op, window + i + 1, have - i - 1) & ACCEPT_QUEUED) _jobQueue.push(op);
+        }
+        memmove(window, window + n, (have - n) * sizeof(BalorCommand));
+        have -= n;
+        made += n;
+    }
+    _usbStreamBuffer.consume(total);
+    _statusFresh = false;
+
+    _rasterStats.rows++;
+    _rasterStats.pixels += pixels;
+    _rasterStats.records += made;
+    _rasterStats.bytes += total;
+    return PAYLOAD_DONE;
+}
+
+// Takes a hatch fill record at the front of the stream: the outline goes into
+// the next free slot and a single OP_HATCH into the job queue, core 1 makes
+// the lines as the LaserQueue takes them. Only taken once the whole record is
+// in and there is a free slot.
+LMCV4Driver::PayloadResult LMCV4Driver::parseHatch(const BalorCommand& header) {
+    size_t total = payloadRecordBytes(header);
+    if (!total) {
+        // No telling where it ends, drop the header and resync on what follows
+        _hatchStats.malformed++;
+        _usbStreamBuffer.consume(CMD_SIZE);
+        return PAYLOAD_DONE;
+    }
+    if (_usbStreamBuffer.available() < total) return PAYLOAD_WAIT;
+    if (abortPending() || _replay.replaying() || _jobQueue.isFull() || !hatchSlotFree()) return PAYLOAD_BLOCKED;
+
+    uint8_t bytes[HATCH_MAX_PAYLOAD];
+    size_t payload = hatchPayloadBytes(header.params[0], header.params[1]);
+    for (size_t i = 0; i < payload; i++) _usbStreamBuffer.peekAt(CMD_SIZE + i, bytes[i]);
+
+    uint32_t queued = _hatchQueued.load(std::memory_order_relaxed);
+    HatchOutline& outline = _hatchSlots[queued % LMCV4Config::HATCH_SLOTS];
+    const uint16_t params[5] = {header.params[0], header.params[1], header.params[2], header.params[3], header.params[4]};
+    if (!hatchDecode(params, bytes, outline)) {
+        _hatchStats.malformed++;
+        _usbStreamBuffer.consume(total);
+        return PAYLOAD_DONE;
+    }
+
+    recordParsed(FR_PARSED, header);
+    JobOp op;
+    _hatchStaged = true;
+    uint8_t accepted = acceptJobRecord(header, op, nullptr, 0);
+    _hatchStaged = false;
+    if (accepted & ACCEPT_QUEUED) {
+        // The slot is core 1's from here, it is written before the op is seen
+        _hatchQueued.store(queued + 1, std::memory_order_relaxed);
+        _jobQueue.push(op);
+        // Where the fill leaves the head
+        _planX = outline.x[0];
+        _planY = outline.y[0];
+        _hatchStats.records++;
+        _hatchStats.vertices += outline.vertices;
+    }
+    _usbStreamBuffer.consume(total);
+    _statusFresh = false;
+    _hatchStats.bytes += total;
+    return PAYLOAD_DONE;
+}
+
+// Handles system commands queued behind a blocked job record right away and
+// overwrites them in place with LMC_OPCODE_HANDLED, or drops them if nothing
+// came after them yet. Job records are never
+// touched, so their order is kept. Only records that arrived since the last
+// scan are looked at.
+void LMCV4Driver::scanOutOfBand() {
+    size_t available = _usbStreamBuffer.available();
+    if (_oobUnscanned > available) {
+        // The parser got there first, along with any payload left to skip
+        size_t eaten = _oobUnscanned - available;
+        _oobSkip -= (eaten < _oobSkip) ? eaten : _oobSkip;
+        _oobUnscanned = available;
+    }
+
+    size_t offset = available - _oobUnscanned;
+    LMCV4_USB_IRQ_POINT();
+    while (offset + CMD_SIZE <= available) {
+        // Bulk, raster and hatch payload is not made of records, don't look inside
+        if (_oobSkip) {
+            size_t n = (available - offset < _oobSkip) ? available - offset : _oobSkip;
+            offset += n;
+            _oobUnscanned -= n;
+            _oobSkip -= n;
+            continue;
+        }
+
+        BalorCommand cmd;
+        for (int i = 0; i < CMD_SIZE; i++) {
+            _usbStreamBuffer.peekAt(offset + i, ((uint8_t*)&cmd)[i]);
+        }
+        offset += CMD_SIZE;
+        _oobUnscanned -= CMD_SIZE;
+        if (payloadRecord(cmd.opcode)) {
+            size_t bytes = payloadRecordBytes(cmd);
+            if (bytes) _oobSkip = bytes - CMD_SIZE;
+            continue;
+        }
+        if (cmd.opcode >= 0x8000) continue;
+
+        static const uint8_t handled[2] = {LMC_OPCODE_HANDLED & 0xFF, LMC_OPCODE_HANDLED >> 8};
+        _usbStreamBuffer.pokeAt(offset - CMD_SIZE, handled[0]);
+        _usbStreamBuffer.pokeAt(offset - CMD_SIZE + 1, handled[1]);
+
+        _oobHandled++;
+        recordParsed(FR_SYSTEM, cmd);
+        if((_debug) && (cmd.opcode != 0x07) && (cmd.opcode != 0x25)&& (cmd.opcode != 0x10)) log("OOB", cmd);
+        handleSystemCommand(cmd);
+
+        // An abort drops the whole stream, nothing left to scan
+        if (lmcv4Opcode(cmd.opcode).handler == SYS_ABORT) {
+            _oobUnscanned = 0;
+            _oobSkip = 0;
+            return;
+        }
+
+        LMCV4_USB_IRQ_POINT();
+
+        // The last thing received: take it back out. A job record can block
+        // for as long as a hatch fill or a MARK_COUNT repeat takes, and the
+        // polls meanwhile would fill the buffer and keep an abort out.
+        if (offset == available) {
+            _usbStreamBuffer.uncommit(CMD_SIZE);
+            available -= CMD_SIZE;
+            offset -= CMD_SIZE;
+        }
+    }
+}
+
+// Consumes a single record from the front of the stream buffer.
+// Returns false (and leaves it there) if it is a job command and the job queue is full.
+bool LMCV4Driver::dispatchRecord(const BalorCommand& record) {
+    BalorCommand cmd = record;
+
+    if (cmd.opcode < 0x8000) {
+        // --- SYSTEM COMMAND (0x00xx) ---
+        // Consume immediately from buffer
+        _usbStreamBuffer.consume(CMD_SIZE);
+        recordParsed(FR_SYSTEM, cmd);
+        if((_debug) && (cmd.opcode != 0x07) && (cmd.opcode != 0x25)&& (cmd.opcode != 0x10)) log("SYS", cmd);
+        handleSystemCommand(cmd);
+        return true;
+    }
+
+    // --- JOB COMMAND (0x8xxx) ---
+    // Only consume if we have space in the Job Queue
+    if (abortPending() || _replay.replaying() || _jobQueue.isFull()) return false;
+    recordParsed(FR_PARSED, cmd);
+    JobOp op;
+    // Single records only come from across the ring wrap, there is nothing
+    // after them to look at
+    if (acceptJobRecord(cmd, op, nullptr, 0) & ACCEPT_QUEUED) _jobQueue.push(op);
+    _usbStreamBuffer.consume(CMD_SIZE);
+    _statusFresh = false;
+    return true;
+}
+
+// Translates a job command into its pre-decoded form, as described by its
+// entry in LMCV4_OPCODES.
+// Returns false for opcodes that do nothing on execution, those are not queued.
+bool LMCV4Driver::decodeJobCommand(const BalorCommand& cmd, JobOp& op) {
+    // Everything off the 0x80xx page (e.g. LMC_OPCODE_HANDLED) has nothing to execute
+    if ((cmd.opcode >> 8) != 0x80) return false;
+    const JobDecodeEntry& desc = LMCV4_JOB_DECODE.entry[cmd.opcode & 0xFF];
+    op.kind = desc.kind;
+    op.opcode = cmd.opcode;
+
+    // Jumps and cuts are most of any job, ahead of the switch
+    if (desc.decode == DEC_XY) {
+        // Full polygon delay unless the corner planner finds out better
+        op.flags = JOB_CORNER_FULL;
+        if (_cubicPending) {
+            if (op.kind == OP_CUT) {
+                // Ends the cubic whose control points came just before
+                _cubicPending = false;
+                op.kind = OP_CUBIC;
+                op.curve.x = cmd.params[1];
+                op.curve.y = cmd.params[0];
+                op.curve.ax = _cubicAX;
+                op.curve.ay = _cubicAY;
+                op.curve.bx = _cubicBX;
+                op.curve.by = _cubicBY;
+                _curveStats.cubics++;
+                return true;
+            }
+            dropCubic();
+        }
+        op.move.x = cmd.params[1];
+        op.move.y = cmd.params[0];
+        op.move.tx = (float)op.move.x - 32768.0f;
+        op.move.ty = (float)op.move.y - 32768.0f;
+        return true;
+    }
+
+    op.flags = 0;
+    switch (desc.decode) {
+        case DEC_SPEED:
+            op.param.raw = cmd.params[0];
+            op.param.value = (float)cmd.params[0] * LMC_SPEED_UNIT * _galvoSpeedFactor;
+            if (op.kind == OP_MARK_SPEED) _planMarkSpeed = op.param.value;
+            return true;
+
+        case DEC_RAW:
+            op.param.raw = cmd.params[0];
+            op.param.value = (float)cmd.params[0];
+            if (op.kind == OP_POWER) _planPower = op.param.raw;
+            return true;
+
+        case DEC_HATCH:
+            // Only parseHatch() has an outline waiting for it
+            if (!_hatchStaged) return false;
+            op.param.raw = _hatchQueued.load(std::memory_order_relaxed) % LMCV4Config::HATCH_SLOTS;
+            op.param.value = 0.0f;
+            return true;
+
+        case DEC_ARC:
+            if (!(_extensions & LMC_EXT_CURVES)) return false;
+            dropCubic();
+            op.flags = JOB_CORNER_FULL | ((cmd.params[4] & CURVE_CCW) ? JOB_ARC_CCW : 0);
+            op.curve.x = cmd.params[1];
+            op.curve.y = cmd.params[0];
+            op.curve.ax = cmd.params[3];
+            op.curve.ay = cmd.params[2];
+            op.curve.bx = 0;
+            op.curve.by = 0;
+            _curveStats.arcs++;
+            return true;
+
+        case DEC_CUBIC:
+            // Nothing to queue yet, the cut after it carries the end
+            if (!(_extensions & LMC_EXT_CURVES)) return false;
+            dropCubic();
+            _cubicPending = true;
+            _cubicAX = cmd.params[1];
+            _cubicAY = cmd.params[0];
+            _cubicBX = cmd.params[3];
+            _cubicBY = cmd.params[2];
+            return false;
+
+        // 0x8026 pulse width, 0x8051 start job? and
+        // anything unknown: nothing to execute
+        default:
+            return false;
+    }
+}
+
+// Keeps a copy of every job record from the host for MARK_COUNT repeats.
+// Returns true if it ended a list that is now being repeated.
+bool LMCV4Driver::recordForReplay(const BalorCommand& cmd, uint8_t flags) {
+    if (!_replay.record(cmd.opcode, cmd.params[0], cmd.params[1], flags)) return false;
+    if (_debug) log("REPLAY", cmd);
+    return true;
+}
+
+// Queues the recorded list again, as far as the job queue has room. Same
+// decoding as records from the host, the cuts keep the corner tags they were
+// planned with the first time.
+void LMCV4Driver::pumpReplay() {
+    if (!_replay.replaying() || abortPending()) return;
+
+    while (_replay.replaying()) {
+        JobOp* slots;
+        size_t room = _jobQueue.reserve_contiguous(slots);
+        if (room == 0) break;
+        size_t out = 0;
+        while (out < room) {
+            const Replay::Record* r = _replay.next();
+            if (!r) break;
+            if (decodeRecord(*r, slots[out])) out++;
+        }
+        _jobQueue.commit(out);
+        _statusFresh = false;
+    }
+}
+
+// Decodes a recorded or cached record the same way as one from the host,
+// the cut keeps the corner tag it was planned with
+bool LMCV4Driver::decodeRecord(const JobRecord& record, JobOp& op) {
+    BalorCommand cmd = {(uint16_t)(0x8000 | record.code), {record.p0, record.p1, 0, 0, 0}};
+    if (!decodeJobCommand(cmd, op)) return false;
+    if (op.kind == OP_JUMP || op.kind == OP_CUT) {
+        op.flags = record.flags;
+        _planX = op.move.x;
+        _planY = op.move.y;
+    }
+    return true;
+}
+
+// Everything a job record from the host goes through on its way into the
+// job queue: list bookkeeping, the job cache, decoding, corner planning and
+// the MARK_COUNT recording. Returns ACCEPT_QUEUED if `op` is to be queued,
+// ACCEPT_STOP if nothing after this record may be queued yet.
+uint8_t LMCV4Driver::acceptJobRecord(const BalorCommand& cmd, JobOp& op, const BalorCommand* next, size_t count) {
+    bool endOfList = (cmd.opcode == JOB_REPLAY_END_OF_LIST);
+
+    // Rest of a list the cache got wrong, up to its End of List
+    if (_cacheDiscard) {
+        if (endOfList) {
+            _cacheDiscard = false;
+            _listPos = 0;
+        }
+        return 0;
+    }
+
+    if (_listPos == 0) {
+        _listKey = Cache::hashStart();
+        _listStartedAt.store(micros(), std::memory_order_relaxed);
+        _listSeq.store(_listSeq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    uint8_t result = 0;
+    uint8_t flags = 0;
+    switch ((_cacheEntry == Cache::NONE) ? CACHE_OFF : followCache(cmd, op, flags)) {
+        case CACHE_QUEUED:
+            result = ACCEPT_QUEUED;
             break;
 
-        
-        case 0x0025: // Status Poll
-            //00 00 12 c0 00 00 xx 02
-            report[0] = 0x00; 
-            report[1] = 0x00;
-            report[2] = 0x12; // Magic bytes seen in python blobs
-            report[3] = 0xc0;
-            report[4] = 0x09;
-            report[5] = 0x00;
-            // Byte 6 is inserted below
-            report[7] = 0x02; 
+        case CACHE_SKIP:
             break;
 
-        case 0x0007: // Status Poll / Version
-        case 0x0019: // End of List (Commit)
-            // These commands mostly care about the Status Byte (Byte 6)
-            // 00 00 21 84 09 00 xx 02
-            report[0] = 0x00; 
-            report[1] = 0x00;
-            report[2] = 0x21; // Magic bytes seen in python blobs
-            report[3] = 0x84;
-            report[4] = 0x09;
-            report[5] = 0x00;
-            // Byte 6 is inserted below
-            report[7] = 0x02; 
+        case CACHE_FAULT:
+            // Ops for records that never came are already queued: stop the job
+            if (_debug) log("CACHE FAULT", cmd);
+            _replay.cancel();
+            _cacheFault = true;
+            _cacheDiscard = !endOfList;
+            _listPos = 0;
+            requestAbort();
+            return ACCEPT_STOP;
+
+        case CACHE_OFF:
+            op.flags = 0;
+            if (decodeJobCommand(cmd, op)) {
+                planCorner(op, next, count);
+                result = ACCEPT_QUEUED;
+            }
+            flags = op.flags;
             break;
+    }
+
+    // A fill's outline and a curve's centre or control points are not kept
+    // with the recording
+    bool curve = (cmd.opcode == LMC_OPCODE_ARC || cmd.opcode == LMC_OPCODE_CUBIC) && (_extensions & LMC_EXT_CURVES);
+    if (cmd.opcode == LMC_OPCODE_HATCH_FILL || curve) _replay.dropList();
+    if (recordForReplay(cmd, flags)) result |= ACCEPT_STOP;
+
+    if (_listPos < Cache::KEY_RECORDS) {
+        _listKey = Cache::hash(_listKey, cmd.opcode, cmd.params[0], cmd.params[1]);
+        if (_cacheEnabled && _listPos + 1 == Cache::KEY_RECORDS && !endOfList) {
+            _cacheEntry = _cache.find(_listKey);
+            if (_cacheEntry != Cache::NONE) {
+                _cache.stats().hits++;
+                _cacheQueued = Cache::KEY_RECORDS;
+            } else {
+                _cache.stats().misses++;
+            }
+        }
+    }
+    _listPos++;
+
+    if (endOfList) endList();
+    return result;
+}
+
+// Compares a record from the host with the cached list being followed.
+// CACHE_QUEUED: `op` filled in from the cache. CACHE_SKIP: matched, nothing
+// (more) to queue for it. CACHE_OFF: a different list, no longer following,
+// decode it as usual. CACHE_FAULT: a different list, and cached ops past this
+// point are already queued.
+LMCV4Driver::CacheFollow LMCV4Driver::followCache(const BalorCommand& cmd, JobOp& op, uint8_t& flags) {
+    const JobRecord* list = _cache.records(_cacheEntry);
+    if (_listPos < _cache.length(_cacheEntry) && list[_listPos].matches(cmd.opcode, cmd.params[0], cmd.params[1])) {
+        flags = list[_listPos].flags;
+        if (_listPos < _cacheQueued) return CACHE_SKIP;
+        _cacheQueued = _listPos + 1;
+        return decodeRecord(list[_listPos], op) ? CACHE_QUEUED : CACHE_SKIP;
+    }
+
+    // Not the list we took it for; it gets cached at its End of List instead
+    bool ahead = _listPos < _cacheQueued;
+    _cache.stats().mismatches++;
+    _cache.evict(_cacheEntry);
+    _cacheEntry = Cache::NONE;
+    if (!ahead) return CACHE_OFF;
+    _cache.stats().faults++;
+    return CACHE_FAULT;
+}
 
-        case 0x0005: // Execute
+// End of List from the host: a list followed from the cache is done, any
+// other one long enough to have a key is cached
+void LMCV4Driver::endList() {
+    dropCubic();
+    if (_cacheEntry != Cache::NONE) {
+        _cache.stats().completed++;
+        _cacheEntry = Cache::NONE;
+    } else if (_cacheEnabled && _listPos >= Cache::KEY_RECORDS && _replay.lastLength() == _listPos) {
+        _cache.insert(_listKey, _replay.lastList(), _replay.lastLength());
+    }
+    _listPos = 0;
+}
+
+// Queues the cached list being followed ahead of the host, up to the
+// run-ahead limit
+void LMCV4Driver::pumpCache() {
+    if (_cacheEntry == Cache::NONE || abortPending()) return;
+
+    size_t limit = _listPos + _cacheRunAhead;
+    if (limit > _cache.length(_cacheEntry)) limit = _cache.length(_cacheEntry);
+    const JobRecord* list = _cache.records(_cacheEntry);
+    while (_cacheQueued < limit) {
+        JobOp* slots;
+        size_t room = _jobQueue.reserve_contiguous(slots);
+        if (room == 0) break;
+        size_t out = 0;
+        while (out < room && _cacheQueued < limit) {
+            if (decodeRecord(list[_cacheQueued++], slots[out])) out++;
+        }
+        _jobQueue.commit(out);
+        _statusFresh = false;
+    }
+}
+
+// Asks core 1 to flush the job queue and stop the galvo
+void LMCV4Driver::requestAbort() {
+    _abortRequestedAt.store(micros(), std::memory_order_relaxed);
+    _abortRequests.store(_abortRequests.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    _statusFresh = false;
+}
+
+// Tags a cut or curve with the share of the polygon delay the corner at its
+// end needs, from the next move among the records that follow it in the parse
+// window. Parameter and system records in between are looked through; a jump,
+// the end of the list or a window that ends first leave the full delay.
+// Curves are taken by their tangents at the joint.
+void LMCV4Driver::planCorner(JobOp& op, const BalorCommand* next, size_t count) {
+    if (op.kind != OP_JUMP && op.kind != OP_CUT && op.kind != OP_ARC && op.kind != OP_CUBIC) return;
+
+    // move.x/y and curve.x/y are the same place
+    int32_t fromX = _planX, fromY = _planY;
+    _planX = op.move.x;
+    _planY = op.move.y;
+    if (op.kind == OP_JUMP || !_cornerPlanner) return;
+
+    if (op.kind == OP_CUBIC) {
+        // Coming in from the last control point that is not the end
+        if (op.curve.bx != op.curve.x || op.curve.by != op.curve.y) {
+            fromX = op.curve.bx;
+            fromY = op.curve.by;
+        } else if (op.curve.ax != op.curve.x || op.curve.ay != op.curve.y) {
+            fromX = op.curve.ax;
+            fromY = op.curve.ay;
+        }
+    } else if (op.kind == OP_ARC) {
+        // Square to the radius at the end
+        int32_t rx = (int32_t)op.curve.x - op.curve.ax, ry = (int32_t)op.curve.y - op.curve.ay;
+        if (rx || ry) {
+            bool ccw = op.flags & JOB_ARC_CCW;
+            fromX = op.curve.x - (ccw ? -ry : ry);
+            fromY = op.curve.y - (ccw ? rx : -rx);
+        }
+    }
+
+    if (count > LMCV4Config::CORNER_LOOKAHEAD) count = LMCV4Config::CORNER_LOOKAHEAD;
+    for (size_t n = 0; n < count; n++) {
+        uint16_t opcode = next[n].opcode;
+        // Can't see into a bulk or raster record from here
+        if (payloadRecord(opcode)) break;
+        // System commands (status polls mostly) don't move the head
+        if ((opcode >> 8) != 0x80) continue;
+        const JobDecodeEntry& desc = LMCV4_JOB_DECODE.entry[opcode & 0xFF];
+        int32_t dx, dy;
+        if (desc.kind == OP_CUT) {
+            // Zero-length cuts at corners: the corner is with the one after
+            if (next[n].params[1] == op.move.x && next[n].params[0] == op.move.y) continue;
+            dx = (int32_t)next[n].params[1] - op.move.x;
+            dy = (int32_t)next[n].params[0] - op.move.y;
+        } else if (desc.kind == OP_ARC || desc.kind == OP_CUBIC) {
+            // Ignored while curves are off; a cubic starting with a control
+            // point on the joint takes its direction from further on
+            if (!(_extensions & LMC_EXT_CURVES) || !curveStart(next[n], op.move.x, op.move.y, dx, dy)) continue;
+        } else {
+            // The path ends here (or moves on without marking)
+            if (desc.kind == OP_JUMP || desc.kind == OP_END_OF_LIST) {
+                _cornerStats.cuts[JOB_CORNER_FULL]++;
+                return;
+            }
+            continue;
+        }
+        uint8_t quarters = cornerQuarters(op.move.x - fromX, op.move.y - fromY, dx, dy);
+        op.flags = (op.flags & ~JOB_CORNER_MASK) | quarters;
+        _cornerStats.cuts[quarters]++;
+        return;
+    }
+    _cornerStats.unseen++;
+}
+
+// Direction a curve record sets off in from (x, y), false if it does not
+// tell (control points on the joint, or an arc around it)
+bool LMCV4Driver::curveStart(const BalorCommand& record, uint16_t x, uint16_t y, int32_t& dx, int32_t& dy) const {
+    if (record.opcode == LMC_OPCODE_ARC) {
+        int32_t rx = (int32_t)x - record.params[3], ry = (int32_t)y - record.params[2];
+        bool ccw = record.params[4] & CURVE_CCW;
+        dx = ccw ? -ry : ry;
+        dy = ccw ? rx : -rx;
+        return rx || ry;
+    }
+    for (int i = 0; i < 2; i++) {
+        dx = (int32_t)record.params[2 * i + 1] - x;
+        dy = (int32_t)record.params[2 * i] - y;
+        if (dx || dy) return true;
+    }
+    return false;
+}
+
+// Brings the cached status byte and the pre-built reports up to date.
+// Only bytes whose source actually changed are rewritten.
+void LMCV4Driver::refreshStatus() {
+    // Published by the executor on core 1, never read its state directly
+    ExecStatus exec = _execStatus.read();
+
+    // READY BIT (0x20): High if we have room in the buffer
+    // Lightburn waits for this before sending the next chunk
+    uint16_t fill[FLOW_BUFFER_COUNT];
+    fill[FLOW_STREAM] = _usbStreamBuffer.available() / CMD_SIZE;
+    fill[FLOW_JOB] = _jobQueue.available();
+    fill[FLOW_GALVO] = (exec.galvo_avail < 0xFFFF) ? exec.galvo_avail : 0xFFFF;
+    bool flowReady = _flow.update(fill, micros());
+
+    uint8_t status = 0;
+    state.is_ready = !abortPending() && flowReady;
+    if (state.is_ready) status |= LMC_STATUS_READY;
+
+    // ERROR BIT (0x02): a cached job ran ahead into a different list
+    if (_cacheFault) status |= LMC_STATUS_ERROR;
+
+    // RUNNING BIT (0x04): High if we are working
+    state.is_running = exec.galvo_busy || _replay.replaying();
+    if (state.is_running) status |= LMC_STATUS_RUNNING;
+
+    _replyStats.refreshes++;
+    _statusFresh = true;
+
+    if (status != _status) {
+        _status = status;
+        _pollReport[6] = status;
+        _versionReport[6] = status;
+        _positionReport[6] = status;
+        _inputsReport[6] = status;
+    }
+
+    if (exec.x != _reportedX || exec.y != _reportedY) {
+        _reportedX = exec.x;
+        _reportedY = exec.y;
+        _positionReport[0] = exec.x & 0xFF;
+        _positionReport[1] = exec.x >> 8;
+        _positionReport[2] = exec.y & 0xFF;
+        _positionReport[3] = exec.y >> 8;
+    }
+
+    uint16_t inputs = state.port_val;
+    // Simulate Laser Bit in port for ReadPort command
+    if (exec.laser_on) inputs |= 0x100;
+    else inputs &= ~0x100;
+    _inputsReport[0] = inputs & 0xFF;
+    _inputsReport[1] = inputs >> 8;
+}
+
+void LMCV4Driver::handleSystemCommand(const BalorCommand& cmd) {
+    PROFILE_SCOPE(_profiler, PROF_SYSTEM);
+
+    // Status is only gathered once per update() pass unless something on this
+    // core changed it, back-to-back polls are answered from the cache
+    if (!_statusFresh) refreshStatus();
+
+    uint8_t handler = lmcv4Opcode(cmd.opcode).handler;
+
+    // Pre-built answers for the polls Lightburn sends all the time
+    switch (handler) {
+        case SYS_GET_POS: queueReply(_positionReport); return;
+        case SYS_READ_INPUTS: queueReply(_inputsReport); return;
+        case SYS_POLL: queueReply(_pollReport); return;      // 0x0025
+        case SYS_VERSION: queueReply(_versionReport); return; // 0x0007, 0x0019 End of List (Commit)
+    }
+
+    uint8_t report[REPORT_SIZE] = {0};
+
+    switch (handler) {
+        case SYS_EXECUTE: // 0x0005
             state.is_running = true;
             break;
 
-        case 0x0012: // Reset / Abort
+        case SYS_ABORT: // 0x0012 Reset / Abort
+            // The stream is ours to drop, the job queue and galvo belong to
+            // core 1 which picks the request up on its next run()
             state.is_running = false;
-            _jobQueue.clear();
             _usbStreamBuffer.clear();
-            //while(_queue->avail()) _queue->pop();
-            hw_abort(_galvo);
-            hw_laserControl(false, _galvo);
+            _oobSkip = 0;
+            _replay.cancel();
+            _cacheEntry = Cache::NONE;
+            _cacheDiscard = false;
+            _cacheFault = false;
+            _listPos = 0;
+            _cubicPending = false;
+            requestAbort();
             break;
             
-        case 0x0021: // Write Port immediate
+        case SYS_WRITE_PORT: // 0x0021 Write Port immediate
              // Typically handled in queue, but some drivers use 0x0021 for immediate IO
              state.port_val = cmd.params[0];
+             _statusFresh = false;
              break;
+
+        case SYS_FR_DUMP: // Vendor: dump flight recorder to the debug stream
+             dumpFlightRecorder(_debugStream);
+             break;
+
+        case SYS_PROF_READ: // Vendor: read one profiling value, P1 = probe, P2 = field
+             profileReport(cmd.params[0], cmd.params[1], report);
+             break;
+
+        case SYS_EXTENSIONS: // Vendor: switch protocol extensions, P1 = wanted
+             _extensions = cmd.params[0] & (LMC_EXT_BULK_VECTORS | LMC_EXT_RASTER | LMC_EXT_HATCH | LMC_EXT_CURVES);
+             _bulkOpcode = (_extensions & LMC_EXT_BULK_VECTORS) ? LMC_OPCODE_BULK_VECTORS : 0;
+             _rasterOpcode = (_extensions & LMC_EXT_RASTER) ? LMC_OPCODE_RASTER_ROW : 0;
+             _hatchOpcode = (_extensions & LMC_EXT_HATCH) ? LMC_OPCODE_HATCH_FILL : 0;
+             report[0] = (LMC_EXT_BULK_VECTORS | LMC_EXT_RASTER | LMC_EXT_HATCH | LMC_EXT_CURVES) & 0xFF;
+             report[1] = (LMC_EXT_BULK_VECTORS | LMC_EXT_RASTER | LMC_EXT_HATCH | LMC_EXT_CURVES) >> 8;
+             report[2] = _extensions & 0xFF;
+             report[3] = _extensions >> 8;
+             break;
+
+        case SYS_LENS: // Vendor: lens correction grid, P1 = action (LensCorrection.h)
+             lensCommand(cmd, report);
+             break;
+
+        case SYS_REPLAY_STAT: { // Vendor: MARK_COUNT replay state
+             uint16_t passes = _replay.passesLeft();
+             uint16_t recorded = (_replay.recorded() < 0xFFFF) ? _replay.recorded() : 0xFFFF;
+             report[0] = passes & 0xFF;
+             report[1] = passes >> 8;
+             report[2] = recorded & 0xFF;
+             report[3] = recorded >> 8;
+             report[4] = (_replay.replaying() ? 0x01 : 0) | (_replay.lastOverflowed() ? 0x02 : 0) |
+                         (_replay.enabled() ? 0x80 : 0);
+             break;
+        }
     }
 
-    // Apply Status
-    report[6] = status;
+    // Apply Status (as it was when the command arrived)
+    report[6] = _status;
 
-    // 4. Send Response
     // Note: Opcode 0x10 usually doesn't get a response in some logs, but 
     // generic logic usually replies to everything except specific streaming packets.
-    tud_vendor_n_write(0, report, REPORT_SIZE);
-    tud_vendor_n_flush(0);
-}
-
-void LMCV4Driver::executeCommand(const BalorCommand& cmd) {
-    switch (cmd.opcode) {
-        case 0x8001: // Travel (Jump)
-            state.x = cmd.params[1];
-            state.y = cmd.params[0];
-            hw_travel(state.x, state.y, _galvo);
-            state.is_running = 1;
-            break;            
-
-        case 0x8005: // Cut (Mark)
-            state.x = cmd.params[1];
-            state.y = cmd.params[0];
-            hw_cut(state.x, state.y, _galvo);
-            state.is_running = 1;
-            break;
-            
-        case 0x8021: // Laser Control
-            state.laser_on = (cmd.params[0] > 0);
-            hw_laserControl(state.laser_on, _galvo);
-            break;
+    queueReply(report);
+}
 
-        case 0x8012: // Set Power
-            hw_setPower(cmd.params[0], _galvo);
-            break;
+// --------------------------------------------------------------------------
+// LENS CORRECTION
+// --------------------------------------------------------------------------
 
-        case 0x801B: // Q-Switch / Freq
-        case 0x800A: 
-            hw_setFrequency(cmd.params[0], _galvo);
-            break;
+// What goes into flash (the EEPROM emulation): the grid, whether it is on,
+// and a checksum so a blank or half-written sector is never loaded
+struct LensStore {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t on;
+    LensGrid grid;
+    uint32_t checksum;
+};
+static const uint32_t LENS_STORE_MAGIC = 0x534E454C; // "LENS"
+static const uint16_t LENS_STORE_VERSION = 1;
+static_assert(sizeof(LensStore) <= 4096, "EEPROM emulation is one 4 KB sector");
 
-        case 0x800C: // Cut Speed
-            hw_setMarkSpeed((float)cmd.params[0] * 1.9656, _galvo);
-            break;
+static uint32_t lensChecksum(const LensStore& store) {
+    const uint8_t* bytes = (const uint8_t*)&store;
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < offsetof(LensStore, checksum); i++) h = (h ^ bytes[i]) * 16777619u;
+    return h;
+}
+
+// Hands the grid (or off) to core 1, see serviceLens()
+void LMCV4Driver::requestLens(bool on) {
+    _lensOn = on;
+    _lensRequests.store(_lensRequests.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+bool LMCV4Driver::setLensCorrection(const LensGrid* grid) {
+    if (lensPending()) return false;
+    if (grid) {
+        _lensGrid = *grid;
+        _lensNodes = LENS_GRID_NODES;
+    }
+    requestLens(grid != nullptr);
+    return true;
+}
+
+bool LMCV4Driver::saveLensCorrection() {
+    ExecStatus exec = _execStatus.read();
+    if (state.is_running || exec.galvo_busy || !_jobQueue.isEmpty() || lensPending()) return false;
+
+    static LensStore store; // too big for the core 0 stack
+    store.magic = LENS_STORE_MAGIC;
+    store.version = LENS_STORE_VERSION;
+    store.on = _lensOn;
+    store.grid = _lensGrid;
+    store.checksum = lensChecksum(store);
+    EEPROM.put(0, store);
+    return EEPROM.commit();
+}
+
+void LMCV4Driver::loadSavedLens() {
+    static LensStore store;
+    EEPROM.begin(sizeof(LensStore));
+    EEPROM.get(0, store);
+    if (store.magic != LENS_STORE_MAGIC || store.version != LENS_STORE_VERSION) return;
+    if (store.checksum != lensChecksum(store)) return;
+    _lensGrid = store.grid;
+    _lensNodes = LENS_GRID_NODES;
+    requestLens(store.on != 0);
+}
 
-        case 0x8006: // Jump Speed
-            hw_setJumpSpeed((float)cmd.params[0] * 1.9656, _galvo);
+// 0x00F4. Nodes are written into the grid core 0 keeps; core 1 gets a copy on
+// LENS_APPLY. While it has yet to take it, the grid is left alone and the
+// reply says busy.
+void LMCV4Driver::lensCommand(const BalorCommand& cmd, uint8_t* report) {
+    bool busy = lensPending();
+    bool bad = false;
+
+    switch (cmd.params[0]) {
+        case LENS_NODE: {
+            int16_t dx = (int16_t)cmd.params[2];
+            int16_t dy = (int16_t)cmd.params[3];
+            if (cmd.params[1] >= LENS_GRID_NODES || dx > LENS_MAX_OFFSET || dx < -LENS_MAX_OFFSET ||
+                dy > LENS_MAX_OFFSET || dy < -LENS_MAX_OFFSET) {
+                bad = true;
+            } else if (!busy) {
+                _lensGrid.dx[cmd.params[1]] = dx;
+                _lensGrid.dy[cmd.params[1]] = dy;
+                _lensNodes++;
+            }
             break;
-            
-        case 0x8002: // End of List marker
-            // This is often a NOP in execution, just marks end of a segment
-            state.is_running = 0;
+        }
+        case LENS_CLEAR:
+            if (busy) break;
+            memset(&_lensGrid, 0, sizeof(_lensGrid));
+            _lensNodes = 0;
             break;
-        case 0x8004:        //set mark end delay
-            hw_setEndDelay(cmd.params[0]);
-
-        break;    
-        case 0x800F:           //set polygon delay
-            hw_setPolygonDelay(cmd.params[0]);
-        break;
-        case 0x800D: // Jump Delay
-            //state.jump_delay = cmd.params[0];
-            
-            //delayMicroseconds(state.jump_delay * 10); // Params often 10us units
+        case LENS_APPLY:
+        case LENS_OFF:
+            if (!busy) requestLens(cmd.params[0] == LENS_APPLY);
             break;
-        case 0x8007: // Laser On Delay
-            hw_setLaserOnDelay(cmd.params[0]);
-             //state.laser_on_delay = cmd.params[0];
-             break;
+        case LENS_SAVE:
+            busy = !saveLensCorrection();
+            break;
+        default:
+            bad = true;
+            break;
+    }
 
-        case 0x8008:        //set laser off delay
-            hw_setLaserOffDelay(cmd.params[0]);
-        break;
+    report[0] = _lensNodes & 0xFF;
+    report[1] = _lensNodes >> 8;
+    report[2] = (_lensOn ? LENS_REPLY_ON : 0) | (busy ? LENS_REPLY_BUSY : 0) | (bad ? LENS_REPLY_BAD : 0);
+}
 
-        case 0x8026:        //set pulse width
-        break;
+// --------------------------------------------------------------------------
+// REPLIES
+// --------------------------------------------------------------------------
 
-        case 0x8051:        //start job?
-        break;
+// Replies are collected and sent with one write + flush per update() pass
+// (or whenever the buffer fills) instead of one USB transaction per poll
+void LMCV4Driver::queueReply(const uint8_t* report) {
+    _replyStats.replies++;
+    if (sizeof(_replyBuf) - _replyLen < REPORT_SIZE) flushReplies();
+    if (sizeof(_replyBuf) - _replyLen < REPORT_SIZE) {
+        // IN FIFO still full, the host is not reading its replies
+        _replyStats.dropped++;
+        return;
     }
+    memcpy(_replyBuf + _replyLen, report, REPORT_SIZE);
+    _replyLen += REPORT_SIZE;
+}
+
+void LMCV4Driver::flushReplies() {
+    if (_replyLen == 0) return;
+    uint32_t written = tud_vendor_n_write(_vendorItf, _replyBuf, _replyLen);
+    tud_vendor_n_flush(_vendorItf);
+    _replyStats.writes++;
+
+    // Whatever did not fit in the IN FIFO goes out on a later pass
+    if (written < _replyLen) memmove(_replyBuf, _replyBuf + written, _replyLen - written);
+    _replyLen -= written;
 }
 
 // --------------------------------------------------------------------------
 // DEBUGGING
 // --------------------------------------------------------------------------
 
+void LMCV4Driver::setPathOptimizer(bool enabled, uint16_t toleranceSteps) {
+    _optimizer.setEnabled(enabled);
+    _optimizer.setTolerance(toleranceSteps);
+}
+
+void LMCV4Driver::setJobCache(bool enabled, uint16_t runAhead) {
+    _cacheEnabled = enabled;
+    _cacheRunAhead = runAhead;
+    _cacheEntry = Cache::NONE;
+    if (!enabled) _cache.clear();
+}
+
+void LMCV4Driver::setFlowWatermarks(FlowBuffer buffer, uint16_t high, uint16_t low) {
+    _flow.setWatermarks(buffer, high, low);
+}
+
+void LMCV4Driver::setRunBudget(uint32_t maxCommands, uint32_t maxMicros) {
+    _runMaxCommands = maxCommands;
+    _runMaxMicros = maxMicros;
+}
+
 void LMCV4Driver::setDebug(bool enabled, Stream *stream) {
     _debug = enabled;
     _debugStream = stream;
 }
 
+void LMCV4Driver::dumpFlightRecorder(Stream* out) {
+#if LMCV4_FLIGHT_RECORDER
+    if (!out) return;
+
+    _parseRecorder.freeze(true);
+    _execRecorder.freeze(true);
+    delayMicroseconds(10); // let a record already in progress on core 1 land
+
+    FlightDumpHeader header = {{'L', 'M', 'F', 'R'}, 1, sizeof(FlightRecord),
+                               (uint32_t)(_parseRecorder.count() + _execRecorder.count())};
+    out->write((const uint8_t*)&header, sizeof(header));
+    for (size_t i = 0; i < _parseRecorder.count(); i++) {
+        out->write((const uint8_t*)&_parseRecorder.at(i), sizeof(FlightRecord));
+    }
+    for (size_t i = 0; i < _execRecorder.count(); i++) {
+        out->write((const uint8_t*)&_execRecorder.at(i), sizeof(FlightRecord));
+    }
+    out->flush();
+
+    _parseRecorder.freeze(false);
+    _execRecorder.freeze(false);
+#else
+    (void)out;
+#endif
+}
+
+// Fills bytes 0..5 of a status report for vendor opcode 0x00F1.
+// report[0..3] = value (LE), report[4] = number of probes, report[5] = field.
+// Fields: 0 count, 1 mean, 2 min, 3 max (cycles), 4..11 histogram buckets,
+// 15 cycles per microsecond. Field 0xFF resets every probe.
+void LMCV4Driver::profileReport(uint16_t probe, uint16_t field, uint8_t* report) {
+#if LMCV4_PROFILE
+    uint32_t value = 0;
+    if (field == 0xFF) {
+        _profiler.reset();
+    } else if (field == 15) {
+        value = profileCyclesPerUs();
+    } else if (probe < PROF_PROBE_COUNT) {
+        const ProfileStats& s = _profiler.stats(probe);
+        switch (field) {
+            case 0: value = s.count; break;
+            case 1: value = s.mean(); break;
+            case 2: value = s.count ? s.min : 0; break;
+            case 3: value = s.max; break;
+            default:
+                if (field >= 4 && field < 4 + PROF_HIST_BUCKETS) value = s.hist[field - 4];
+                break;
+        }
+    }
+    report[0] = value & 0xFF;
+    report[1] = (value >> 8) & 0xFF;
+    report[2] = (value >> 16) & 0xFF;
+    report[3] = value >> 24;
+    report[4] = PROF_PROBE_COUNT;
+    report[5] = field & 0xFF;
+#else
+    (void)probe;
+    (void)field;
+    (void)report;
+#endif
+}
+
+void LMCV4Driver::printProfile(Stream* out) {
+#if LMCV4_PROFILE
+    if (!out) return;
+    out->printf("probe               count     mean      min      max  (cycles, %u/us)\r\n", (unsigned)profileCyclesPerUs());
+    for (uint8_t i = 0; i < PROF_PROBE_COUNT; i++) {
+        const ProfileStats& s = _profiler.stats(i);
+        if (!s.count) continue;
+        out->printf("%-18s %6lu %8lu %8lu %8lu\r\n", profileProbeName(i), (unsigned long)s.count,
+                    (unsigned long)s.mean(), (unsigned long)s.min, (unsigned long)s.max);
+    }
+#else
+    (void)out;
+#endif
+}
+
 void LMCV4Driver::log(const char* prefix, const BalorCommand& cmd)
 {
     if (!_debug || !_debugStream) return;
     _debugStream->printf("%S [0x%04X] %-14S P1:%-6d, P2:%-6d\r\n", prefix, cmd.opcode, getOpcodeName(cmd.opcode),cmd.params[0], cmd.params[1]);
 }
 
+void LMCV4Driver::log(const char* prefix, const JobOp& op)
+{
+    if (!_debug || !_debugStream) return;
+    if (op.kind == OP_JUMP || op.kind == OP_CUT || op.kind == OP_ARC || op.kind == OP_CUBIC)
+        _debugStream->printf("%S [0x%04X] %-14S X:%-6d, Y:%-6d\r\n", prefix, op.opcode, getOpcodeName(op.opcode), op.move.x, op.move.y);
+    else
+        _debugStream->printf("%S [0x%04X] %-14S P1:%-6d\r\n", prefix, op.opcode, getOpcodeName(op.opcode), op.param.raw);
+}
+
 const char* LMCV4Driver::getOpcodeName(uint16_t op) {
-    switch(op) {
-        // --- System Commands ---
-        case 0x0005: return "EXEC";
-        case 0x0007: return "VER";
-        case 0x0009: return "READ_IN";
-        case 0x000C: return "GETPOS";
-        case 0x0012: return "RST";
-        case 0x0021: return "WPORT";
-        case 0x0025: return "STAT";
-
-        // --- Job: Motion ---
-        case 0x8001: return "JUMP";
-        case 0x8002: return "END";
-        case 0x8005: return "CUT";
-        case 0x8051: return "START";
-
-        // --- Job: Laser & Timing ---
-        case 0x8003: return "LASER_ON_PT";
-        case 0x8004: return "MARK_END_DLY";
-        case 0x8006: return "TRAVEL_SPD";
-        case 0x8007: return "LASER_ON_DLY";
-        case 0x8008: return "LASER_OFF_DLY";
-        case 0x800A: return "FREQ";
-        case 0x800B: return "PULSE_WIDTH";
-        case 0x800C: return "CUT_SPD";
-        case 0x800D: return "JUMP_DLY";
-        case 0x800F: return "POLY_DLY";
-        case 0x8011: return "WRITE_PORT";
-        case 0x8012: return "POWER";
-        case 0x801A: return "FLY_EN";
-        case 0x801B: return "QSWITCH";
-        case 0x801C: return "DIRECT_SW";
-        case 0x801D: return "FLY_DLY";
-        case 0x8021: return "LSR_CTRL";
-        case 0x8023: return "MARK_COUNT";
-        case 0x8050: return "JPT_PARAM";
-        default: return "UNK";
-    }
+    return lmcv4OpcodeName(op);
 }
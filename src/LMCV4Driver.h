@@ -2,62 +2,262 @@
 #define LMCV4_DRIVER_H
 
 #include <Adafruit_TinyUSB.h>
+#include "LMCV4Config.h"
 #include "LMCV4_Protocol.h"
+#include "LMCV4_Opcodes.h"
+#include "JobOp.h"
+#include "FlightRecorder.h"
+#include "Profiler.h"
+#include "FlowControl.h"
+#include "PathOptimizer.h"
+#include "CornerPlanner.h"
+#include "JobReplay.h"
+#include "JobCache.h"
+#include "BulkVectors.h"
+#include "RasterRows.h"
+#include "HatchFill.h"
+#include "CurveFlatten.h"
+#include "LensCorrection.h"
 #include "RingBuffer.h"
+#include "Published.h"
 #include "XY2Galvo.h"
 
-#define CHUNK_SIZE  3100
+#define LMC_SPEED_UNIT  1.9656f // mm/s per speed count on the wire
 
+// The driver is split across the two RP2350 cores:
+//
+//  core 0 (loop):  update()  USB I/O, stream parsing, system commands, status
+//  core 1 (loop1): run()     executes _jobQueue into the XY2Galvo LaserQueue
+//
+// They only share _jobQueue (core 0 pushes, core 1 pops), the _execStatus
+// snapshot (core 1 publishes, core 0 reads) and the abort request counters.
+// Nothing on one core ever waits for the other.
+//
+// This class is the core 0 half and the shared state. The executor, run(), is
+// in LMCV4Executor<Hardware> (LMCV4Executor.h) so the hardware hooks are bound
+// at compile time; derive the hardware layer from that.
 class LMCV4Driver : public Adafruit_USBD_Interface {
 public:
     LMCV4Driver();
     void begin(XY2Galvo* galvo, LaserQueue* queue);
     
-    // Call this in the main loop as fast as possible
+    // Core 0. Call this in loop() as fast as possible
     // Handles USB I/O and parsing
+    // Latency budget: one pass should stay well under 1 ms. Received data
+    // does not wait for it: the RX callback moves every packet into the stream
+    // buffer as it arrives, so a slow pass only costs throughput once the
+    // stream buffer is full (the host gets NAKed), never data.
     void update(); 
 
-    // Call this in the main loop to execute queued hardware movements
-    // Handles the actual laser/galvo control logic
-    void run(); 
+    // Core 0, from TinyUSB's vendor RX callback (see LMCV4Driver.cpp). Moves
+    // what the RX FIFO holds into the stream buffer, or leaves it for the next
+    // update() if that is in the middle of the part that owns the buffer's
+    // write end, or the buffer is full.
+    void onUsbReceive();
+    // On by default. Off, the callback is ignored and update() reads the RX
+    // FIFO at the top of every pass, which needs a FIFO big enough to ride
+    // out a whole pass.
+    void setRxCallback(bool enabled) {
+        _rxCallback = enabled;
+        _rxDeferred = true;
+    }
+
+    struct RxStats {
+        uint32_t callbacks = 0; // RX callbacks taken
+        uint32_t deferred = 0;  // callbacks that left the FIFO to update(), which held the write end
+        uint32_t full = 0;      // reads that left data in the FIFO for a full stream buffer
+        uint64_t bytes = 0;     // moved into the stream buffer
+    };
+    const RxStats& rxStats() const { return _rxStats; }
+
+    // Limits how much one run() pass may do before returning: at most
+    // maxCommands job commands and roughly maxMicros of work (0 = no limit).
+    // Without limits a pass keeps going until the LaserQueue is full.
+    void setRunBudget(uint32_t maxCommands, uint32_t maxMicros);
+
+    struct RunStats {
+        uint32_t passes = 0;     // run() calls
+        uint32_t executed = 0;   // job commands executed
+        uint32_t max_batch = 0;  // most commands executed in one pass
+        uint32_t underruns = 0;  // times the LaserQueue ran dry with jobs waiting
+    };
+    // Written by core 1, safe to read (approximately) from anywhere
+    const RunStats& runStats() const { return _runStats; }
+
+    // Streaming clean-up of the moves and parameters between the job queue and
+    // the hardware hooks (see PathOptimizer.h). On by default with tolerance 0,
+    // which only merges exactly collinear segments. Call before the executor
+    // is running, the optimizer belongs to core 1.
+    void setPathOptimizer(bool enabled, uint16_t toleranceSteps = 0);
+    // Written by core 1
+    const PathOptimizer::Stats& pathOptimizerStats() const { return _optimizer.stats(); }
+
+    // Scales the polygon delay of every cut by the angle of the corner at its
+    // end (see CornerPlanner.h). On by default; off, every cut gets the full
+    // polygon delay as before.
+    void setCornerPlanner(bool enabled) { _cornerPlanner = enabled; }
+
+    struct CornerStats {
+        uint32_t cuts[JOB_CORNER_FULL + 1] = {}; // cuts tagged per quarter of the polygon delay
+        uint32_t unseen = 0; // next move not in the parse window yet, given the full delay
+    };
+    const CornerStats& cornerStats() const { return _cornerStats; }
+
+    // Repeats job lists with a 0x8023 MARK_COUNT on the device instead of
+    // having the host send every pass (see JobReplay.h). On by default.
+    // Vendor opcode 0x00F2 reports passes left, the length of the list being
+    // recorded and whether the last repeated list was too long to record.
+    typedef JobReplay<LMCV4Config::REPLAY_RECORDS> Replay;
+    void setJobReplay(bool enabled) { _replay.setEnabled(enabled); }
+    const Replay::Stats& replayStats() const { return _replay.stats(); }
+
+    // Keeps recently completed job lists and feeds a list the host sends again
+    // from the cache (see JobCache.h). On by default. With runAhead 0 a cached
+    // op is only queued once the host's record for it has arrived and matched,
+    // so a different list is never marked wrong. With runAhead N the cache may
+    // queue up to N records before they arrive; if the list then turns out
+    // different, the job is stopped like 0x0012, the rest of the list is
+    // dropped and the status reports ERROR (0x02) until the next 0x0012.
+    typedef JobCache<LMCV4Config::JOB_CACHE_RECORDS, LMCV4Config::JOB_CACHE_ENTRIES,
+                     LMCV4Config::JOB_CACHE_KEY_RECORDS> Cache;
+    void setJobCache(bool enabled, uint16_t runAhead = 0);
+    const Cache::Stats& jobCacheStats() const { return _cache.stats(); }
+
+    // Time from the first job record of a list being parsed to its first cut
+    // reaching the hardware
+    struct FirstMarkStats {
+        uint32_t lists = 0;
+        uint32_t last_us = 0;
+        uint32_t max_us = 0;
+        uint64_t total_us = 0;
+    };
+    // Written by core 1
+    const FirstMarkStats& firstMarkStats() const { return _firstMark; }
+
+    // READY flow control, in command units per buffer (see FlowControl.h).
+    // Defaults: stream buffer keeps room for a LMCV4_CHUNK_SIZE chunk and
+    // LMCV4_SEND_AHEAD bytes sent past READY, job queue keeps room for two,
+    // the LaserQueue does not gate READY (the job queue behind it is the
+    // reservoir that has to stay topped up).
+    void setFlowWatermarks(FlowBuffer buffer, uint16_t high, uint16_t low);
+    const FlowControl::Stats& flowStats() const { return _flow.stats(); }
+    uint32_t flowNotReadyUs() const { return _flow.notReadyUs(micros()); }
+
+    struct ReplyStats {
+        uint32_t replies = 0;   // status reports answered
+        uint32_t refreshes = 0; // times the cached status was rebuilt
+        uint32_t writes = 0;    // USB write + flush transactions
+        uint32_t dropped = 0;   // replies lost to a full IN FIFO
+    };
+    const ReplyStats& replyStats() const { return _replyStats; }
+
+    // Time from handling 0x0012 on core 0 to the laser being switched off on
+    // core 1. It is handled as soon as it is in the stream buffer, even behind
+    // a full job queue, and the buffer keeps room for it behind up to
+    // LMCV4_SEND_AHEAD bytes sent past READY. The bench's abort case checks
+    // the whole host to laser off time.
+    struct AbortStats {
+        uint32_t aborts = 0;
+        uint32_t last_us = 0;
+        uint32_t max_us = 0;
+    };
+    // Written by core 1
+    const AbortStats& abortStats() const { return _abortStats; }
+
+    // System commands handled out of band, ahead of blocked job records
+    uint32_t outOfBandCount() const { return _oobHandled; }
+
+    // Bulk vector records (BulkVectors.h), once a host switched them on
+    struct BulkStats {
+        uint32_t records = 0;   // bulk records expanded
+        uint32_t vectors = 0;   // jumps and cuts they carried
+        uint64_t bytes = 0;     // wire bytes they took, header and padding included
+        uint32_t malformed = 0; // dropped: bad header or payload
+    };
+    const BulkStats& bulkStats() const { return _bulkStats; }
+
+    // Raster row records (RasterRows.h), once a host switched them on
+    struct RasterStats {
+        uint32_t rows = 0;      // rows expanded
+        uint32_t pixels = 0;
+        uint32_t records = 0;   // jump, cut and power records made of them
+        uint64_t bytes = 0;     // wire bytes the rows took
+        uint32_t malformed = 0; // dropped: bad header, or too many runs for the job queue
+    };
+    const RasterStats& rasterStats() const { return _rasterStats; }
+    // How far the mirrors trail the commanded position, in us. Raster rows
+    // are shifted back along their scan direction by this times the mark
+    // speed. 0 (default) leaves them where the host put them.
+    void setRasterLineLag(uint16_t us) { _rasterLagUs = us; }
+
+    // Hatch fill records (HatchFill.h), once a host switched them on
+    struct HatchStats {
+        uint32_t records = 0;   // outlines queued
+        uint32_t vertices = 0;
+        uint64_t bytes = 0;     // wire bytes they took
+        uint32_t malformed = 0; // dropped: bad header or outline
+    };
+    const HatchStats& hatchStats() const { return _hatchStats; }
+    // Fills made and the lines and cuts they took. Written by core 1
+    const HatchFill::Stats& hatchFillStats() const { return _hatch.stats(); }
+
+    // Arc and cubic records (CurveFlatten.h), once a host switched them on
+    struct CurveStats {
+        uint32_t arcs = 0;
+        uint32_t cubics = 0;
+        uint32_t dropped = 0; // cubic control points with no cut after them
+    };
+    const CurveStats& curveStats() const { return _curveStats; }
+    // Largest distance a piece of a curve may keep from it, in steps (default
+    // 1). Call before the executor is running.
+    void setCurveTolerance(uint16_t steps) { _curve.setTolerance(steps); }
+    // Curves flattened and the pieces they took. Written by core 1
+    const CurveFlattener::Stats& curveFlattenStats() const { return _curve.stats(); }
+
+    // Lens field correction (see LensCorrection.h), applied by the hardware
+    // layer to every target. Usually loaded node by node with vendor opcode
+    // 0x00F4; begin() picks up the grid saved in flash.
+    // Core 0: switches the correction on with `grid`, or off with null.
+    // False (and nothing changes) while core 1 has yet to take the last one.
+    bool setLensCorrection(const LensGrid* grid);
+    // Keeps the grid and on/off in flash. Erasing flash stalls both cores for
+    // a few ms, so this refuses (false) while a job is running.
+    bool saveLensCorrection();
+    // Call before the executor is running
+    void setLensTolerance(uint16_t steps) { _lens.setTolerance(steps); }
+    // Written by core 1
+    const LensCorrection::Stats& lensStats() const { return _lens.stats(); }
 
     void setDebug(bool enabled, Stream* stream = &Serial);
 
+    // Writes the flight recorder (recent parsed/executed commands) to `out` in
+    // the binary format of FlightRecorder.h, decode with tools/flightrec_decode.
+    // Also triggered by vendor opcode 0x00F0, to the debug stream.
+    // Blocks core 0 for as long as the stream takes to send ~16 KB.
+    void dumpFlightRecorder(Stream* out);
+
+    // Prints the hot-path profiling probes as text (see Profiler.h)
+    void printProfile(Stream* out);
+
     // TinyUSB Descriptor Hook
     virtual uint16_t getInterfaceDescriptor(uint8_t itfnum, uint8_t* buf, uint16_t bufsize);
 
 protected:
-    // Hardware Abstraction Layer (Override these in main.cpp)
-    virtual void hw_travel(uint16_t x, uint16_t y, XY2Galvo* galvo) = 0;
-    virtual void hw_cut(uint16_t x, uint16_t y,  XY2Galvo* galvo) = 0;
-    virtual void hw_laserControl(bool on,  XY2Galvo* galvo) = 0;
-    virtual void hw_setPower(uint16_t power,  XY2Galvo* galvo) = 0;
-    virtual void hw_setFrequency(uint16_t period,  XY2Galvo* galvo) = 0;
-    virtual void hw_setMarkSpeed(float speed,  XY2Galvo* galvo) = 0;
-    virtual void hw_setJumpSpeed(float speed,  XY2Galvo* galvo) = 0;
-    virtual void hw_getPos(uint16_t& live_x, uint16_t& live_y,  XY2Galvo* galvo) = 0;
-    virtual void hw_abort(XY2Galvo *galvo) = 0;
-    virtual void hw_setPulseWidth(uint16_t us) = 0;
-    virtual void hw_setLaserOnDelay(uint16_t us) = 0;
-    virtual void hw_setLaserOffDelay(uint16_t us) = 0;
-    virtual void hw_setEndDelay(uint16_t us) = 0;
-    virtual void hw_setPolygonDelay(uint16_t us) = 0;
-    virtual uint16_t hw_getInputs() = 0;
-
     // Internal Machine State
     struct State {
+        // Executor position (core 1)
         uint16_t x = 0x8000;
         uint16_t y = 0x8000;
         
-        // Logical states
+        // Logical states (core 0)
         bool is_ready = true;   // Ready to receive commands
         bool is_running = false; // Currently executing a job list
         
         // Hardware states
-        bool laser_on = false;
-        uint16_t port_val = 0;
+        bool laser_on = false;  // core 1
+        uint16_t port_val = 0;  // core 0
         
-        // Timing parameters (buffered from commands)
+        // Timing parameters (buffered from commands, core 1)
         uint16_t jump_delay = 0;
         uint16_t mark_delay = 0;
         uint16_t poly_delay = 0;
@@ -69,31 +269,250 @@ protected:
     XY2Galvo* _galvo;
     LaserQueue* _queue;
     // USB Buffers
-    uint8_t _rx_buf_temp[4096]; // Temporary buffer for Raw USB read
-    RingBuffer<uint8_t, 4096> _usbStreamBuffer; // Buffer to re-assemble stream into 12-byte cmds
+    // Raw USB data is read straight into this ring and parsed in place
+    RingBuffer<uint8_t, LMCV4Config::STREAM_BUFFER_SIZE> _usbStreamBuffer; // Buffer to re-assemble stream into 12-byte cmds
 
   
-    // Stores parsed commands waiting to be executed by hardware
-    RingBuffer<BalorCommand, 2048> _jobQueue; 
+    // Stores decoded commands waiting to be executed by hardware
+    // Produced on core 0, consumed on core 1
+    RingBuffer<JobOp, LMCV4Config::JOB_QUEUE_SIZE> _jobQueue;
+
+    // Galvo steps per tick for 1 mm/s, set by the hardware layer. Speeds are
+    // converted with this at parse time.
+    float _galvoSpeedFactor = 1.0f;
+
+    // What core 0 needs to know about the executor, published by core 1
+    struct ExecStatus {
+        uint16_t x = 0x8000;     // live position from hw_getPos()
+        uint16_t y = 0x8000;
+        uint32_t galvo_avail = 0; // used LaserQueue slots
+        bool galvo_busy = false; // LaserQueue not empty
+        bool laser_on = false;
+    };
+    Published<ExecStatus> _execStatus;
+
+    FlowControl _flow; // core 0
+
+    // Status report cache (core 0)
+    // The status byte and the reports for the frequent polls are rebuilt only
+    // when the executor snapshot or this core's queues changed, polls are
+    // served by copying a ready-made report
+    bool _statusFresh = false;
+    uint8_t _status = 0;
+    uint16_t _reportedX = 0x8000;
+    uint16_t _reportedY = 0x8000;
+    uint8_t _pollReport[REPORT_SIZE];     // 0x0025
+    uint8_t _versionReport[REPORT_SIZE];  // 0x0007, 0x0019
+    uint8_t _positionReport[REPORT_SIZE]; // 0x000C
+    uint8_t _inputsReport[REPORT_SIZE];   // 0x0009
+    void refreshStatus();
+
+    // Replies of one update() pass, sent as a single USB transaction
+    uint8_t _replyBuf[64];
+    uint16_t _replyLen = 0;
+    ReplyStats _replyStats;
+    void queueReply(const uint8_t* report);
+    void flushReplies();
+
+    // Abort handshake: core 0 bumps _abortRequests, core 1 flushes the job
+    // queue, stops the galvo and catches _abortsDone up. Core 0 holds back new
+    // job records while an abort is pending so none of them get flushed.
+    std::atomic<uint32_t> _abortRequests{0};
+    std::atomic<uint32_t> _abortsDone{0};
+    std::atomic<uint32_t> _abortRequestedAt{0}; // micros() of the latest request
+    AbortStats _abortStats; // core 1
+    bool abortPending() const {
+        return _abortRequests.load(std::memory_order_acquire) != _abortsDone.load(std::memory_order_acquire);
+    }
 
     // TinyUSB Handles
     uint8_t _ep_out;
     uint8_t _ep_in;
-    uint8_t _itfnum;
+    uint8_t _itfnum;        // USB interface number, for the descriptor
+    uint8_t _vendorItf = 0; // vendor class instance, for tud_vendor_n_*()
+
+    // Receiving. The callback interrupts core 0 anywhere in update(), so
+    // update() raises _rxBusy around whatever touches the stream buffer's
+    // write end or _oobUnscanned, and the callback leaves the FIFO alone then.
+    void receive();
+    void receiveDeferred();
+    bool _rxCallback = true;
+    std::atomic<bool> _rxBusy{false};
+    std::atomic<bool> _rxDeferred{false}; // data left in the FIFO for the next update()
+    RxStats _rxStats;
     
     bool _debug = false;
     Stream* _debugStream = nullptr;
 
+    // Executor batching
+    uint32_t _runMaxCommands = 0;
+    uint32_t _runMaxMicros = 100;
+    RunStats _runStats;
+    bool _galvoStarved = false;
+    PathOptimizer _optimizer; // core 1
+
     // Parsing & Processing
     void processIncomingStream();
-    void handleJobCommand(const BalorCommand& cmd);
+    bool parseStream();
+    void scanOutOfBand();
+    size_t _oobUnscanned = 0; // stream bytes at the head not yet seen by scanOutOfBand()
+    size_t _oobSkip = 0;      // bulk payload bytes scanOutOfBand() has to step over
+    uint32_t _oobHandled = 0;
+
+    // Protocol extensions the host switched on with 0x00F3 (core 0)
+    uint16_t _extensions = 0;
+    uint16_t _bulkOpcode = 0;   // LMC_OPCODE_BULK_VECTORS while enabled, 0 otherwise
+    uint16_t _rasterOpcode = 0; // LMC_OPCODE_RASTER_ROW while enabled, 0 otherwise
+    uint16_t _hatchOpcode = 0;  // LMC_OPCODE_HATCH_FILL while enabled, 0 otherwise
+    BulkStats _bulkStats;
+    RasterStats _rasterStats;
+    HatchStats _hatchStats;
+    CurveStats _curveStats;
+    uint16_t _rasterLagUs = 0;
+    // Records followed by a payload that is not made of records
+    bool payloadRecord(uint16_t opcode) const {
+        return opcode >= 0x8000 && (opcode == _bulkOpcode || opcode == _rasterOpcode || opcode == _hatchOpcode);
+    }
+    size_t payloadRecordBytes(const BalorCommand& header) const;
+    enum PayloadResult : uint8_t { PAYLOAD_DONE, PAYLOAD_WAIT, PAYLOAD_BLOCKED };
+    PayloadResult parsePayload(const BalorCommand& header);
+    PayloadResult parseBulk(const BalorCommand& header);
+    PayloadResult parseRaster(const BalorCommand& header);
+    PayloadResult parseHatch(const BalorCommand& header);
+    bool dispatchRecord(const BalorCommand& record);
+    bool decodeJobCommand(const BalorCommand& cmd, JobOp& op);
+
+    // Corner planner (core 0): end of the last decoded move, and the records
+    // after a cut that are looked through for the next one
+    bool _cornerPlanner = true;
+    uint16_t _planX = 0x8000;
+    uint16_t _planY = 0x8000;
+    // Power (0x8012) and mark speed (steps per tick) last decoded, for raster rows
+    uint16_t _planPower = 4095;
+    float _planMarkSpeed = 0.0f;
+    CornerStats _cornerStats;
+    void planCorner(JobOp& op, const BalorCommand* next, size_t count);
+
+    // MARK_COUNT repeats (core 0)
+    Replay _replay;
+    bool recordForReplay(const BalorCommand& cmd, uint8_t flags);
+    void pumpReplay();
+    bool decodeRecord(const JobRecord& record, JobOp& op);
+
+    // Job list bookkeeping and the job cache (core 0)
+    enum : uint8_t { ACCEPT_QUEUED = 0x01, ACCEPT_STOP = 0x02 };
+    enum CacheFollow : uint8_t { CACHE_OFF, CACHE_QUEUED, CACHE_SKIP, CACHE_FAULT };
+    Cache _cache;
+    bool _cacheEnabled = true;
+    uint16_t _cacheRunAhead = 0;
+    int _cacheEntry = Cache::NONE; // list being followed
+    size_t _cacheQueued = 0;       // records of it queued so far
+    bool _cacheDiscard = false;    // dropping the rest of a list after a fault
+    bool _cacheFault = false;      // reported as ERROR until the next abort
+    size_t _listPos = 0;           // job records of the current list so far
+    uint32_t _listKey = 0;
+    uint8_t acceptJobRecord(const BalorCommand& cmd, JobOp& op, const BalorCommand* next, size_t count);
+    CacheFollow followCache(const BalorCommand& cmd, JobOp& op, uint8_t& flags);
+    void endList();
+    void pumpCache();
+    void requestAbort();
+
+    // Lens grid hand-over: core 0 fills _lensGrid and bumps _lensRequests,
+    // core 1 copies it into _lens on its next run() and catches _lensDone up.
+    // _lensGrid and _lensOn are left alone while a request is pending.
+    LensGrid _lensGrid = {};   // core 0
+    bool _lensOn = false;      // core 0
+    uint16_t _lensNodes = 0;   // written since the last LENS_CLEAR
+    std::atomic<uint32_t> _lensRequests{0};
+    std::atomic<uint32_t> _lensDone{0};
+    LensCorrection _lens;      // core 1
+    bool lensPending() const {
+        return _lensRequests.load(std::memory_order_acquire) != _lensDone.load(std::memory_order_acquire);
+    }
+    void requestLens(bool on);
+    void lensCommand(const BalorCommand& cmd, uint8_t* report);
+    void loadSavedLens();
+
+    // Hatch fill outlines: core 0 decodes one into the next free slot and
+    // queues an OP_HATCH for it, bumping _hatchQueued; core 1 makes the fill
+    // and catches _hatchReleased up, or all the way on an abort. A slot is
+    // only written while no more than HATCH_SLOTS - 1 are in use.
+    HatchOutline _hatchSlots[LMCV4Config::HATCH_SLOTS];
+    std::atomic<uint32_t> _hatchQueued{0};
+    std::atomic<uint32_t> _hatchReleased{0};
+    bool _hatchStaged = false; // core 0: an outline is waiting in the next slot for decodeJobCommand()
+    HatchFill _hatch;          // core 1
+    HatchMove _hatchMove;      // core 1: next move, the hardware did not take it yet
+    bool _hatchMovePending = false;
+    bool hatchSlotFree() const {
+        return _hatchQueued.load(std::memory_order_relaxed) - _hatchReleased.load(std::memory_order_acquire) <
+               LMCV4Config::HATCH_SLOTS;
+    }
+
+    // Curves: control points of a 0x80F4 wait on core 0 for the cut that
+    // ends the cubic; core 1 flattens the queued OP_ARC / OP_CUBIC
+    bool _cubicPending = false; // core 0
+    uint16_t _cubicAX = 0, _cubicAY = 0, _cubicBX = 0, _cubicBY = 0;
+    void dropCubic() {
+        if (_cubicPending) _curveStats.dropped++;
+        _cubicPending = false;
+    }
+    bool curveStart(const BalorCommand& record, uint16_t x, uint16_t y, int32_t& dx, int32_t& dy) const;
+    CurveFlattener _curve;     // core 1
+    CurvePiece _curvePiece;    // core 1: next piece, the hardware did not take it yet
+    bool _curvePiecePending = false;
+
+    // Time to first mark: core 0 stamps the start of each list, core 1 the
+    // first cut after it
+    std::atomic<uint32_t> _listSeq{0};
+    std::atomic<uint32_t> _listStartedAt{0};
+    uint32_t _markedSeq = 0; // core 1
+    FirstMarkStats _firstMark; // core 1
+    void noteMark() {
+        uint32_t seq = _listSeq.load(std::memory_order_acquire);
+        if (seq == _markedSeq) return;
+        _markedSeq = seq;
+        uint32_t us = micros() - _listStartedAt.load(std::memory_order_relaxed);
+        _firstMark.lists++;
+        _firstMark.last_us = us;
+        _firstMark.total_us += us;
+        if (us > _firstMark.max_us) _firstMark.max_us = us;
+    }
     void handleSystemCommand(const BalorCommand& cmd);
     
-    // Execution
-    void executeCommand(const BalorCommand& cmd);
+    // Flight recorder, one ring per core
+#if LMCV4_FLIGHT_RECORDER
+    FlightRecorder<LMCV4_FLIGHT_RECORDER_SIZE> _parseRecorder;
+    FlightRecorder<LMCV4_FLIGHT_RECORDER_SIZE> _execRecorder;
+#endif
+    void recordParsed(uint8_t source, const BalorCommand& cmd) {
+#if LMCV4_FLIGHT_RECORDER
+        _parseRecorder.record(micros(), source, cmd.opcode, cmd.params[0], cmd.params[1], _jobQueue.available(),
+                              _usbStreamBuffer.available());
+#else
+        (void)source;
+        (void)cmd;
+#endif
+    }
+    void recordExecuted(const JobOp& op) {
+#if LMCV4_FLIGHT_RECORDER
+        bool move = (op.kind == OP_JUMP || op.kind == OP_CUT || op.kind == OP_ARC || op.kind == OP_CUBIC);
+        _execRecorder.record(micros(), FR_EXECUTED, op.opcode, move ? op.move.x : op.param.raw, move ? op.move.y : 0,
+                             _jobQueue.available(), _queue->avail());
+#else
+        (void)op;
+#endif
+    }
+
+    // Hot-path profiling
+#if LMCV4_PROFILE
+    Profiler _profiler;
+#endif
+    void profileReport(uint16_t probe, uint16_t field, uint8_t* report);
 
     // Utilities
     void log(const char* prefix, const BalorCommand& cmd);
+    void log(const char* prefix, const JobOp& op);
     const char* getOpcodeName(uint16_t op);
 };
 
@@ -0,0 +1,295 @@
+#ifndef LMCV4_EXECUTOR_H
+#define LMCV4_EXECUTOR_H
+
+#include "LMCV4Driver.h"
+
+// Core 1 half of the driver, bound to the hardware layer at compile time
+// (CRTP). The hardware layer derives from LMCV4Executor<itself> and provides
+// the hooks below as ordinary (non-virtual) members, so they inline straight
+// into executeCommand(). A missing hook is a compile error.
+//
+// Targets are galvo coordinates (centred on 0), speeds are galvo steps per tick,
+// the galvo is the one passed to begin() (_galvo).
+//
+//   bool hw_travel(float tx, float ty);   false if the hardware cannot take the
+//   bool hw_cut(float tx, float ty);      vector yet, retried on a later run()
+//   void hw_laserControl(bool on);
+//   void hw_setPower(uint16_t power);
+//   void hw_setFrequency(uint16_t period);
+//   void hw_setMarkSpeed(float speed);
+//   void hw_setJumpSpeed(float speed);
+//   void hw_setLaserOnDelay(uint16_t us);
+//   void hw_setLaserOffDelay(uint16_t us);
+//   void hw_setEndDelay(uint16_t us);
+//   void hw_setPolygonDelay(uint16_t us);
+//   void hw_setJumpDelay(uint16_t us);
+//   void hw_setCornerDelay(uint8_t quarters); share of the polygon delay for
+//                                          the next cut, JOB_CORNER_* (JobOp.h)
+//   void hw_getPos(uint16_t& live_x, uint16_t& live_y);
+//   void hw_abort();
+//
+// Hooks may be private if the hardware layer befriends LMCV4Executor<itself>.
+template <typename Hardware>
+class LMCV4Executor : public LMCV4Driver {
+public:
+    // Core 1. Call this in loop1() as fast as possible
+    // Handles the actual laser/galvo control logic
+    // Latency budget: one pass should stay under ~100 us. A vector takes at
+    // least one 10 us galvo tick, so a few hundred queued LaserQueue entries
+    // give the executor milliseconds of slack before the galvo runs dry.
+    void run() {
+        // Executes commands from the Job Queue physically
+        // This simulates the "Machine" consuming the buffer
+
+        // Abort requested by core 0: we are the job queue consumer, so we are
+        // the ones allowed to flush it
+        serviceAbort();
+        serviceLens();
+
+        // Galvo ran dry while we still had work queued: count each episode once
+        bool starved = !_jobQueue.isEmpty() && _queue->avail() == 0;
+        if (starved && !_galvoStarved) _runStats.underruns++;
+        _galvoStarved = starved;
+
+        // Fill as many free LaserQueue slots as we can in one pass, within budget
+        uint32_t start = micros();
+        uint32_t executed = 0;
+        while (_queue->free() > 1) {
+            JobOp op;
+            if (!_jobQueue.peek(op)) {
+                // Nothing left to merge the held move with, let it go
+                if (_optimizer.holding() && executeHeld()) executed++;
+                break;
+            }
+
+            PathOptimizer::Action action = _optimizer.offer(op);
+            if (action == PathOptimizer::FLUSH_FIRST) {
+                if (!executeHeld()) break; // hardware busy
+                executed++;
+                continue; // and offer op again
+            }
+            if (action == PathOptimizer::PASS) {
+                if (!executeCommand(op)) break; // hardware busy, leave it queued
+                recordExecuted(op);
+                if(_debug) log("EXE", op);
+                executed++;
+            }
+            _jobQueue.consume(1);
+
+            if (_runMaxCommands && executed >= _runMaxCommands) break;
+            if (_runMaxMicros && (micros() - start) >= _runMaxMicros) break;
+            // Don't make an abort wait for the rest of the batch
+            if (_abortRequests.load(std::memory_order_relaxed) != _abortsDone.load(std::memory_order_relaxed)) break;
+        }
+        serviceAbort();
+
+        _runStats.passes++;
+        _runStats.executed += executed;
+        if (executed > _runStats.max_batch) _runStats.max_batch = executed;
+
+        publishExecStatus();
+    }
+
+private:
+    Hardware& hw() { return static_cast<Hardware&>(*this); }
+
+    // Abort requested by core 0: we are the job queue consumer, so we are the
+    // ones allowed to flush it. Checked before and after every batch, so the
+    // laser is off at most one executed op after the request is seen.
+    void serviceAbort() {
+        uint32_t abortRequests = _abortRequests.load(std::memory_order_acquire);
+        if (abortRequests == _abortsDone.load(std::memory_order_relaxed)) return;
+
+        _jobQueue.clear();
+        _optimizer.reset();
+        _hatch.cancel();
+        _hatchMovePending = false;
+        _hatchReleased.store(_hatchQueued.load(std::memory_order_acquire), std::memory_order_release);
+        _curve.cancel();
+        _curvePiecePending = false;
+        hw().hw_abort();
+        state.laser_on = false;
+        hw().hw_laserControl(false);
+
+        uint32_t latency = micros() - _abortRequestedAt.load(std::memory_order_relaxed);
+        _abortStats.aborts++;
+        _abortStats.last_us = latency;
+        if (latency > _abortStats.max_us) _abortStats.max_us = latency;
+
+        _abortsDone.store(abortRequests, std::memory_order_release);
+    }
+
+    // New lens grid (or off) from core 0. Taken between vectors, so a cut is
+    // never split with one grid and finished with another.
+    void serviceLens() {
+        uint32_t requests = _lensRequests.load(std::memory_order_acquire);
+        if (requests == _lensDone.load(std::memory_order_relaxed)) return;
+        if (_lensOn) _lens.load(_lensGrid);
+        else _lens.disable();
+        _lensDone.store(requests, std::memory_order_release);
+    }
+
+    // Sends the move the optimizer held back to the hardware
+    bool executeHeld() {
+        const JobOp& op = _optimizer.held();
+        if (!executeCommand(op)) return false;
+        _optimizer.released();
+        recordExecuted(op);
+        if(_debug) log("EXE", op);
+        return true;
+    }
+
+    void publishExecStatus() {
+        ExecStatus status;
+        hw().hw_getPos(status.x, status.y);
+        status.galvo_avail = _queue->avail();
+        status.galvo_busy = _queue->avail() > 0;
+        status.laser_on = state.laser_on;
+        _execStatus.publish(status);
+    }
+
+    // Returns false if the hardware could not accept the op yet
+    bool executeCommand(const JobOp& op) {
+        PROFILE_SCOPE(_profiler, PROF_EXEC_BASE + op.kind);
+
+        switch (op.kind) {
+            case OP_JUMP: {
+                PROFILE_SCOPE(_profiler, PROF_HW_TRAVEL);
+                if (!hw().hw_travel(op.move.tx, op.move.ty)) return false;
+                state.x = op.move.x;
+                state.y = op.move.y;
+                break;
+            }
+
+            case OP_CUT: {
+                PROFILE_SCOPE(_profiler, PROF_HW_CUT);
+                hw().hw_setCornerDelay(op.flags & JOB_CORNER_MASK);
+                if (!hw().hw_cut(op.move.tx, op.move.ty)) return false;
+                noteMark();
+                state.x = op.move.x;
+                state.y = op.move.y;
+                break;
+            }
+
+            case OP_LASER_CTRL:
+                state.laser_on = (op.param.raw > 0);
+                hw().hw_laserControl(state.laser_on);
+                break;
+
+            case OP_POWER:
+                hw().hw_setPower(op.param.raw);
+                break;
+
+            case OP_FREQUENCY:
+                hw().hw_setFrequency(op.param.raw);
+                break;
+
+            case OP_MARK_SPEED:
+                hw().hw_setMarkSpeed(op.param.value);
+                break;
+
+            case OP_JUMP_SPEED:
+                hw().hw_setJumpSpeed(op.param.value);
+                break;
+
+            case OP_END_DELAY:
+                hw().hw_setEndDelay(op.param.raw);
+                break;
+
+            case OP_POLY_DELAY:
+                hw().hw_setPolygonDelay(op.param.raw);
+                break;
+
+            case OP_LASER_ON_DELAY:
+                hw().hw_setLaserOnDelay(op.param.raw);
+                break;
+
+            case OP_LASER_OFF_DELAY:
+                hw().hw_setLaserOffDelay(op.param.raw);
+                break;
+
+            case OP_JUMP_DELAY:
+                hw().hw_setJumpDelay(op.param.raw);
+                break;
+
+            case OP_END_OF_LIST:
+                // This is often a NOP in execution, just marks end of a segment
+                break;
+
+            case OP_HATCH:
+                if (!executeHatch(op)) return false;
+                break;
+
+            case OP_ARC:
+            case OP_CUBIC:
+                if (!executeCurve(op)) return false;
+                break;
+        }
+        return true;
+    }
+
+    // Makes the next moves of a hatch fill, at most HATCH_MOVES_PER_RUN and
+    // only as many as the LaserQueue has room for, so the op stays queued
+    // until the last one is out. Then the outline's slot is handed back to core 0.
+    bool executeHatch(const JobOp& op) {
+        if (!_hatch.active()) _hatch.begin(_hatchSlots[op.param.raw], state.x, state.y);
+
+        for (size_t n = 0; n < LMCV4Config::HATCH_MOVES_PER_RUN && _queue->free() > 1; n++) {
+            if (!_hatchMovePending && !_hatch.next(_hatchMove)) {
+                _optimizer.movedTo(state.x, state.y);
+                _hatchReleased.store(_hatchReleased.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+                return true;
+            }
+            _hatchMovePending = true;
+
+            float tx = (float)_hatchMove.x - 32768.0f;
+            float ty = (float)_hatchMove.y - 32768.0f;
+            if (_hatchMove.cut) {
+                PROFILE_SCOPE(_profiler, PROF_HW_CUT);
+                // Every line ends in a jump to the next
+                hw().hw_setCornerDelay(JOB_CORNER_FULL);
+                if (!hw().hw_cut(tx, ty)) return false;
+                noteMark();
+            } else {
+                PROFILE_SCOPE(_profiler, PROF_HW_TRAVEL);
+                if (!hw().hw_travel(tx, ty)) return false;
+            }
+            state.x = _hatchMove.x;
+            state.y = _hatchMove.y;
+            _hatchMovePending = false;
+        }
+        return false; // more to come, next pass
+    }
+
+    // Cuts the next pieces of an arc or cubic, like executeHatch(): at most
+    // CURVE_PIECES_PER_RUN and only as many as the LaserQueue has room for.
+    // Joints inside the curve get the delay their own angle needs, the last
+    // one what the corner planner found.
+    bool executeCurve(const JobOp& op) {
+        if (!_curve.active()) {
+            if (op.kind == OP_ARC)
+                _curve.beginArc(state.x, state.y, op.curve.ax, op.curve.ay, op.curve.x, op.curve.y, op.flags & JOB_ARC_CCW);
+            else
+                _curve.beginCubic(state.x, state.y, op.curve.ax, op.curve.ay, op.curve.bx, op.curve.by, op.curve.x, op.curve.y);
+        }
+
+        for (size_t n = 0; n < LMCV4Config::CURVE_PIECES_PER_RUN && _queue->free() > 1; n++) {
+            if (!_curvePiecePending && !_curve.next(_curvePiece)) {
+                _optimizer.movedTo(state.x, state.y, OP_CUT);
+                return true;
+            }
+            _curvePiecePending = true;
+
+            PROFILE_SCOPE(_profiler, PROF_HW_CUT);
+            hw().hw_setCornerDelay(_curvePiece.last ? (op.flags & JOB_CORNER_MASK) : _curvePiece.corner);
+            if (!hw().hw_cut((float)_curvePiece.x - 32768.0f, (float)_curvePiece.y - 32768.0f)) return false;
+            noteMark();
+            state.x = _curvePiece.x;
+            state.y = _curvePiece.y;
+            _curvePiecePending = false;
+        }
+        return false; // more to come, next pass
+    }
+};
+
+#endif
@@ -0,0 +1,174 @@
+#ifndef LMCV4_OPCODES_H
+#define LMCV4_OPCODES_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "JobOp.h"
+
+// Opcode descriptor table, shared by the firmware and the host tools
+// (no Arduino dependencies). This is the one place to add an opcode: the
+// parser, the system command handler and the debug output all look it up
+// here instead of switching on the opcode themselves.
+//
+// Lookups for the two opcode pages the protocol uses (0x00xx system, 0x80xx
+// job) go through 256-entry tables built from it at compile time.
+
+enum OpcodeClass : uint8_t {
+    OPC_UNKNOWN = 0,
+    OPC_SYSTEM,     // 0x00xx, handled on core 0 as soon as it is parsed
+    OPC_MOTION,     // 0x80xx jumps and cuts
+    OPC_PARAMETER,  // 0x80xx laser / timing settings
+    OPC_JOB,        // other 0x80xx list records (markers, unsupported, ...)
+};
+
+// How a job record's params become a JobOp
+enum OpcodeDecode : uint8_t {
+    DEC_NONE = 0,   // nothing to execute, not queued
+    DEC_RAW,        // param.raw = param.value = params[0]
+    DEC_XY,         // move, X = params[1], Y = params[0]
+    DEC_SPEED,      // param.value = params[0] in speed units, converted to steps per tick
+    DEC_HATCH,      // param.raw = outline slot, filled in by the parser
+    DEC_ARC,        // curve: end, centre and direction, once curves are switched on
+    DEC_CUBIC,      // control points kept for the cut that follows, not queued
+};
+
+// What LMCV4Driver::handleSystemCommand() does with a system command
+enum SystemHandler : uint8_t {
+    SYS_STATUS_ONLY = 0, // empty report with the status byte
+    SYS_POLL,            // cached 0x0025 report
+    SYS_VERSION,         // cached 0x0007 report
+    SYS_GET_POS,         // cached position report
+    SYS_READ_INPUTS,     // cached input port report
+    SYS_EXECUTE,
+    SYS_ABORT,
+    SYS_WRITE_PORT,
+    SYS_FR_DUMP,
+    SYS_PROF_READ,
+    SYS_REPLAY_STAT,
+    SYS_EXTENSIONS,
+    SYS_LENS,
+};
+
+struct OpcodeDesc {
+    uint16_t opcode;
+    const char* name;
+    uint8_t cls;     // OpcodeClass
+    uint8_t handler; // JobOpKind for job records, SystemHandler for system commands
+    uint8_t decode;  // OpcodeDecode
+};
+
+// Entry 0 is what unknown opcodes map to
+inline constexpr OpcodeDesc LMCV4_OPCODES[] = {
+    {0x0000, "UNK",           OPC_UNKNOWN,   SYS_STATUS_ONLY,    DEC_NONE},
+
+    // --- System Commands ---
+    {0x0005, "EXEC",          OPC_SYSTEM,    SYS_EXECUTE,        DEC_NONE},
+    {0x0007, "VER",           OPC_SYSTEM,    SYS_VERSION,        DEC_NONE},
+    {0x0009, "READ_IN",       OPC_SYSTEM,    SYS_READ_INPUTS,    DEC_NONE},
+    {0x000C, "GETPOS",        OPC_SYSTEM,    SYS_GET_POS,        DEC_NONE},
+    {0x0012, "RST",           OPC_SYSTEM,    SYS_ABORT,          DEC_NONE},
+    {0x0019, "EOL_COMMIT",    OPC_SYSTEM,    SYS_VERSION,        DEC_NONE},
+    {0x0021, "WPORT",         OPC_SYSTEM,    SYS_WRITE_PORT,     DEC_NONE},
+    {0x0025, "STAT",          OPC_SYSTEM,    SYS_POLL,           DEC_NONE},
+
+    // --- Vendor extensions (not sent by stock software) ---
+    {0x00F0, "FR_DUMP",       OPC_SYSTEM,    SYS_FR_DUMP,        DEC_NONE},
+    {0x00F1, "PROF_READ",     OPC_SYSTEM,    SYS_PROF_READ,      DEC_NONE},
+    {0x00F2, "REPLAY_STAT",   OPC_SYSTEM,    SYS_REPLAY_STAT,    DEC_NONE},
+    {0x00F3, "EXT",           OPC_SYSTEM,    SYS_EXTENSIONS,     DEC_NONE},
+    {0x00F4, "LENS",          OPC_SYSTEM,    SYS_LENS,           DEC_NONE},
+    {0xFFFF, "OOB_DONE",      OPC_JOB,       OP_NOP,             DEC_NONE}, // system command already handled out of band
+
+    // --- Job: Motion ---
+    {0x8001, "JUMP",          OPC_MOTION,    OP_JUMP,            DEC_XY},
+    {0x8002, "END",           OPC_JOB,       OP_END_OF_LIST,     DEC_RAW},
+    {0x8005, "CUT",           OPC_MOTION,    OP_CUT,             DEC_XY},
+    {0x8051, "START",         OPC_JOB,       OP_NOP,             DEC_NONE},
+    {0x80F0, "BULK_VEC",      OPC_MOTION,    OP_NOP,             DEC_NONE}, // vendor, BulkVectors.h, expanded by the parser
+    {0x80F1, "RASTER_ROW",    OPC_MOTION,    OP_NOP,             DEC_NONE}, // vendor, RasterRows.h, expanded by the parser
+    {0x80F2, "HATCH_FILL",    OPC_MOTION,    OP_HATCH,           DEC_HATCH}, // vendor, HatchFill.h, filled by the executor
+    {0x80F3, "ARC",           OPC_MOTION,    OP_ARC,             DEC_ARC},   // vendor, CurveFlatten.h, flattened by the executor
+    {0x80F4, "CUBIC",         OPC_MOTION,    OP_CUBIC,           DEC_CUBIC}, // vendor, CurveFlatten.h, flattened by the executor
+
+    // --- Job: Laser & Timing ---
+    {0x8003, "LASER_ON_PT",   OPC_PARAMETER, OP_NOP,             DEC_NONE},
+    {0x8004, "MARK_END_DLY",  OPC_PARAMETER, OP_END_DELAY,       DEC_RAW},
+    {0x8006, "TRAVEL_SPD",    OPC_PARAMETER, OP_JUMP_SPEED,      DEC_SPEED},
+    {0x8007, "LASER_ON_DLY",  OPC_PARAMETER, OP_LASER_ON_DELAY,  DEC_RAW},
+    {0x8008, "LASER_OFF_DLY", OPC_PARAMETER, OP_LASER_OFF_DELAY, DEC_RAW},
+    {0x800A, "FREQ",          OPC_PARAMETER, OP_FREQUENCY,       DEC_RAW},
+    {0x800B, "PULSE_WIDTH",   OPC_PARAMETER, OP_NOP,             DEC_NONE},
+    {0x800C, "CUT_SPD",       OPC_PARAMETER, OP_MARK_SPEED,      DEC_SPEED},
+    {0x800D, "JUMP_DLY",      OPC_PARAMETER, OP_JUMP_DELAY,      DEC_RAW},
+    {0x800F, "POLY_DLY",      OPC_PARAMETER, OP_POLY_DELAY,      DEC_RAW},
+    {0x8011, "WRITE_PORT",    OPC_PARAMETER, OP_NOP,             DEC_NONE},
+    {0x8012, "POWER",         OPC_PARAMETER, OP_POWER,           DEC_RAW},
+    {0x801A, "FLY_EN",        OPC_PARAMETER, OP_NOP,             DEC_NONE},
+    {0x801B, "QSWITCH",       OPC_PARAMETER, OP_FREQUENCY,       DEC_RAW},
+    {0x801C, "DIRECT_SW",     OPC_PARAMETER, OP_NOP,             DEC_NONE},
+    {0x801D, "FLY_DLY",       OPC_PARAMETER, OP_NOP,             DEC_NONE},
+    {0x8021, "LSR_CTRL",      OPC_PARAMETER, OP_LASER_CTRL,      DEC_RAW},
+    {0x8023, "MARK_COUNT",    OPC_JOB,       OP_NOP,             DEC_NONE},
+    {0x8026, "PULSE_WIDTH2",  OPC_PARAMETER, OP_NOP,             DEC_NONE},
+    {0x8050, "JPT_PARAM",     OPC_PARAMETER, OP_NOP,             DEC_NONE},
+};
+
+inline constexpr size_t LMCV4_OPCODE_COUNT = sizeof(LMCV4_OPCODES) / sizeof(LMCV4_OPCODES[0]);
+static_assert(LMCV4_OPCODE_COUNT <= 256, "opcode pages index the table with a uint8_t");
+
+// Low byte of an opcode -> index into LMCV4_OPCODES, for one high byte
+struct OpcodePage {
+    uint8_t index[256];
+};
+
+constexpr OpcodePage lmcv4BuildOpcodePage(uint8_t page) {
+    OpcodePage out{};
+    for (size_t i = 1; i < LMCV4_OPCODE_COUNT; i++) {
+        if ((LMCV4_OPCODES[i].opcode >> 8) == page) out.index[LMCV4_OPCODES[i].opcode & 0xFF] = (uint8_t)i;
+    }
+    return out;
+}
+
+inline constexpr OpcodePage LMCV4_SYSTEM_PAGE = lmcv4BuildOpcodePage(0x00);
+inline constexpr OpcodePage LMCV4_JOB_PAGE = lmcv4BuildOpcodePage(0x80);
+
+// What the parser needs per 0x80xx opcode, packed into two bytes so decoding
+// a job record costs a single table load
+struct JobDecodeEntry {
+    uint8_t kind;   // JobOpKind
+    uint8_t decode; // OpcodeDecode
+};
+
+struct JobDecodeTable {
+    JobDecodeEntry entry[256];
+};
+
+constexpr JobDecodeTable lmcv4BuildJobDecodeTable() {
+    JobDecodeTable out{};
+    for (size_t lo = 0; lo < 256; lo++) {
+        const OpcodeDesc& d = LMCV4_OPCODES[LMCV4_JOB_PAGE.index[lo]];
+        out.entry[lo].kind = (d.cls == OPC_UNKNOWN) ? (uint8_t)OP_NOP : d.handler;
+        out.entry[lo].decode = d.decode;
+    }
+    return out;
+}
+
+inline constexpr JobDecodeTable LMCV4_JOB_DECODE = lmcv4BuildJobDecodeTable();
+
+inline const OpcodeDesc& lmcv4Opcode(uint16_t op) {
+    uint8_t page = op >> 8;
+    if (page == 0x80) return LMCV4_OPCODES[LMCV4_JOB_PAGE.index[op & 0xFF]];
+    if (page == 0x00) return LMCV4_OPCODES[LMCV4_SYSTEM_PAGE.index[op & 0xFF]];
+
+    // Off-page opcodes are rare (internal markers), a scan is fine
+    for (size_t i = 1; i < LMCV4_OPCODE_COUNT; i++) {
+        if (LMCV4_OPCODES[i].opcode == op) return LMCV4_OPCODES[i];
+    }
+    return LMCV4_OPCODES[0];
+}
+
+inline const char* lmcv4OpcodeName(uint16_t op) {
+    return lmcv4Opcode(op).name;
+}
+
+#endif
@@ -19,6 +19,11 @@
 #define LMC_STATUS_UNK_40   (1 << 6) // 0x40
 #define LMC_STATUS_UNK_80   (1 << 7) // 0x80
 
+// Written over a system command that was handled out of band while it was
+// still in the stream buffer. In the job range, so the parser keeps job
+// order and then drops it like any other opcode with nothing to execute.
+#define LMC_OPCODE_HANDLED  0xFFFF
+
 // Command Structure (Packed to match wire protocol)
 struct BalorCommand {
     uint16_t opcode;
@@ -0,0 +1,124 @@
+#ifndef LASER_SET_POOL_H
+#define LASER_SET_POOL_H
+
+#include <Arduino.h>
+#include "XY2Galvo.h"
+
+// Interned, generation-tracked storage for the LaserSets the galvo queue points at.
+//
+// XY2Galvo keeps a pointer to the LaserSet of every queued vector, so a set must
+// stay untouched until the galvo has consumed the last vector that uses it.
+// Every vector pushed gets a sequence number; each entry remembers the last
+// sequence that used it. Every vector takes at least one LaserQueue slot and
+// the queue is FIFO, so with `avail` slots in use at most the newest `avail`
+// vectors can still be queued; anything older has left it. That needs no
+// knowledge of how XY2Galvo lays out its entries. The newest vector out of the
+// queue may still be drawing, so it is kept one vector longer.
+//
+// Executor core only.
+template <size_t Size>
+class LaserSetPool {
+public:
+    static const int NONE = -1;
+
+    struct Stats {
+        uint32_t vectors = 0;      // vectors committed
+        uint32_t allocations = 0;  // new entries created
+        uint32_t interned = 0;     // changes that matched a recent entry instead
+        uint32_t stalls = 0;       // vectors held back because the pool was full
+    };
+
+    LaserSetPool() {
+        for (size_t i = 0; i < Size; i++) _lastUse[i] = 0;
+    }
+
+    // Returns an entry holding exactly `set`, reusing a recent identical one if
+    // there is one. `keep` is an entry that must not be recycled (the other
+    // currently active handle), `keep2` another one. Returns NONE if every
+    // entry is still in use; the caller has to let the galvo drain and try again.
+    int acquire(const LaserSet& set, int keep, LaserQueue* queue, int keep2 = NONE) {
+        // Interning: settings often flip back and forth between a few values
+        for (size_t i = 0; i < RECENT; i++) {
+            int idx = _recent[i];
+            if (idx != NONE && memcmp(&_sets[idx], &set, sizeof(LaserSet)) == 0) {
+                _stats.interned++;
+                return idx;
+            }
+        }
+
+        int idx = findFree(keep, keep2, queue);
+        if (idx == NONE) {
+            _stats.stalls++;
+            return NONE;
+        }
+
+        _sets[idx] = set;
+        _lastUse[idx] = _seq; // live from now on, even before its first vector
+        _recent[_recentHead] = idx;
+        _recentHead = (_recentHead + 1) % RECENT;
+        _stats.allocations++;
+        return idx;
+    }
+
+    // Marks one more vector as using entry idx, returns the stable set
+    const LaserSet* use(int idx) {
+        _lastUse[idx] = ++_seq;
+        _stats.vectors++;
+        return &_sets[idx];
+    }
+
+    // Entries that may still be referenced by the LaserQueue
+    size_t occupancy() const {
+        size_t live = 0;
+        for (size_t i = 0; i < Size; i++) {
+            if (_lastUse[i] > _floor) live++;
+        }
+        return live;
+    }
+
+    // Share of vectors that went out without creating a new entry
+    float reuseRate() const {
+        if (_stats.vectors == 0) return 0.0f;
+        return 1.0f - (float)_stats.allocations / (float)_stats.vectors;
+    }
+
+    const Stats& stats() const { return _stats; }
+
+private:
+    static const size_t RECENT = 4;
+
+    LaserSet _sets[Size];
+    uint64_t _lastUse[Size];   // sequence of the last vector using the entry
+    uint64_t _seq = 0;         // vectors pushed so far (64 bit: never wraps)
+    uint64_t _floor = 0;       // every vector up to here has left the queue
+    size_t _cursor = 0;
+    int _recent[RECENT] = {NONE, NONE, NONE, NONE};
+    size_t _recentHead = 0;
+    Stats _stats;
+
+    void updateFloor(LaserQueue* queue) {
+        uint64_t queued = queue->avail() + 1; // + the one being drawn
+        if (_seq > queued && _seq - queued > _floor) _floor = _seq - queued;
+    }
+
+    int findFree(int keep, int keep2, LaserQueue* queue) {
+        updateFloor(queue);
+        for (size_t n = 0; n < Size; n++) {
+            size_t idx = _cursor;
+            _cursor = (_cursor + 1) % Size;
+            if ((int)idx != keep && (int)idx != keep2 && _lastUse[idx] <= _floor) {
+                forgetRecent((int)idx);
+                return (int)idx;
+            }
+        }
+        return NONE;
+    }
+
+    void forgetRecent(int idx) {
+        for (size_t i = 0; i < RECENT; i++) {
+            if (_recent[i] == idx) _recent[i] = NONE;
+        }
+    }
+};
+
+#endif
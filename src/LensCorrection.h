@@ -0,0 +1,180 @@
+#ifndef LENS_CORRECTION_H
+#define LENS_CORRECTION_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// Lens field distortion correction.
+//
+// Targets are mapped linearly onto the galvo, the F-theta lens is not quite
+// linear: towards the corners of the field marks land tenths of a millimetre
+// off. The correction is a grid of 17 x 17 (dx, dy) offsets in galvo steps,
+// one node every 4096 steps, usually measured from a marked test grid. Every
+// target is moved by the offset interpolated bilinearly from the four nodes
+// around it, in integer arithmetic.
+//
+// Inside a grid cell the correction is not affine, it bends straight lines
+// into parabolas, and where a line crosses into the next cell it kinks. A cut
+// is split at the cell edges it crosses, then each piece in halves until its
+// corrected middle is within the tolerance of the straight line between its
+// corrected ends. A parabola is furthest off its chord in the middle, so that
+// holds for the whole piece. At most MAX_PIECES pieces.
+//
+// Loaded over vendor opcode 0x00F4 and kept in flash by the driver; this is
+// the executor's copy (core 1).
+
+#define LMC_OPCODE_LENS 0x00F4
+
+// 0x00F4 params[0]. The reply has bytes 0-1 = nodes written since the last
+// LENS_CLEAR, byte 2 = LENS_REPLY_* flags.
+#define LENS_NODE   0 // params[1] = node, params[2] = dx, params[3] = dy (int16)
+#define LENS_CLEAR  1 // zero the grid being loaded
+#define LENS_APPLY  2 // switch the correction on with the grid loaded
+#define LENS_OFF    3 // switch it off, the grid is kept
+#define LENS_SAVE   4 // keep grid and on/off in flash, only while idle
+
+#define LENS_REPLY_ON   0x01 // correction on
+#define LENS_REPLY_BUSY 0x02 // not done, send it again (core 1 still taking the last grid, or a job running)
+#define LENS_REPLY_BAD  0x04 // unknown action, node out of range or offset too large
+
+#define LENS_GRID_SIZE  17
+#define LENS_GRID_NODES (LENS_GRID_SIZE * LENS_GRID_SIZE)
+#define LENS_CELL_SHIFT 12   // 4096 steps per cell
+#define LENS_MAX_OFFSET 4096 // steps, ~7 mm on a 110 mm field
+
+// Node (i, j) sits at x = i * 4096, y = j * 4096 (65536 standing in for the
+// last step) and is [j * LENS_GRID_SIZE + i]
+struct LensGrid {
+    int16_t dx[LENS_GRID_NODES];
+    int16_t dy[LENS_GRID_NODES];
+};
+
+// Galvo steps, 0..65535
+struct LensPoint {
+    int32_t x, y;
+};
+
+class LensCorrection {
+public:
+    static const int MAX_DEPTH = 4;   // halvings of one piece inside a cell
+    static const int MAX_PIECES = 64; // more than the 31 cells a cut can cross
+
+    struct Stats {
+        uint32_t points = 0; // targets corrected, cut ends and test points
+        uint32_t cuts = 0;
+        uint32_t split = 0;  // cuts that took more than one piece
+        uint32_t pieces = 0;
+    };
+
+    void load(const LensGrid& grid) {
+        memcpy(&_grid, &grid, sizeof(_grid));
+        _enabled = true;
+    }
+    void disable() { _enabled = false; }
+    bool enabled() const { return _enabled; }
+
+    // Largest deviation from straight a piece may keep, in steps. Points are
+    // whole steps, rounding can put a piece up to one more off.
+    void setTolerance(uint16_t steps) { _tolerance = steps; }
+    uint16_t tolerance() const { return _tolerance; }
+
+    LensPoint apply(int32_t x, int32_t y) {
+        _stats.points++;
+        size_t n = (size_t)(y >> LENS_CELL_SHIFT) * LENS_GRID_SIZE + (x >> LENS_CELL_SHIFT);
+        int32_t fx = x & ((1 << LENS_CELL_SHIFT) - 1);
+        int32_t fy = y & ((1 << LENS_CELL_SHIFT) - 1);
+        return {clamp(x + interpolate(_grid.dx, n, fx, fy)), clamp(y + interpolate(_grid.dy, n, fx, fy))};
+    }
+
+    // Corrects the cut from (x0, y0) to (x1, y1) into `out`: the end of each
+    // piece, the last one is the corrected (x1, y1). Returns the piece count.
+    int cut(int32_t x0, int32_t y0, int32_t x1, int32_t y1, LensPoint* out) {
+        int32_t dx = x1 - x0, dy = y1 - y0;
+        int32_t sx = (dx > 0) ? 1 : -1, sy = (dy > 0) ? 1 : -1;
+        // Pieces at the cell edges leave this many for halving
+        _room = MAX_PIECES - 1 - edges(x0, x1) - edges(y0, y1);
+
+        const int32_t cell = 1 << LENS_CELL_SHIFT;
+        int n = 0;
+        LensPoint a = {x0, y0};
+        LensPoint ca = apply(x0, y0);
+        // Next cell edge ahead on each axis
+        int32_t ex = ((dx > 0) ? (x0 >> LENS_CELL_SHIFT) + 1 : (x0 - 1) >> LENS_CELL_SHIFT) * cell;
+        int32_t ey = ((dy > 0) ? (y0 >> LENS_CELL_SHIFT) + 1 : (y0 - 1) >> LENS_CELL_SHIFT) * cell;
+        while (true) {
+            bool xEdge = dx != 0 && (ex - x1) * sx < 0;
+            bool yEdge = dy != 0 && (ey - y1) * sy < 0;
+            if (!xEdge && !yEdge) break;
+            // Nearer is the smaller share of the cut, |ex - x0| / |dx| against
+            // |ey - y0| / |dy|, compared crosswise
+            int64_t tx = (int64_t)(ex - x0) * sx * (dy * sy);
+            int64_t ty = (int64_t)(ey - y0) * sy * (dx * sx);
+            bool takeX = xEdge && (!yEdge || tx <= ty);
+            bool takeY = yEdge && (!xEdge || ty <= tx);
+            LensPoint b;
+            if (takeX) b = {ex, y0 + (int32_t)(((int64_t)(ex - x0) * dy) / dx)};
+            else b = {x0 + (int32_t)(((int64_t)(ey - y0) * dx) / dy), ey};
+            if (takeX) ex += sx * cell;
+            if (takeY) ey += sy * cell;
+
+            LensPoint cb = apply(b.x, b.y);
+            split(a, ca, b, cb, 0, out, n);
+            a = b;
+            ca = cb;
+        }
+        split(a, ca, {x1, y1}, apply(x1, y1), 0, out, n);
+
+        _stats.cuts++;
+        _stats.pieces += n;
+        if (n > 1) _stats.split++;
+        return n;
+    }
+
+    const Stats& stats() const { return _stats; }
+
+private:
+    LensGrid _grid = {};
+    bool _enabled = false;
+    uint16_t _tolerance = 2;
+    int _room = 0; // halvings the cut being split may still take
+    Stats _stats;
+
+    // Offset at fraction (fx, fy) of the cell whose low corner is node n,
+    // fractions and the first stage in 12-bit fixed point
+    static int32_t interpolate(const int16_t* d, size_t n, int32_t fx, int32_t fy) {
+        int32_t top = d[n] * (1 << LENS_CELL_SHIFT) + (d[n + 1] - d[n]) * fx;
+        int32_t bottom = d[n + LENS_GRID_SIZE] * (1 << LENS_CELL_SHIFT) +
+                         (d[n + LENS_GRID_SIZE + 1] - d[n + LENS_GRID_SIZE]) * fx;
+        int64_t v = (int64_t)top * (1 << LENS_CELL_SHIFT) + (int64_t)(bottom - top) * fy;
+        return (int32_t)((v + (1 << (2 * LENS_CELL_SHIFT - 1))) >> (2 * LENS_CELL_SHIFT));
+    }
+
+    static int32_t clamp(int32_t v) { return (v < 0) ? 0 : (v > 0xFFFF) ? 0xFFFF : v; }
+
+    // Cell edges strictly between v0 and v1 on one axis
+    static int edges(int32_t v0, int32_t v1) {
+        int32_t lo = (v0 < v1) ? v0 : v1, hi = (v0 < v1) ? v1 : v0;
+        return (hi > lo) ? ((hi - 1) >> LENS_CELL_SHIFT) - (lo >> LENS_CELL_SHIFT) : 0;
+    }
+
+    // a to b lies inside one cell
+    void split(LensPoint a, LensPoint ca, LensPoint b, LensPoint cb, int depth, LensPoint* out, int& n) {
+        if (depth < MAX_DEPTH && _room > 0) {
+            LensPoint m = {(a.x + b.x) >> 1, (a.y + b.y) >> 1};
+            LensPoint cm = apply(m.x, m.y);
+            int64_t ex = 2 * cm.x - ca.x - cb.x; // twice the deviation
+            int64_t ey = 2 * cm.y - ca.y - cb.y;
+            int64_t limit = 2 * (int64_t)_tolerance;
+            if (ex * ex + ey * ey > limit * limit) {
+                _room--;
+                split(a, ca, m, cm, depth + 1, out, n);
+                split(m, cm, b, cb, depth + 1, out, n);
+                return;
+            }
+        }
+        out[n++] = cb;
+    }
+};
+
+#endif
@@ -0,0 +1,224 @@
+#ifndef PATH_OPTIMIZER_H
+#define PATH_OPTIMIZER_H
+
+#include <stdint.h>
+#include "JobOp.h"
+
+// Streaming clean-up of the job ops between _jobQueue and the hardware hooks.
+//
+// LightBurn output has a fair amount of galvo work that draws nothing:
+// zero-length cuts, jumps to where the head already is, straight lines split
+// into collinear pieces, and the same parameter sent again before every
+// vector. Each of those costs a LaserQueue entry (and its delays) on the galvo.
+//
+// The optimizer holds back at most one move. Following ops are either folded
+// into it (dropped, or merged when collinear within the tolerance) or the held
+// move has to be executed first. Parameter ops that do not change anything are
+// dropped; any other parameter op first releases the held move, so a merge
+// never crosses a settings change. With tolerance 0 only exactly collinear
+// segments are merged and the output draws exactly what the input did.
+//
+// Executor side only (core 1), see LMCV4Executor::run().
+
+class PathOptimizer {
+public:
+    enum Action : uint8_t {
+        PASS = 0,    // execute the op as usual
+        ABSORBED,    // op dropped or merged, consume it without executing
+        FLUSH_FIRST, // execute held() first, then offer the op again
+    };
+
+    struct Stats {
+        uint32_t moves_in = 0;        // jumps and cuts offered
+        uint32_t moves_out = 0;       // jumps and cuts passed on to the hardware
+        uint32_t dropped_moves = 0;   // zero-length cuts, jumps to the current position
+        uint32_t merged_moves = 0;    // collinear pieces folded into the previous move
+        uint32_t dropped_params = 0;  // parameter ops that changed nothing
+        uint32_t saved_marks = 0;     // galvo mark segments saved
+        uint64_t saved_mark_us = 0;   // estimated mark time saved (polygon delay + tick rounding)
+    };
+
+    // Intermediate points remembered per merge run, to check them all against
+    // the merged chord. A run that reaches this is passed on.
+    static const int MAX_MERGED = 16;
+
+    // Rounding lost per galvo segment, half a 10 us tick on average
+    static const uint32_t SEGMENT_ROUNDING_US = 5;
+
+    void setEnabled(bool enabled) {
+        _enabled = enabled;
+        if (!enabled) reset();
+    }
+    bool enabled() const { return _enabled; }
+
+    // Max distance (galvo steps) a dropped intermediate point may lie off the
+    // merged segment
+    void setTolerance(uint16_t steps) { _tolerance = steps; }
+
+    // Forget everything, including a held move (abort)
+    void reset() {
+        if (_held) {
+            _x = _startX;
+            _y = _startY;
+        }
+        _lastKind = OP_JUMP;
+        _held = false;
+        _merged = 0;
+        _knownMask = 0;
+    }
+
+    const Stats& stats() const { return _stats; }
+
+    bool holding() const { return _held; }
+    const JobOp& held() const { return _heldOp; }
+
+    // The held move went to the hardware
+    void released() {
+        _held = false;
+        _merged = 0;
+        _stats.moves_out++;
+    }
+
+    // The head was moved without going through offer() (a hatch fill or a
+    // curve), later moves are compared with where it is now. `kind`: how it
+    // got there, OP_CUT if the laser was marking.
+    void movedTo(uint16_t x, uint16_t y, uint8_t kind = OP_JUMP) {
+        _x = x;
+        _y = y;
+        _lastKind = kind;
+    }
+
+    Action offer(const JobOp& op) {
+        bool move = (op.kind == OP_JUMP || op.kind == OP_CUT);
+        if (!_enabled) {
+            // Keep following the position so enabling it later starts right
+            if (move) {
+                _x = op.move.x;
+                _y = op.move.y;
+                _lastKind = op.kind;
+            }
+            return PASS;
+        }
+
+        if (move) return offerMove(op);
+
+        if (isSetter(op.kind)) {
+            uint32_t bit = 1u << op.kind;
+            if ((_knownMask & bit) && _known[op.kind] == op.param.raw) {
+                _stats.dropped_params++;
+                return ABSORBED;
+            }
+            if (_held) return FLUSH_FIRST;
+            _knownMask |= bit;
+            _known[op.kind] = op.param.raw;
+            if (op.kind == OP_POLY_DELAY) _polyDelayUs = op.param.raw;
+            return PASS;
+        }
+
+        // Laser control, end of list, ...: keep the order exactly
+        if (_held) return FLUSH_FIRST;
+        return PASS;
+    }
+
+private:
+    bool _enabled = true;
+    uint16_t _tolerance = 0;
+
+    bool _held = false;
+    JobOp _heldOp;
+    uint16_t _startX = 0x8000, _startY = 0x8000; // where the held move starts
+    int _merged = 0;
+    uint16_t _mergedX[MAX_MERGED];
+    uint16_t _mergedY[MAX_MERGED];
+
+    uint16_t _x = 0x8000, _y = 0x8000; // end of the last move passed on or held
+    uint8_t _lastKind = OP_JUMP;
+
+    uint32_t _knownMask = 0; // which _known[] entries are valid
+    uint16_t _known[OP_KIND_COUNT];
+    uint16_t _polyDelayUs = 0;
+
+    Stats _stats;
+
+    static bool isSetter(uint8_t kind) {
+        return kind == OP_POWER || kind == OP_FREQUENCY || kind == OP_MARK_SPEED || kind == OP_JUMP_SPEED ||
+               kind == OP_END_DELAY || kind == OP_POLY_DELAY || kind == OP_LASER_ON_DELAY ||
+               kind == OP_LASER_OFF_DELAY || kind == OP_JUMP_DELAY;
+    }
+
+    void savedSegment(uint8_t kind) {
+        if (kind != OP_CUT) return;
+        _stats.saved_marks++;
+        _stats.saved_mark_us += _polyDelayUs + SEGMENT_ROUNDING_US;
+    }
+
+    Action offerMove(const JobOp& op) {
+        _stats.moves_in++;
+
+        // Goes nowhere: a jump to where we are, or a cut of zero length in
+        // the middle of a cut path. A zero-length cut after a jump is a dot,
+        // that one is kept.
+        if (op.move.x == _x && op.move.y == _y && (op.kind == OP_JUMP || _lastKind == OP_CUT)) {
+            _stats.dropped_moves++;
+            savedSegment(op.kind);
+            return ABSORBED;
+        }
+        _lastKind = op.kind;
+
+        if (_held) {
+            if (op.kind != _heldOp.kind || !extends(op.move.x, op.move.y)) return FLUSH_FIRST;
+
+            _mergedX[_merged] = _heldOp.move.x;
+            _mergedY[_merged] = _heldOp.move.y;
+            _merged++;
+            _heldOp.move = op.move;
+            _heldOp.flags = op.flags; // the corner is now at the new end
+            _x = op.move.x;
+            _y = op.move.y;
+            _stats.merged_moves++;
+            savedSegment(op.kind);
+            return ABSORBED;
+        }
+
+        _held = true;
+        _heldOp = op;
+        _startX = _x;
+        _startY = _y;
+        _merged = 0;
+        _x = op.move.x;
+        _y = op.move.y;
+        return ABSORBED;
+    }
+
+    // True if replacing the held move's end with (x, y) keeps the held end and
+    // every point merged before within tolerance of the new chord
+    bool extends(uint16_t x, uint16_t y) const {
+        if (_merged >= MAX_MERGED) return false;
+
+        int32_t cx = (int32_t)x - _startX;
+        int32_t cy = (int32_t)y - _startY;
+        int32_t hx = (int32_t)_heldOp.move.x - _startX;
+        int32_t hy = (int32_t)_heldOp.move.y - _startY;
+
+        // Must keep going the same way, no folding back over the held segment
+        if ((int64_t)hx * ((int32_t)x - _heldOp.move.x) + (int64_t)hy * ((int32_t)y - _heldOp.move.y) <= 0) return false;
+
+        float len2 = (float)cx * cx + (float)cy * cy;
+        float limit = (float)_tolerance * _tolerance * len2;
+        if (!nearChord(hx, hy, cx, cy, limit)) return false;
+        for (int i = 0; i < _merged; i++) {
+            if (!nearChord((int32_t)_mergedX[i] - _startX, (int32_t)_mergedY[i] - _startY, cx, cy, limit)) return false;
+        }
+        return true;
+    }
+
+    // |p x c|^2 <= limit, i.e. p within tolerance of the line through 0 and c
+    static bool nearChord(int32_t px, int32_t py, int32_t cx, int32_t cy, float limit) {
+        int64_t cross = (int64_t)px * cy - (int64_t)py * cx;
+        if (cross == 0) return true;
+        float c = (float)cross;
+        return c * c <= limit;
+    }
+};
+
+#endif
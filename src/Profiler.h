@@ -0,0 +1,111 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <Arduino.h>
+#include "JobOp.h"
+
+// Cycle-count profiling of the driver hot paths.
+//
+// Each probe keeps count/sum/min/max and a log2 histogram of its cycle counts.
+// A probe is only ever written from one core, so there is no locking; readers
+// on the other core may see a slightly stale or mixed set, which is fine for
+// statistics. Read live over USB with vendor opcode 0x00F1 (see
+// LMCV4Driver::handleSystemCommand) or print with LMCV4Driver::printProfile().
+//
+// Build with -DLMCV4_PROFILE=0 to compile every probe out.
+
+#ifndef LMCV4_PROFILE
+#define LMCV4_PROFILE 1
+#endif
+
+enum ProfileProbe : uint8_t {
+    PROF_UPDATE = 0,      // core 0: whole update() pass
+    PROF_PARSE,           // core 0: processIncomingStream()
+    PROF_SYSTEM,          // core 0: handleSystemCommand()
+    PROF_HW_TRAVEL,       // core 1: hw_travel() override
+    PROF_HW_CUT,          // core 1: hw_cut() override
+    PROF_EXEC_BASE,       // core 1: executeCommand(), one probe per JobOpKind
+    PROF_PROBE_COUNT = PROF_EXEC_BASE + OP_KIND_COUNT
+};
+
+// Histogram bucket i counts samples below 2^(i + 7) cycles, the last one the rest
+#define PROF_HIST_BUCKETS 8
+
+struct ProfileStats {
+    uint32_t count = 0;
+    uint64_t sum = 0;
+    uint32_t min = 0xFFFFFFFF;
+    uint32_t max = 0;
+    uint32_t hist[PROF_HIST_BUCKETS] = {};
+
+    uint32_t mean() const { return count ? (uint32_t)(sum / count) : 0; }
+};
+
+inline uint32_t profileCycles() {
+    return rp2040.getCycleCount();
+}
+
+// Cycles per microsecond, for turning the numbers above into time
+inline uint32_t profileCyclesPerUs() {
+#ifdef F_CPU
+    return F_CPU / 1000000;
+#else
+    return 150;
+#endif
+}
+
+inline const char* profileProbeName(uint8_t probe) {
+    static const char* const names[PROF_EXEC_BASE] = {"update", "parse", "system", "hw_travel", "hw_cut"};
+    if (probe < PROF_EXEC_BASE) return names[probe];
+    static const char* const kinds[OP_KIND_COUNT] = {
+        "exec:nop",         "exec:jump",        "exec:cut",           "exec:laser_ctrl", "exec:power",
+        "exec:frequency",   "exec:mark_speed",  "exec:jump_speed",    "exec:end_delay",  "exec:poly_delay",
+        "exec:laser_on_dly", "exec:laser_off_dly", "exec:jump_delay", "exec:end_of_list",
+        "exec:hatch",       "exec:arc",         "exec:cubic",
+    };
+    if (probe < PROF_PROBE_COUNT) return kinds[probe - PROF_EXEC_BASE];
+    return "?";
+}
+
+class Profiler {
+public:
+    void add(uint8_t probe, uint32_t cycles) {
+        ProfileStats& s = _stats[probe];
+        s.count++;
+        s.sum += cycles;
+        if (cycles < s.min) s.min = cycles;
+        if (cycles > s.max) s.max = cycles;
+        int bucket = (cycles < 128) ? 0 : (31 - __builtin_clz(cycles)) - 6;
+        if (bucket >= PROF_HIST_BUCKETS) bucket = PROF_HIST_BUCKETS - 1;
+        s.hist[bucket]++;
+    }
+
+    const ProfileStats& stats(uint8_t probe) const { return _stats[probe]; }
+
+    void reset() {
+        for (size_t i = 0; i < PROF_PROBE_COUNT; i++) _stats[i] = ProfileStats();
+    }
+
+private:
+    ProfileStats _stats[PROF_PROBE_COUNT];
+};
+
+// Times the rest of the enclosing scope into `probe`
+class ProfileScope {
+public:
+    ProfileScope(Profiler& profiler, uint8_t probe) : _profiler(profiler), _probe(probe), _start(profileCycles()) {}
+    ~ProfileScope() { _profiler.add(_probe, profileCycles() - _start); }
+
+private:
+    Profiler& _profiler;
+    uint8_t _probe;
+    uint32_t _start;
+};
+
+#if LMCV4_PROFILE
+#define PROFILE_SCOPE(profiler, probe) ProfileScope _profileScope(profiler, probe)
+#else
+#define PROFILE_SCOPE(profiler, probe) do {} while (0)
+#endif
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef PUBLISHED_H
+#define PUBLISHED_H
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <type_traits>
+
+// Single-writer snapshot shared between cores (sequence lock).
+//
+// The writer never blocks. A reader that races with a publish() simply retries,
+// so it always gets a value that was published as a whole, never half of one.
+// Keep T small: readers spin for as long as one copy of T takes.
+template <typename T>
+class Published {
+    static_assert(std::is_trivially_copyable<T>::value, "Published values are copied with memcpy");
+
+public:
+    Published() : _seq(0) {}
+
+    // Writer side only
+    void publish(const T& value) {
+        uint32_t seq = _seq.load(std::memory_order_relaxed);
+        _seq.store(seq + 1, std::memory_order_relaxed); // odd: write in progress
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy((void*)&_value, &value, sizeof(T));
+        _seq.store(seq + 2, std::memory_order_release);
+    }
+
+    // Any reader, any core
+    T read() const {
+        T out;
+        uint32_t before, after;
+        do {
+            before = _seq.load(std::memory_order_acquire);
+            memcpy(&out, (const void*)&_value, sizeof(T));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = _seq.load(std::memory_order_relaxed);
+        } while ((before & 1) || before != after);
+        return out;
+    }
+
+private:
+    std::atomic<uint32_t> _seq;
+    volatile T _value;
+};
+
+#endif
@@ -0,0 +1,229 @@
+#ifndef RP2350_LASER_H
+#define RP2350_LASER_H
+
+#include <Arduino.h>
+#include "LMCV4Executor.h"
+#include "XY2Galvo.h"
+#include "LaserSetPool.h"
+#include "JumpSettle.h"
+#define FIELD_SIZE_MM  110.0
+#define GALVO_RANGE 65536.0f
+#define UPDATE_RATE_HZ 100000.0f // 1/10us
+
+extern LaserSet laser_set[];
+
+// LMCV4 hardware layer for the RP2350 driving an XY2-100 galvo.
+// Kept out of main.cpp so the native benchmark exercises the same code.
+class RP2350Laser : public LMCV4Executor<RP2350Laser>
+{
+    friend class LMCV4Executor<RP2350Laser>;
+
+public:
+    typedef LaserSetPool<LMCV4Config::SETTINGS_POOL_SIZE> SettingsPool;
+
+private:
+    SettingsPool _settingsPool;
+    const float SPEED_FACTOR = GALVO_RANGE / (FIELD_SIZE_MM * UPDATE_RATE_HZ);
+    // 2. Current State (Pending changes from USB)
+    LaserSet _pendingMarkSettings = laser_set[2];    // Holds current power, freq, mark speed for marking
+    LaserSet _pendingJumpSettings = laser_set[0];    // Holds current power, freq, mark speed for jumps
+    // Pool entries the galvo is currently being fed, NONE until the first vector
+    // or after a hw_set* call changed the pending settings
+    int _markEntry = SettingsPool::NONE;
+    int _jumpEntry = SettingsPool::NONE;
+    // Jump settle time (delay_m of the jump set) by jump length
+    JumpSettleTable _jumpSettle;
+    
+    // Returns null if the pool is full and the galvo has to drain first
+    const LaserSet *commitLaserSet(bool is_marking)
+    {
+        // Only a settings change costs a copy, otherwise vectors share the entry
+        if (is_marking)
+        {
+            if (_markEntry == SettingsPool::NONE)
+                _markEntry = _settingsPool.acquire(_pendingMarkSettings, _jumpEntry, _queue);
+            if (_markEntry == SettingsPool::NONE) return nullptr;
+            return _settingsPool.use(_markEntry);
+        }
+        if (_jumpEntry == SettingsPool::NONE)
+            _jumpEntry = _settingsPool.acquire(_pendingJumpSettings, _markEntry, _queue);
+        if (_jumpEntry == SettingsPool::NONE) return nullptr;
+        return _settingsPool.use(_jumpEntry);
+    }
+
+    // Setters only invalidate the entry when the value actually changes
+    template <typename T>
+    void updateMark(T &field, T value)
+    {
+        if (field == value) return;
+        field = value;
+        _markEntry = SettingsPool::NONE;
+    }
+    template <typename T>
+    void updateJump(T &field, T value)
+    {
+        if (field == value) return;
+        field = value;
+        _jumpEntry = SettingsPool::NONE;
+    }
+
+public:
+    RP2350Laser()
+    {
+        // Speeds arrive already converted to galvo steps per tick
+        _galvoSpeedFactor = SPEED_FACTOR;
+    }
+
+    // Shape of the jump settle time over jump length, see JumpSettle.h.
+    // Call before the executor is running.
+    bool setJumpSettle(const JumpSettlePoint* points, int count) { return _jumpSettle.setPoints(points, count); }
+
+    const SettingsPool::Stats &settingsPoolStats() const { return _settingsPool.stats(); }
+    size_t settingsPoolOccupancy() const { return _settingsPool.occupancy(); }
+    float settingsPoolReuseRate() const { return _settingsPool.reuseRate(); }
+
+protected:
+    bool hw_travel(float tx, float ty)
+    {
+        // Mirrors move with laser OFF, then settle for as long as this jump needs.
+        // state.x/y is still where the jump starts.
+        uint16_t settle = _jumpSettle.ticks((int32_t)tx + 32768 - state.x, (int32_t)ty + 32768 - state.y);
+        updateJump(_pendingJumpSettings.delay_m, (decltype(_pendingJumpSettings.delay_m))settle);
+        const LaserSet* useThisSet = commitLaserSet(false);
+        if (!useThisSet) return false;
+        // Nothing is marked on the way, only where it lands needs correcting
+        if (_lens.enabled())
+            _galvo->drawTo(toGalvo(_lens.apply((int32_t)tx + 32768, (int32_t)ty + 32768)), (const LaserSet&)*useThisSet);
+        else
+            _galvo->drawTo({tx, ty}, (const LaserSet&)*useThisSet);
+        // Serial1.printf("Jump: %d, %d\n", state.x, state.y);
+        return true;
+    }
+
+    bool hw_cut(float tx, float ty)
+    {
+        // Mirrors move with laser ON
+        if (_lens.enabled()) return cutCorrected((int32_t)tx + 32768, (int32_t)ty + 32768);
+        const LaserSet* useThisSet = commitLaserSet(true);
+        if (!useThisSet) return false;
+        _galvo->drawTo({tx, ty}, (const LaserSet&)*useThisSet);
+        // Serial1.printf("Mark: %d, %d\r\n", state.x, state.y);
+        return true;
+    }
+
+    void hw_laserControl(bool on)
+    {
+        digitalWrite(LED_BUILTIN, on ? HIGH : LOW);
+        Point here = _lens.enabled() ? toGalvo(_lens.apply(state.x, state.y))
+                                     : Point{static_cast<float>(state.x) - (float)32768.0, static_cast<float>(state.y) - (float)32768.0};
+        if (!on)
+            _galvo->moveTo(here);
+        else
+            _galvo->drawTo(here, laser_set[1]);
+        // Serial1.println(on ? "Laser ON" : "Laser OFF");
+    }
+
+    void hw_setPower(uint16_t power)
+    {
+        uint pattern = 0x03ff >> map(power, 0, 4095, 10, 0);
+        updateMark(_pendingMarkSettings.pattern, (decltype(_pendingMarkSettings.pattern))pattern);
+        //Serial1.printf("Power: %d\r\n", power);
+    }
+
+    void hw_setFrequency(uint16_t /*period*/) {}
+    void hw_setMarkSpeed(float stepPerTick)
+    {
+        updateMark(_pendingMarkSettings.speed, (decltype(_pendingMarkSettings.speed))stepPerTick);
+    }
+    void hw_setJumpSpeed(float stepPerTick)
+    {
+        updateJump(_pendingJumpSettings.speed, (decltype(_pendingJumpSettings.speed))stepPerTick);
+    }
+
+    void hw_getPos(uint16_t &live_x, uint16_t &live_y)
+    {
+        // Report logical position for now
+        live_x = state.x;
+        live_y = state.y;
+    }
+
+    uint16_t hw_getInputs()
+    {
+        return 0x0000;
+    }
+
+   
+    void hw_abort() {
+        // Pool entries free themselves once the galvo queue is seen empty
+        _galvo->requestAbort();
+    }  
+    void hw_setPulseWidth(uint16_t us) {
+        state.pulseWidth = us;
+    }
+    void hw_setLaserOnDelay(uint16_t us){
+        state.laser_on_delay = us;
+        updateMark(_pendingMarkSettings.delay_a, (decltype(_pendingMarkSettings.delay_a))(us/10));
+    }
+    void hw_setLaserOffDelay(uint16_t us){
+        state.laser_off_delay = us;
+        updateMark(_pendingMarkSettings.delay_e, (decltype(_pendingMarkSettings.delay_e))(us/10));
+    }
+    void hw_setEndDelay(uint16_t us){
+        state.end_delay = us;
+        
+    }
+    void hw_setJumpDelay(uint16_t us){
+        state.jump_delay = us;
+        _jumpSettle.setJumpDelay(us);
+    }
+    void hw_setPolygonDelay(uint16_t us){
+        state.poly_delay = us;
+        applyPolygonDelay();
+    }
+    // Per cut, from the corner planner: only the share of the polygon delay
+    // the corner at the end of this cut needs goes into delay_m
+    void hw_setCornerDelay(uint8_t quarters){
+        if (quarters == _cornerQuarters) return;
+        _cornerQuarters = quarters;
+        applyPolygonDelay();
+    }
+
+private:
+    uint8_t _cornerQuarters = JOB_CORNER_FULL;
+
+    static Point toGalvo(const LensPoint& p) { return {(float)(p.x - 32768), (float)(p.y - 32768)}; }
+
+    // A cut through the lens correction, in as many pieces as it takes to stay
+    // straight. All of them go out or none, so a retry starts over cleanly.
+    bool cutCorrected(int32_t x, int32_t y)
+    {
+        LensPoint ends[LensCorrection::MAX_PIECES];
+        int pieces = _lens.cut(state.x, state.y, x, y, ends);
+        if (_queue->free() <= (uint)pieces) return false;
+
+        // The joints inside the cut go straight on, they get no polygon delay
+        int straight = SettingsPool::NONE;
+        if (pieces > 1)
+        {
+            LaserSet set = _pendingMarkSettings;
+            set.delay_m = 0;
+            straight = _settingsPool.acquire(set, _jumpEntry, _queue, _markEntry);
+            if (straight == SettingsPool::NONE) return false;
+        }
+        if (_markEntry == SettingsPool::NONE)
+            _markEntry = _settingsPool.acquire(_pendingMarkSettings, _jumpEntry, _queue, straight);
+        if (_markEntry == SettingsPool::NONE) return false;
+
+        for (int i = 0; i + 1 < pieces; i++)
+            _galvo->drawTo(toGalvo(ends[i]), (const LaserSet&)*_settingsPool.use(straight));
+        _galvo->drawTo(toGalvo(ends[pieces - 1]), (const LaserSet&)*_settingsPool.use(_markEntry));
+        return true;
+    }
+
+    void applyPolygonDelay(){
+        uint32_t us = (uint32_t)state.poly_delay * _cornerQuarters / JOB_CORNER_FULL;
+        updateMark(_pendingMarkSettings.delay_m, (decltype(_pendingMarkSettings.delay_m))(us/10));
+    }
+};
+
+#endif
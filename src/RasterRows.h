@@ -0,0 +1,107 @@
+#ifndef RASTER_ROWS_H
+#define RASTER_ROWS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// Raster rows (vendor extension), shared by the firmware and host tools (no
+// Arduino dependencies).
+//
+// A photo sent as plain records costs a jump and a cut per run of lit pixels,
+// and a power record per pixel when grey levels vary: USB and parsing run out
+// long before the galvo does. A raster record carries one scan line as its
+// pixels instead:
+//
+//   header   one 12-byte record: opcode 0x80F1, params[0] = x, params[1] = y
+//            where the first pixel starts, params[2] = pixels, params[3] =
+//            pitch (int16, steps per pixel, negative scans backwards),
+//            params[4] = RASTER_* flags
+//   payload  the pixels, 1 bit each (MSB first, 1 = mark), or with
+//            RASTER_8BIT one byte each (0 = off, 255 = the power set with
+//            0x8012), zero padding up to a multiple of 12 bytes
+//
+// The driver turns a row into the jump, cut and power records the host would
+// have sent: a jump to the start of each run of equal lit pixels, its power
+// (8-bit rows) and a cut to its end; an 8-bit row ends with the power set back
+// to what it was. Every row is shifted back along its scan direction by the
+// distance the mirrors lag behind at the mark speed (setRasterLineLag()), so
+// rows scanned in both directions line up.
+//
+// A raster record has to go out in one piece, and like bulk vector records
+// (BulkVectors.h) it is only understood once the host switched it on with
+// vendor opcode 0x00F3 (params[0] = LMC_EXT_RASTER).
+
+#define LMC_OPCODE_RASTER_ROW 0x80F1
+#define LMC_EXT_RASTER        0x0002
+
+#define RASTER_8BIT     0x0001 // one byte per pixel, else one bit
+#define RASTER_VERTICAL 0x0002 // scan along Y, else along X
+
+#define RASTER_RECORD_SIZE 12
+#define RASTER_MAX_PAYLOAD 240 // 20 records: 1920 1-bit or 240 8-bit pixels
+
+inline size_t rasterPayloadBytes(size_t pixels, uint16_t flags) {
+    return (flags & RASTER_8BIT) ? pixels : (pixels + 7) / 8;
+}
+
+// Bytes of header + padded payload
+inline size_t rasterRecordBytes(size_t pixels, uint16_t flags) {
+    size_t payload = rasterPayloadBytes(pixels, flags);
+    return RASTER_RECORD_SIZE + (payload + RASTER_RECORD_SIZE - 1) / RASTER_RECORD_SIZE * RASTER_RECORD_SIZE;
+}
+
+// Pixel i of a payload as 0..255 (1-bit pixels are 0 or 255)
+inline uint8_t rasterPixel(const uint8_t* payload, size_t i, uint16_t flags) {
+    if (flags & RASTER_8BIT) return payload[i];
+    return (payload[i >> 3] & (0x80 >> (i & 7))) ? 255 : 0;
+}
+
+// Walks a row as runs of equal pixels, skipping the blank ones
+class RasterRuns {
+public:
+    RasterRuns(const uint8_t* payload, size_t pixels, uint16_t flags)
+        : _payload(payload), _pixels(pixels), _flags(flags) {}
+
+    // Next lit run [start, end) and its value, false at the end of the row
+    bool next(size_t& start, size_t& end, uint8_t& value) {
+        while (_pos < _pixels && rasterPixel(_payload, _pos, _flags) == 0) _pos++;
+        if (_pos == _pixels) return false;
+        start = _pos;
+        value = rasterPixel(_payload, _pos++, _flags);
+        while (_pos < _pixels && rasterPixel(_payload, _pos, _flags) == value) _pos++;
+        end = _pos;
+        return true;
+    }
+
+private:
+    const uint8_t* _payload;
+    size_t _pixels;
+    uint16_t _flags;
+    size_t _pos = 0;
+};
+
+// Reference encoder: writes header, payload and padding (little endian, like
+// every record) for a row of `count` pixels given one byte each (1-bit rows:
+// anything but 0 marks). `out` needs room for rasterRecordBytes(). Returns
+// the bytes written, 0 if the row does not fit one record.
+inline size_t rasterWriteRow(uint8_t* out, uint16_t x, uint16_t y, int16_t pitch, uint16_t flags,
+                             const uint8_t* pixels, size_t count) {
+    size_t payload = rasterPayloadBytes(count, flags);
+    if (payload > RASTER_MAX_PAYLOAD) return 0;
+    size_t total = rasterRecordBytes(count, flags);
+    memset(out, 0, total);
+    const uint16_t header[6] = {LMC_OPCODE_RASTER_ROW, x, y, (uint16_t)count, (uint16_t)pitch, flags};
+    for (int i = 0; i < 6; i++) {
+        out[2 * i] = header[i] & 0xFF;
+        out[2 * i + 1] = header[i] >> 8;
+    }
+    uint8_t* data = out + RASTER_RECORD_SIZE;
+    for (size_t i = 0; i < count; i++) {
+        if (flags & RASTER_8BIT) data[i] = pixels[i];
+        else if (pixels[i]) data[i >> 3] |= 0x80 >> (i & 7);
+    }
+    return total;
+}
+
+#endif
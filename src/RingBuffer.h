@@ -1,45 +1,155 @@
 #ifndef RING_BUFFER_H
 #define RING_BUFFER_H
 
-#include <Arduino.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+#include <type_traits>
 
+// Single-producer / single-consumer ring buffer.
+//
+// Safe to use across the two RP2350 cores (or an IRQ and the main loop) as long
+// as exactly one context pushes and exactly one context pops. The producer only
+// ever writes _head, the consumer only ever writes _tail; both are free-running
+// counters that are masked on access, so there is no shared count to race on.
+//
+// Producer side: push(), push_span(), reserve_contiguous(), commit(), space(),
+//                isFull(), uncommit() (same context as the consumer only)
+// Consumer side: pop(), pop_span(), peek(), peekAt(), pokeAt(),
+//                peek_contiguous(), consume(), clear()
+// available()/isEmpty() are safe from either side (the answer may be stale).
 template <typename T, size_t Size>
 class RingBuffer {
+    static_assert(Size > 0 && (Size & (Size - 1)) == 0, "RingBuffer Size must be a power of two");
+    static_assert(std::is_trivially_copyable<T>::value, "RingBuffer elements are copied with memcpy");
+
 public:
-    RingBuffer() : _head(0), _tail(0), _count(0) {}
+    RingBuffer() : _head(0), _tail(0) {}
 
     bool push(const T& item) {
-        if (_count >= Size) return false; // Buffer full
-        _buffer[_head] = item;
-        _head = (_head + 1) % Size;
-        _count++;
+        size_t head = _head.load(std::memory_order_relaxed);
+        if (head - _tail.load(std::memory_order_acquire) >= Size) return false; // Buffer full
+        _buffer[head & MASK] = item;
+        _head.store(head + 1, std::memory_order_release);
         return true;
     }
 
     bool pop(T& item) {
-        if (_count == 0) return false; // Buffer empty
-        item = _buffer[_tail];
-        _tail = (_tail + 1) % Size;
-        _count--;
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        if (_head.load(std::memory_order_acquire) == tail) return false; // Buffer empty
+        item = _buffer[tail & MASK];
+        _tail.store(tail + 1, std::memory_order_release);
         return true;
     }
 
-    bool peek(T& item) {
-        if (_count == 0) return false;
-        item = _buffer[_tail];
-        return true;
+    bool peek(T& item) const {
+        return peekAt(0, item);
     }
-    
+
     // Peek at an offset without removing
-    bool peekAt(size_t offset, T& item) {
-        if (offset >= _count) return false;
-        size_t index = (_tail + offset) % Size;
-        item = _buffer[index];
+    bool peekAt(size_t offset, T& item) const {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        if (offset >= _head.load(std::memory_order_acquire) - tail) return false;
+        item = _buffer[(tail + offset) & MASK];
         return true;
     }
 
+    // Overwrites an item that is still queued. The producer never touches
+    // queued items, so this is as safe as peekAt() from the consumer side.
+    bool pokeAt(size_t offset, const T& item) {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        if (offset >= _head.load(std::memory_order_acquire) - tail) return false;
+        _buffer[(tail + offset) & MASK] = item;
+        return true;
+    }
+
+    // Copies up to n items in, returns how many actually fit
+    size_t push_span(const T* src, size_t n) {
+        size_t head = _head.load(std::memory_order_relaxed);
+        size_t room = Size - (head - _tail.load(std::memory_order_acquire));
+        if (n > room) n = room;
+        if (n == 0) return 0;
+
+        size_t idx = head & MASK;
+        size_t first = Size - idx;
+        if (first > n) first = n;
+        memcpy(&_buffer[idx], src, first * sizeof(T));
+        if (n > first) memcpy(&_buffer[0], src + first, (n - first) * sizeof(T));
+
+        _head.store(head + n, std::memory_order_release);
+        return n;
+    }
+
+    // Points ptr at the next free slot and returns how many items can be written
+    // there without wrapping. Publish them with commit(). Lets a producer (e.g.
+    // a USB read) fill the ring directly instead of going through a temp buffer.
+    size_t reserve_contiguous(T*& ptr) {
+        size_t head = _head.load(std::memory_order_relaxed);
+        size_t room = Size - (head - _tail.load(std::memory_order_acquire));
+        size_t idx = head & MASK;
+        size_t first = Size - idx;
+        ptr = &_buffer[idx];
+        return (room < first) ? room : first;
+    }
+
+    // Publishes n items written after reserve_contiguous()
+    void commit(size_t n) {
+        _head.store(_head.load(std::memory_order_relaxed) + n, std::memory_order_release);
+    }
+
+    // Takes back the n newest items. Only for a ring whose producer and
+    // consumer are the same context, nothing else may be reading them.
+    void uncommit(size_t n) {
+        size_t head = _head.load(std::memory_order_relaxed);
+        size_t count = head - _tail.load(std::memory_order_relaxed);
+        if (n > count) n = count;
+        _head.store(head - n, std::memory_order_release);
+    }
+
+    // Copies up to n items out, returns how many were removed
+    size_t pop_span(T* dst, size_t n) {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        size_t count = _head.load(std::memory_order_acquire) - tail;
+        if (n > count) n = count;
+        if (n == 0) return 0;
+
+        size_t idx = tail & MASK;
+        size_t first = Size - idx;
+        if (first > n) first = n;
+        memcpy(dst, &_buffer[idx], first * sizeof(T));
+        if (n > first) memcpy(dst + first, &_buffer[0], (n - first) * sizeof(T));
+
+        _tail.store(tail + n, std::memory_order_release);
+        return n;
+    }
+
+    // Points ptr at the oldest item and returns how many items can be read
+    // from there without wrapping. Release them with consume().
+    size_t peek_contiguous(const T*& ptr) const {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        size_t count = _head.load(std::memory_order_acquire) - tail;
+        size_t idx = tail & MASK;
+        size_t first = Size - idx;
+        ptr = &_buffer[idx];
+        return (count < first) ? count : first;
+    }
+
+    // Drops n items from the consumer side (after peek/peek_contiguous)
+    void consume(size_t n) {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        size_t count = _head.load(std::memory_order_acquire) - tail;
+        if (n > count) n = count;
+        _tail.store(tail + n, std::memory_order_release);
+    }
+
     size_t available() const {
-        return _count;
+        // Tail first: head can only be ahead of any tail we have already seen
+        size_t tail = _tail.load(std::memory_order_acquire);
+        return _head.load(std::memory_order_acquire) - tail;
+    }
+
+    size_t space() const {
+        return Size - available();
     }
 
     size_t capacity() const {
@@ -47,24 +157,25 @@ public:
     }
 
     bool isFull() const {
-        return _count == Size;
+        return available() >= Size;
     }
 
     bool isEmpty() const {
-        return _count == 0;
+        return available() == 0;
     }
 
+    // Discards everything currently queued. Consumer side only: the producer
+    // may keep pushing while this runs and those items are kept.
     void clear() {
-        _head = 0;
-        _tail = 0;
-        _count = 0;
+        _tail.store(_head.load(std::memory_order_acquire), std::memory_order_release);
     }
 
 private:
+    static constexpr size_t MASK = Size - 1;
+
     T _buffer[Size];
-    volatile size_t _head;
-    volatile size_t _tail;
-    volatile size_t _count;
+    std::atomic<size_t> _head; // written by producer only
+    std::atomic<size_t> _tail; // written by consumer only
 };
 
-#endif
\ No newline at end of file
+#endif
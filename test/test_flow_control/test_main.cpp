@@ -0,0 +1,101 @@
+// FlowControl (src/FlowControl.h): READY hysteresis on the buffer watermarks.
+//
+//   pio test -e native -f test_flow_control
+
+#include <unity.h>
+#include <FlowControl.h>
+#include <random>
+
+void setUp() {}
+void tearDown() {}
+
+static void setAll(FlowControl& flow) {
+    flow.setWatermarks(FLOW_STREAM, 80, 40);
+    flow.setWatermarks(FLOW_JOB, 1000, 500);
+    flow.setWatermarks(FLOW_GALVO, 900, 100);
+}
+
+static void test_drops_at_high_and_returns_at_low() {
+    FlowControl flow;
+    setAll(flow);
+    uint16_t fill[FLOW_BUFFER_COUNT] = {79, 999, 899};
+    TEST_ASSERT_TRUE(flow.update(fill, 0));
+
+    fill[FLOW_JOB] = 1000;
+    TEST_ASSERT_FALSE(flow.update(fill, 100));
+    TEST_ASSERT_EQUAL_UINT32(1, flow.stats().episodes);
+    TEST_ASSERT_EQUAL_UINT32(1, flow.stats().trips[FLOW_JOB]);
+    TEST_ASSERT_EQUAL_UINT32(0, flow.stats().trips[FLOW_STREAM]);
+
+    // Below high is not enough, every buffer has to be down to its low mark
+    fill[FLOW_JOB] = 500;
+    TEST_ASSERT_FALSE(flow.update(fill, 200));
+    fill[FLOW_STREAM] = 40;
+    TEST_ASSERT_FALSE(flow.update(fill, 300));
+    TEST_ASSERT_EQUAL_UINT32(250, flow.notReadyUs(350));
+    fill[FLOW_GALVO] = 100;
+    TEST_ASSERT_TRUE(flow.update(fill, 400));
+    TEST_ASSERT_EQUAL_UINT32(300, flow.stats().not_ready_us);
+    TEST_ASSERT_EQUAL_UINT32(300, flow.stats().longest_not_ready_us);
+    TEST_ASSERT_EQUAL_UINT32(300, flow.notReadyUs(1000));
+
+    // Between the marks again: stays ready
+    fill[FLOW_JOB] = 999;
+    fill[FLOW_GALVO] = 899;
+    TEST_ASSERT_TRUE(flow.update(fill, 500));
+    TEST_ASSERT_EQUAL_UINT32(1, flow.stats().episodes);
+}
+
+static void test_low_above_high_is_clamped() {
+    FlowControl flow;
+    flow.setWatermarks(FLOW_STREAM, 10, 20);
+    uint16_t fill[FLOW_BUFFER_COUNT] = {10, 0, 0};
+    TEST_ASSERT_FALSE(flow.update(fill, 0));
+    fill[FLOW_STREAM] = 11;
+    TEST_ASSERT_FALSE(flow.update(fill, 1));
+    fill[FLOW_STREAM] = 10;
+    TEST_ASSERT_TRUE(flow.update(fill, 2));
+}
+
+// Random fills against the rule itself: READY only drops with some buffer at
+// or over its high mark, and only comes back with every buffer at or under
+// its low mark
+static void test_random_fills_follow_the_rule() {
+    FlowControl flow;
+    setAll(flow);
+    const uint16_t high[FLOW_BUFFER_COUNT] = {80, 1000, 900};
+    const uint16_t low[FLOW_BUFFER_COUNT] = {40, 500, 100};
+    std::mt19937 rng(1);
+    uint16_t fill[FLOW_BUFFER_COUNT] = {};
+    bool ready = true;
+    uint32_t drops = 0, wrong = 0;
+    for (uint32_t now = 0; now < 200000; now++) {
+        // Fills wander up and down, like buffers being filled and drained
+        for (int i = 0; i < FLOW_BUFFER_COUNT; i++) {
+            int step = (int)(rng() % 9) - 4;
+            int v = (int)fill[i] + step * (high[i] / 40 + 1);
+            fill[i] = (uint16_t)((v < 0) ? 0 : (v > high[i] + 20) ? high[i] + 20 : v);
+        }
+        bool anyHigh = false, allLow = true;
+        for (int i = 0; i < FLOW_BUFFER_COUNT; i++) {
+            if (fill[i] >= high[i]) anyHigh = true;
+            if (fill[i] > low[i]) allLow = false;
+        }
+        bool expect = ready ? !anyHigh : allLow;
+        bool got = flow.update(fill, now);
+        if (got != expect) wrong++;
+        if (ready && !got) drops++;
+        ready = got;
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, wrong);
+    TEST_ASSERT_TRUE(drops > 10);
+    TEST_ASSERT_EQUAL_UINT32(drops, flow.stats().episodes);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_drops_at_high_and_returns_at_low);
+    RUN_TEST(test_low_above_high_is_clamped);
+    RUN_TEST(test_random_fills_follow_the_rule);
+    return UNITY_END();
+}
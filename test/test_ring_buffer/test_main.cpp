@@ -0,0 +1,143 @@
+// RingBuffer (src/RingBuffer.h) under a real producer and consumer thread.
+//
+//   pio test -e native -f test_ring_buffer
+//
+// The producer writes a running sequence number through push(), push_span()
+// and reserve_contiguous()/commit() in turn, the consumer reads it back
+// through pop(), pop_span() and peek_contiguous()/consume() and checks every
+// item is the next number. Spans have odd lengths on a small ring, so they
+// keep crossing the wrap.
+
+#include <unity.h>
+#include <RingBuffer.h>
+#include <atomic>
+#include <thread>
+
+static const size_t RING_SIZE = 64;
+static const uint32_t ITEMS = 2000000;
+static const size_t MAX_SPAN = 23;
+
+typedef RingBuffer<uint32_t, RING_SIZE> Ring;
+
+void setUp() {}
+void tearDown() {}
+
+static void produce(Ring& ring) {
+    uint32_t next = 0;
+    uint32_t span[MAX_SPAN];
+    for (unsigned turn = 0; next < ITEMS; turn++) {
+        size_t want = 1 + turn % MAX_SPAN;
+        if (want > ITEMS - next) want = ITEMS - next;
+        size_t done = 0;
+        switch (turn % 3) {
+            case 0:
+                done = ring.push(next) ? 1 : 0;
+                break;
+            case 1:
+                for (size_t i = 0; i < want; i++) span[i] = next + i;
+                done = ring.push_span(span, want);
+                break;
+            case 2: {
+                uint32_t* window;
+                size_t room = ring.reserve_contiguous(window);
+                done = (room < want) ? room : want;
+                for (size_t i = 0; i < done; i++) window[i] = next + i;
+                ring.commit(done);
+                break;
+            }
+        }
+        next += done;
+        if (done == 0) std::this_thread::yield();
+    }
+}
+
+// Returns the number of items that were not the next in sequence
+static uint32_t consume(Ring& ring) {
+    uint32_t expect = 0;
+    uint32_t bad = 0;
+    uint32_t span[MAX_SPAN];
+    for (unsigned turn = 0; expect < ITEMS; turn++) {
+        size_t want = 1 + (turn * 7) % MAX_SPAN;
+        size_t got = 0;
+        switch (turn % 3) {
+            case 0: {
+                uint32_t v;
+                if (ring.pop(v)) {
+                    got = 1;
+                    bad += (v != expect);
+                }
+                break;
+            }
+            case 1:
+                got = ring.pop_span(span, want);
+                for (size_t i = 0; i < got; i++) bad += (span[i] != expect + i);
+                break;
+            case 2: {
+                const uint32_t* window;
+                size_t len = ring.peek_contiguous(window);
+                got = (len < want) ? len : want;
+                for (size_t i = 0; i < got; i++) bad += (window[i] != expect + i);
+                // peekAt() sees the same items as the window
+                uint32_t v;
+                if (got && (!ring.peekAt(got - 1, v) || v != expect + got - 1)) bad++;
+                ring.consume(got);
+                break;
+            }
+        }
+        if (ring.available() > RING_SIZE) bad++;
+        expect += got;
+        if (got == 0) std::this_thread::yield();
+    }
+    return bad;
+}
+
+static void test_two_threads_keep_sequence() {
+    static Ring ring;
+    std::atomic<uint32_t> bad{0};
+    std::thread consumer([&] { bad = consume(ring); });
+    std::thread producer([&] { produce(ring); });
+    producer.join();
+    consumer.join();
+    TEST_ASSERT_EQUAL_UINT32(0, bad.load());
+    TEST_ASSERT_TRUE(ring.isEmpty());
+}
+
+// One thread, spans across the wrap at every offset
+static void test_spans_across_the_wrap() {
+    static Ring ring;
+    uint32_t in[RING_SIZE], out[RING_SIZE];
+    uint32_t seq = 0;
+    size_t passed = 0;  // items through the ring, places the wrap
+    for (size_t offset = 0; offset < RING_SIZE; offset++) {
+        for (size_t n = 1; n <= RING_SIZE; n++) {
+            for (size_t i = 0; i < n; i++) in[i] = seq + i;
+            TEST_ASSERT_EQUAL(n, ring.push_span(in, n));
+            // A full ring takes no more
+            if (n == RING_SIZE) TEST_ASSERT_FALSE(ring.push(0));
+
+            const uint32_t* window;
+            size_t len = ring.peek_contiguous(window);
+            // The window stops at the end of the storage
+            size_t toEnd = RING_SIZE - (passed % RING_SIZE);
+            TEST_ASSERT_EQUAL(n < toEnd ? n : toEnd, len);
+            TEST_ASSERT_EQUAL_UINT32(seq, window[0]);
+
+            TEST_ASSERT_EQUAL(n, ring.pop_span(out, RING_SIZE));
+            for (size_t i = 0; i < n; i++) TEST_ASSERT_EQUAL_UINT32(seq + i, out[i]);
+            TEST_ASSERT_TRUE(ring.isEmpty());
+            seq += n;
+            passed += n;
+        }
+        // Move the start along by one
+        ring.push(0);
+        ring.consume(1);
+        passed++;
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_spans_across_the_wrap);
+    RUN_TEST(test_two_threads_keep_sequence);
+    return UNITY_END();
+}
@@ -0,0 +1,82 @@
+// Decodes a flight recorder dump (vendor opcode 0x00F0 or
+// LMCV4Driver::dumpFlightRecorder()) captured from the debug serial port.
+//
+//   g++ -std=gnu++17 -Isrc tools/flightrec_decode.cpp -o flightrec_decode
+//   flightrec_decode capture.bin
+//
+// The capture may contain other serial output around the dump, the decoder
+// looks for the "LMFR" header. Records from both cores are merged by time.
+
+#include "FlightRecorder.h"
+#include "LMCV4_Opcodes.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+static const char* sourceName(uint8_t source) {
+    switch (source) {
+        case FR_PARSED: return "PARSE";
+        case FR_SYSTEM: return "SYS";
+        case FR_EXECUTED: return "EXEC";
+        default: return "?";
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s capture.bin\n", argv[0]);
+        return 2;
+    }
+
+    FILE* f = fopen(argv[1], "rb");
+    if (!f) {
+        perror(argv[1]);
+        return 1;
+    }
+    std::vector<uint8_t> data;
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) data.insert(data.end(), buf, buf + n);
+    fclose(f);
+
+    // Find the last complete dump in the capture
+    size_t at = data.size();
+    for (size_t i = 0; i + sizeof(FlightDumpHeader) <= data.size(); i++) {
+        if (memcmp(&data[i], "LMFR", 4) == 0) at = i;
+    }
+    if (at == data.size()) {
+        fprintf(stderr, "no LMFR header found\n");
+        return 1;
+    }
+
+    FlightDumpHeader header;
+    memcpy(&header, &data[at], sizeof(header));
+    if (header.version != 1 || header.record_size != sizeof(FlightRecord)) {
+        fprintf(stderr, "unsupported dump version %u / record size %u\n", header.version, header.record_size);
+        return 1;
+    }
+
+    size_t first = at + sizeof(header);
+    size_t available = (data.size() - first) / sizeof(FlightRecord);
+    if (available < header.count) {
+        fprintf(stderr, "dump truncated: %zu of %u records\n", available, header.count);
+        header.count = (uint32_t)available;
+    }
+
+    std::vector<FlightRecord> records(header.count);
+    if (header.count) memcpy(records.data(), &data[first], header.count * sizeof(FlightRecord));
+
+    // Stable: keeps parse before exec for records with the same timestamp
+    std::stable_sort(records.begin(), records.end(),
+                     [](const FlightRecord& a, const FlightRecord& b) { return a.time_us < b.time_us; });
+
+    uint32_t t0 = records.empty() ? 0 : records.front().time_us;
+    printf("%12s %5s %6s %-14s %6s %6s %6s %6s\n", "t+us", "src", "opcode", "name", "p0", "p1", "jobq", "other");
+    for (const FlightRecord& r : records) {
+        printf("%12u %5s 0x%04X %-14s %6u %6u %6u %6u\n", r.time_us - t0, sourceName(r.source), r.opcode,
+               lmcv4OpcodeName(r.opcode), r.p0, r.p1, r.job_depth, r.other_depth);
+    }
+    return 0;
+}